@@ -0,0 +1,108 @@
+#
+# Copyright (C) 2015 OpenWrt.org
+#
+# This is free software, licensed under the GNU General Public License v2.
+# See /LICENSE for more information.
+#
+# Content addressed cache for prepared sources and build directories of
+# packages. Entries live in $(BUILD_CACHE_DIR)/{prepared,built}/<key>.tar.gz
+# and can be shared between build trees and machines.
+#
+# The prepared key covers the build directory name, the contents of the
+# package directory (Makefile, patches, files) and PKG_FILE_DEPENDS, the
+# values of PKG_PREPARED_DEPENDS and the build infrastructure in include/.
+# The built key adds the values of PKG_CONFIG_DEPENDS, the build variant,
+# the toolchain, the headers and libraries staged by the dependencies and,
+# for packages including kernel.mk, the kernel version, architecture,
+# .config and Module.symvers.
+#
+# Entries of PKG_BUILD_DEPENDS may name source, binary or host (foo/host)
+# packages; they are resolved to the installed stamps and pkginfo files,
+# which hold the hash of what was staged. If one of them has not been built
+# yet, the cache is skipped for the package.
+#
+# A cache hit only restores $(PKG_BUILD_DIR), so the cache is skipped for
+# packages with PKG_INSTALL_DIR outside of it. Packages whose prepare,
+# compile or install steps write anywhere else must set PKG_BUILD_CACHE:=0.
+
+ifneq ($(CONFIG_BUILD_CACHE),)
+ifeq ($(DUMP)$(QUILT)$(STAMP_NO_AUTOREBUILD),)
+  BUILD_CACHE_ENABLED:=1
+endif
+endif
+
+BUILD_CACHE_TOOLCHAIN_ID = \
+	$(REAL_GNU_TARGET_NAME) $(GCCV) $(LIBC)-$(LIBCV) $(ARCH_PACKAGES) \
+	$(BOARD) $(TARGET_CFLAGS) $(TARGET_CPPFLAGS) $(TARGET_LDFLAGS) \
+	$(DISABLE_IPV6) $(DISABLE_NLS)
+
+BUILD_CACHE_KERNEL_ID = \
+	$(if $(LINUX_VERMAGIC),$(LINUX_VERSION) $(LINUX_KARCH))
+
+BUILD_CACHE_KERNEL_FILES = \
+	$(if $(LINUX_VERMAGIC),$(wildcard $(LINUX_DIR)/.config $(LINUX_DIR)/Module.symvers))
+
+build_cache_vars=$(subst ',,$(foreach v,$(1),$(v)=$($(v))))
+
+# 1: condition of a dependency, SYMBOL or !SYMBOL
+build_cache_cond=$(if $(filter !%,$(1)),$(if $(CONFIG_$(patsubst !%,%,$(1))),,1),$(CONFIG_$(1)))
+
+# 1: dependency list, with conditional entries that do not apply dropped
+build_cache_deps=$(foreach dep,$(filter-out @%,$(patsubst +%,%,$(1))), \
+	$(if $(findstring :,$(dep)), \
+		$(if $(call build_cache_cond,$(firstword $(subst :,$(space),$(dep)))), \
+			$(lastword $(subst :,$(space),$(dep)))), \
+		$(dep)))
+
+# 1: build dependency
+build_cache_dep_file=$(firstword $(wildcard \
+	$(if $(filter %/host,$(1)), \
+		$(STAGING_DIR_HOST)/stamp/.$(patsubst %/host,%,$(1))_installed, \
+		$(STAGING_DIR)/stamp/.$(1)_installed $(STAGING_DIR)/pkginfo/$(1).staged)))
+
+define BuildCache/Setup
+  $(if $(filter 0,$(PKG_BUILD_CACHE)),$(eval BUILD_CACHE_ENABLED:=))
+  $(if $(filter $(PKG_BUILD_DIR)/%,$(PKG_INSTALL_DIR)),,$(eval BUILD_CACHE_ENABLED:=))
+  $(if $(BUILD_CACHE_ENABLED),
+    $(eval BUILD_CACHE_DEP_FILES:=$(foreach dep,$(call build_cache_deps,$(PKG_BUILD_DEPENDS)), \
+		$(or $(call build_cache_dep_file,$(dep)),$(eval BUILD_CACHE_ENABLED:=)))))
+  $(if $(BUILD_CACHE_ENABLED),
+    $(eval BUILD_CACHE_PREPARED:=$(shell $(SH_FUNC) { \
+		echo '$(patsubst $(BUILD_DIR)/%,%,$(PKG_BUILD_DIR)) $(call build_cache_vars,$(PKG_PREPARED_DEPENDS))'; \
+		$(call find_content_md5,${CURDIR} $(PKG_FILE_DEPENDS),); \
+		cat $(TOPDIR)/rules.mk $(INCLUDE_DIR)/*.mk; \
+	} | md5s))
+    $(eval BUILD_CACHE_BUILT:=$(shell $(SH_FUNC) { \
+		echo '$(BUILD_CACHE_PREPARED) $(BUILD_VARIANT) $(call build_cache_vars,$(PKG_CONFIG_DEPENDS))'; \
+		echo '$(subst ',,$(strip $(BUILD_CACHE_TOOLCHAIN_ID) $(BUILD_CACHE_KERNEL_ID)))'; \
+		cat /dev/null $(BUILD_CACHE_KERNEL_FILES) \
+			$(call find_staged_dependencies,$(DEPENDS)) $(BUILD_CACHE_DEP_FILES); \
+	} | md5s))
+    $(eval BUILD_CACHE_PREPARED_FILE:=$(BUILD_CACHE_DIR)/prepared/$(BUILD_CACHE_PREPARED).tar.gz)
+    $(eval BUILD_CACHE_BUILT_FILE:=$(BUILD_CACHE_DIR)/built/$(BUILD_CACHE_BUILT).tar.gz)
+    $(eval BUILD_CACHE_HIT:=$(wildcard $(BUILD_CACHE_BUILT_FILE)))
+    $(eval BUILD_CACHE_RESTORE:=$(or $(BUILD_CACHE_HIT),$(wildcard $(BUILD_CACHE_PREPARED_FILE))))
+  )
+endef
+
+# Unpack a cache entry into $(PKG_BUILD_DIR), unless it is already there.
+# 1: cache file
+define BuildCache/Restore
+	[ -f $(PKG_BUILD_DIR)/.cache_$(basename $(basename $(notdir $(1)))) ] || { \
+		echo "Restoring $(PKG_NAME) from $(1)"; \
+		rm -rf $(PKG_BUILD_DIR); \
+		mkdir -p $(PKG_BUILD_DIR); \
+		$(TAR) -C $(PKG_BUILD_DIR) -xzf $(1); \
+	}
+endef
+
+# Store $(PKG_BUILD_DIR) in the cache. Failing to do so is not fatal.
+# 1: cache file
+define BuildCache/Store
+	$(if $(BUILD_CACHE_ENABLED),-( \
+		touch $(PKG_BUILD_DIR)/.cache_$(basename $(basename $(notdir $(1)))); \
+		mkdir -p $(dir $(1)); \
+		$(TAR) -C $(PKG_BUILD_DIR) -czf $(1).$$$$$$$$ . && \
+			mv $(1).$$$$$$$$ $(1) || rm -f $(1).$$$$$$$$; \
+	))
+endef
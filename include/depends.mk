@@ -8,13 +8,23 @@
 # parameters:
 #	1: directories/files
 #	2: directory dependency
-#	3: tempfile for file listings
+#	3: if set, also rebuild if files were added or removed
 #	4: find options
+#
+# The directory listings are kept in a manifest under $(TMP_DIR)/dep, so
+# only directories that changed since the last check are read again. The
+# manifest name leaves out the hash in .prepared stamps, so a refreshed
+# stamp reuses and replaces the manifest of the previous one.
 
-DEP_FINDPARAMS := -x "*/.svn*" -x ".*" -x "*:*" -x "*\!*" -x "* *" -x "*\\\#*" -x "*/.*_check" -x "*/.*.swp"
+DEP_FINDPARAMS := -x "*/.svn*" -x ".*" -x "*:*" -x "*\!*" -x "* *" -x "*\\\#*" -x "*/.*_check" -x "*/.*.swp" -x "*/.dep_*"
 
 find_md5=$(SH_FUNC) find $(1) -type f $(patsubst -x,-and -not -path,$(DEP_FINDPARAMS) $(2)) | md5s
 
+# like find_md5, but covers the file contents, with names relative to $(TOPDIR)
+find_content_md5=$(SH_FUNC) ( cd $(TOPDIR); $(FIND) $(patsubst $(TOPDIR)/%,%,$(1)) -type f $(patsubst -x,-and -not -path,$(DEP_FINDPARAMS) $(2)) -print0 | LC_ALL=C sort -z | $(XARGS) -0 md5sum ) | md5s
+
+dep_manifest=$(TMP_DIR)/dep/$(subst /,_,$(patsubst $(TOPDIR)/%,%,$(dir $(1))))$(if $(filter .prepared%,$(notdir $(1))),.prepared,$(notdir $(1)))
+
 define rdep
   .PRECIOUS: $(2)
   .SILENT: $(2)_check
@@ -23,13 +33,9 @@ define rdep
 
 ifneq ($(wildcard $(2)),)
   $(2)_check::
-	$(if $(3), \
-		$(call find_md5,$(1),$(4)) > $(3).1; \
-		{ [ \! -f "$(3)" ] || diff $(3) $(3).1 >/dev/null; } && \
-	) \
+	mkdir -p $(TMP_DIR)/dep
 	{ \
-		[ -f "$(2)_check.1" ] && mv "$(2)_check.1"; \
-	    $(TOPDIR)/scripts/timestamp.pl $(DEP_FINDPARAMS) $(4) -n $(2) $(1) && { \
+	    $(TOPDIR)/scripts/timestamp.pl $(DEP_FINDPARAMS) $(4) -m $(call dep_manifest,$(2)) $(if $(3),-l) -n $(2) $(1) && { \
 			$(call debug_eval,$(SUBDIR),r,echo "No need to rebuild $(2)";) \
 			touch -r "$(2)" "$(2)_check"; \
 		} \
@@ -37,10 +43,9 @@ ifneq ($(wildcard $(2)),)
 		$(call debug_eval,$(SUBDIR),r,echo "Need to rebuild $(2)";) \
 		touch "$(2)_check"; \
 	}
-	$(if $(3), mv $(3).1 $(3))
 else
   $(2)_check::
-	$(if $(3), rm -f $(3) $(3).1)
+	rm -f $(call dep_manifest,$(2))
 	$(call debug_eval,$(SUBDIR),r,echo "Target $(2) not built")
 endif
 
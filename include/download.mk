@@ -7,7 +7,7 @@
 
 OPENWRT_GIT = http://git.openwrt.org
 
-DOWNLOAD_RDEP=$(STAMP_PREPARED) $(HOST_STAMP_PREPARED)
+DOWNLOAD_RDEP=$(if $(BUILD_CACHE_RESTORE),,$(STAMP_PREPARED)) $(HOST_STAMP_PREPARED)
 
 # Try to guess the download method from the URL
 define dl_method
@@ -47,6 +47,16 @@ define DownloadMethod/default
 	$(SCRIPT_DIR)/download.pl "$(DL_DIR)" "$(FILE)" "$(MD5SUM)" $(foreach url,$(URL),"$(url)")
 endef
 
+# With DOWNLOAD_LIST set, downloads are only recorded in that file, so that
+# they can be fetched in parallel by download.pl -f before the actual pass.
+define DownloadList/default
+	echo '"$(DL_DIR)" "$(FILE)" "$(MD5SUM)" $(foreach url,$(URL),"$(url)")' >> $(DOWNLOAD_LIST)
+endef
+
+define DownloadList/mirror
+	$(if $(if $(MIRROR),$(filter-out x,$(MIRROR_MD5SUM))),echo '"$(DL_DIR)" "$(FILE)" "$(MIRROR_MD5SUM)"' >> $(DOWNLOAD_LIST),true)
+endef
+
 define wrap_mirror
 	$(if $(if $(MIRROR),$(filter-out x,$(MIRROR_MD5SUM))),@$(SCRIPT_DIR)/download.pl "$(DL_DIR)" "$(FILE)" "$(MIRROR_MD5SUM)" || ( $(1) ),$(1))
 endef
@@ -181,6 +191,10 @@ define Download
 
   $(DL_DIR)/$(FILE):
 	mkdir -p $(DL_DIR)
+  ifneq ($(DOWNLOAD_LIST),)
+	$(if $(filter default,$(call dl_method,$(URL),$(PROTO))),$(DownloadList/default),$(DownloadList/mirror))
+  else
 	$(if $(DownloadMethod/$(call dl_method,$(URL),$(PROTO))),$(DownloadMethod/$(call dl_method,$(URL),$(PROTO))),$(DownloadMethod/unknown))
+  endif
 
 endef
@@ -175,7 +175,7 @@ ifndef DUMP
 		$(foreach hook,$(Hooks/HostInstall/Post),$(call $(hook))$(sep))
 		mkdir -p $$(shell dirname $$@)
 		touch $(HOST_STAMP_BUILT)
-		touch $$@
+		$(call find_content_md5,${CURDIR} $(PKG_FILE_DEPENDS),) > $$@
 
   ifndef STAMP_BUILT
     prepare: host-prepare
@@ -262,13 +262,46 @@ define Image/Checksum
 	)
 endef
 
-define BuildImage/mkfs
-  install: mkfs-$(1)
-  .PHONY: mkfs-$(1)
+# Hash of the rootfs contents and metadata, only rewritten when it changes
+define Image/mkfs/hash
+	$(SH_FUNC) ( cd $(TARGET_DIR); \
+		$(FIND) . -printf '%y %m %U %G %n %s %l %p\n' | LC_ALL=C sort; \
+		$(FIND) . -type f -print0 | LC_ALL=C sort -z | $(XARGS) -0 -r md5sum; \
+	) | md5s > $(1).new
+	cmp -s $(1) $(1).new && rm -f $(1).new || mv $(1).new $(1)
+endef
+
+# Filesystems that are generated as $(KDIR)/root.<type> by their
+# Image/mkfs command. Their last image is kept and reused as long as the
+# rootfs hash and the mkfs command line stay the same.
+MKFS_CACHE_TYPES := squashfs jffs2-% ext4
+
+define BuildImage/mkfs/cached
+  $(KDIR)/.root.$(1).cmd: mkfs_prepare
+	@echo '$(subst ','\'',$(subst $(newline), ,$(Image/mkfs/$(1))))' > $$@.new
+	@cmp -s $$@ $$@.new && rm -f $$@.new || mv $$@.new $$@
+
+  $(KDIR)/.root.$(1).img: $(KDIR)/root.hash $(KDIR)/.root.$(1).cmd
+	$(Image/mkfs/$(1))
+	[ ! -f $(KDIR)/root.$(1) ] || cp $(KDIR)/root.$(1) $$@
+
+  mkfs-$(1): $(KDIR)/.root.$(1).img
+	[ ! -f $$< ] || cmp -s $$< $(KDIR)/root.$(1) || cp $$< $(KDIR)/root.$(1)
+	$(call Build/mkfs/default,$(1))
+	$(call Build/mkfs/$(1),$(1))
+endef
+
+define BuildImage/mkfs/default
   mkfs-$(1): mkfs_prepare
 	$(Image/mkfs/$(1))
 	$(call Build/mkfs/default,$(1))
 	$(call Build/mkfs/$(1),$(1))
+endef
+
+define BuildImage/mkfs
+  install: mkfs-$(1)
+  .PHONY: mkfs-$(1)
+  $(if $(filter $(MKFS_CACHE_TYPES),$(1)),$(BuildImage/mkfs/cached),$(BuildImage/mkfs/default))
   $(KDIR)/root.$(1): mkfs-$(1)
 
 endef
@@ -472,6 +505,9 @@ define BuildImage
   mkfs_prepare: image_prepare
 	$(call Image/mkfs/prepare)
 
+  $(KDIR)/root.hash: mkfs_prepare
+	$(call Image/mkfs/hash,$$@)
+
   kernel_prepare: mkfs_prepare
 	$(call Image/BuildKernel)
 	$(if $(CONFIG_TARGET_ROOTFS_INITRAMFS),$(if $(IB),,$(call Image/BuildKernel/Initramfs)))
@@ -9,7 +9,7 @@ include $(INCLUDE_DIR)/feeds.mk
 
 # invoke ipkg-build with some default options
 IPKG_BUILD:= \
-  $(SCRIPT_DIR)/ipkg-build -c -o 0 -g 0
+  $(STAGING_DIR_HOST)/bin/ipkg-build -c -o 0 -g 0
 
 IPKG_STATE_DIR:=$(TARGET_DIR)/usr/lib/opkg
 
@@ -101,6 +101,7 @@ ifeq ($(DUMP),)
         ifneq ($(ABI_VERSION),)
         compile: $(PKG_INFO_DIR)/$(1).version
         endif
+        compile: $(PKG_INFO_DIR)/$(1).staged
 
         ifeq ($(CONFIG_PACKAGE_$(1)),y)
           .PHONY: $(PKG_INSTALL_STAMP).$(1)
@@ -144,6 +145,11 @@ ifeq ($(DUMP),)
 	echo '$(ABI_VERSION)' | cmp -s - $$@ || \
 		echo '$(ABI_VERSION)' > $$@
 
+    $(PKG_INFO_DIR)/$(1).staged: $(STAMP_BUILT) $(if $(filter-out undefined,$(origin Build/InstallDev)),$(STAMP_INSTALLED))
+	mkdir -p $(PKG_INFO_DIR)
+	$(StagingFilesHash) > $$@.tmp
+	cmp -s $$@.tmp $$@ && rm -f $$@.tmp || mv $$@.tmp $$@
+
     Package/$(1)/DEPENDS := $$(call mergelist,$$(filter-out @%,$$(IDEPEND_$(1))))
     ifneq ($$(EXTRA_DEPENDS),)
       Package/$(1)/DEPENDS := $$(EXTRA_DEPENDS)$$(if $$(Package/$(1)/DEPENDS),$$(comma) $$(Package/$(1)/DEPENDS))
@@ -81,7 +81,7 @@ include $(INCLUDE_DIR)/host.mk
 include $(INCLUDE_DIR)/unpack.mk
 include $(INCLUDE_DIR)/depends.mk
 
-find_library_dependencies = $(wildcard $(patsubst %,$(STAGING_DIR)/pkginfo/%.version, \
+find_pkginfo_dependencies = $(wildcard $(patsubst %,$(STAGING_DIR)/pkginfo/%.$(2), \
 	$(filter-out $(BUILD_PACKAGES),$(foreach dep, \
 		$(filter-out @%, $(patsubst +%,%,$(1))), \
 		$(if $(findstring :,$(dep)), \
@@ -89,6 +89,8 @@ find_library_dependencies = $(wildcard $(patsubst %,$(STAGING_DIR)/pkginfo/%.ver
 			$(dep) \
 		) \
 	))))
+find_library_dependencies = $(call find_pkginfo_dependencies,$(1),version)
+find_staged_dependencies = $(call find_pkginfo_dependencies,$(1),staged)
 
 STAMP_NO_AUTOREBUILD=$(wildcard $(PKG_BUILD_DIR)/.no_autorebuild)
 PREV_STAMP_PREPARED:=$(if $(STAMP_NO_AUTOREBUILD),$(wildcard $(PKG_BUILD_DIR)/.prepared*))
@@ -105,6 +107,17 @@ STAMP_INSTALLED:=$(STAGING_DIR)/stamp/.$(PKG_NAME)$(if $(BUILD_VARIANT),.$(BUILD
 
 STAGING_FILES_LIST:=$(PKG_NAME)$(if $(BUILD_VARIANT),.$(BUILD_VARIANT),).list
 
+# md5 of the names and contents of the files staged by this package
+define StagingFilesHash
+	( cd $(STAGING_DIR); $(SH_FUNC) \
+		cat packages/$(STAGING_FILES_LIST) 2>/dev/null | \
+		LC_ALL=C sort | while read FILE; do \
+			[ -f "$$$$FILE" ] || continue; \
+			echo "$$$$FILE"; cat "$$$$FILE"; \
+		done | md5s \
+	)
+endef
+
 define CleanStaging
 	rm -f $(STAMP_INSTALLED)
 	@-(\
@@ -136,6 +149,7 @@ include $(INCLUDE_DIR)/package-dumpinfo.mk
 include $(INCLUDE_DIR)/package-ipkg.mk
 include $(INCLUDE_DIR)/package-bin.mk
 include $(INCLUDE_DIR)/autotools.mk
+include $(INCLUDE_DIR)/build-cache.mk
 
 override MAKEFLAGS=
 CONFIG_SITE:=$(INCLUDE_DIR)/site/$(ARCH)
@@ -147,8 +161,7 @@ unexport QUIET CONFIG_SITE
 ifeq ($(DUMP)$(filter prereq clean refresh update,$(MAKECMDGOALS)),)
   ifneq ($(if $(QUILT),,$(CONFIG_AUTOREBUILD)),)
     define Build/Autoclean
-      $(PKG_BUILD_DIR)/.dep_files: $(STAMP_PREPARED)
-      $(call rdep,${CURDIR} $(PKG_FILE_DEPENDS),$(STAMP_PREPARED),$(PKG_BUILD_DIR)/.dep_files,-x "*/.dep_*")
+      $(call rdep,${CURDIR} $(PKG_FILE_DEPENDS),$(STAMP_PREPARED),1,-x "*/.dep_*")
       $(if $(filter prepare,$(MAKECMDGOALS)),,$(call rdep,$(PKG_BUILD_DIR),$(STAMP_BUILT),,-x "*/.dep_*" -x "*/ipkg*"))
     endef
   endif
@@ -194,6 +207,7 @@ Build/Exports=$(Build/Exports/Default)
 
 define Build/DefaultTargets
   $(if $(QUILT),$(Build/Quilt))
+  $(call BuildCache/Setup)
   $(if $(USE_SOURCE_DIR)$(USE_GIT_TREE),,$(if $(strip $(PKG_SOURCE_URL)),$(call Download,default)))
   $(call Build/Autoclean)
 
@@ -206,28 +220,43 @@ define Build/DefaultTargets
   $(STAMP_PREPARED):
 	@-rm -rf $(PKG_BUILD_DIR)
 	@mkdir -p $(PKG_BUILD_DIR)
+    ifneq ($(BUILD_CACHE_RESTORE),)
+	$(call BuildCache/Restore,$(BUILD_CACHE_RESTORE))
+    else
 	$(foreach hook,$(Hooks/Prepare/Pre),$(call $(hook))$(sep))
 	$(Build/Prepare)
 	$(foreach hook,$(Hooks/Prepare/Post),$(call $(hook))$(sep))
+	$(call BuildCache/Store,$(BUILD_CACHE_PREPARED_FILE))
+    endif
 	touch $$@
 
   $(call Build/Exports,$(STAMP_CONFIGURED))
   $(STAMP_CONFIGURED): $(STAMP_PREPARED)
 	$(CleanStaging)
+    ifneq ($(BUILD_CACHE_HIT),)
+	$(call BuildCache/Restore,$(BUILD_CACHE_HIT))
+    else
 	$(foreach hook,$(Hooks/Configure/Pre),$(call $(hook))$(sep))
 	$(Build/Configure)
 	$(foreach hook,$(Hooks/Configure/Post),$(call $(hook))$(sep))
+    endif
 	rm -f $(STAMP_CONFIGURED_WILDCARD)
 	touch $$@
 
   $(call Build/Exports,$(STAMP_BUILT))
   $(STAMP_BUILT): $(STAMP_CONFIGURED)
+    ifneq ($(BUILD_CACHE_HIT),)
+	$(call BuildCache/Restore,$(BUILD_CACHE_HIT))
+	touch $$@
+    else
 	$(foreach hook,$(Hooks/Compile/Pre),$(call $(hook))$(sep))
 	$(Build/Compile)
 	$(foreach hook,$(Hooks/Compile/Post),$(call $(hook))$(sep))
 	$(Build/Install)
 	$(foreach hook,$(Hooks/Install/Post),$(call $(hook))$(sep))
 	touch $$@
+	$(call BuildCache/Store,$(BUILD_CACHE_BUILT_FILE))
+    endif
 
   $(STAMP_INSTALLED) : export PATH=$$(TARGET_PATH_PKG)
   $(STAMP_INSTALLED): $(STAMP_BUILT)
@@ -253,7 +282,7 @@ define Build/DefaultTargets
 		,staging-dir); \
 	fi
 	rm -rf $(TMP_DIR)/stage-$(PKG_NAME)
-	touch $$@
+	$(StagingFilesHash) > $$@
 
   ifdef Build/InstallDev
     compile: $(STAMP_INSTALLED)
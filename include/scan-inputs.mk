@@ -0,0 +1,15 @@
+#
+# Copyright (C) 2015 OpenWrt.org
+#
+# This is free software, licensed under the GNU General Public License v2.
+# See /LICENSE for more information.
+#
+
+# Read after a package/target Makefile by include/scan.mk. Records every
+# makefile that went into the metadata dump, so that the scan cache can
+# tell when a cached dump has gone stale.
+
+ifneq ($(SCAN_INPUTS_FILE),)
+  __scan_inputs:=$(filter-out $(TOPDIR)/.config $(abspath $(lastword $(MAKEFILE_LIST))),$(abspath $(MAKEFILE_LIST)))
+  __scan_inputs:=$(shell echo $(__scan_inputs) | tr ' ' '\n' > $(SCAN_INPUTS_FILE))
+endif
@@ -11,6 +11,7 @@ SCAN_DIR ?= package
 TARGET_STAMP:=$(TMP_DIR)/info/.files-$(SCAN_TARGET).stamp
 FILELIST:=$(TMP_DIR)/info/.files-$(SCAN_TARGET)-$(SCAN_COOKIE)
 OVERRIDELIST:=$(TMP_DIR)/info/.overrides-$(SCAN_TARGET)-$(SCAN_COOKIE)
+SCAN_CACHE:=$(TMP_DIR)/info/.cache-$(SCAN_TARGET)
 
 ifeq ($(IS_TTY),1)
   define progress
@@ -26,19 +27,53 @@ define feedname
 $(if $(patsubst feeds/%,,$(1)),,$(word 2,$(subst /, ,$(1))))
 endef
 
+# $(1) => package dir relative to $(SCAN_DIR)
+define scan_deps
+$(foreach DEP,$(DEPS_$(SCAN_DIR)/$(1)/Makefile) $(SCAN_DEPS),$(wildcard $(if $(filter /%,$(DEP)),$(DEP),$(SCAN_DIR)/$(1)/$(DEP))))
+endef
+
+# Hash over everything a cached dump depends on: the makefiles recorded
+# while dumping, the package's own SCAN_DEPS and the names (not contents)
+# of the global SCAN_DEPS, which only matter once they are actually included.
+# $(1) => cache dir, $(2) => package dir relative to $(SCAN_DIR)
+define scan_hash
+{ \
+	echo "$(call feedname,$(2)) $(SCAN_MAKEOPTS) $(call scan_deps,$(2))"; \
+	cat $(1)/inputs $$(cat $(1)/inputs) $(filter-out /%,$(call scan_deps,$(2))); \
+} 2>/dev/null | (md5sum || md5) 2>/dev/null | awk '{print $$1}'
+endef
+
+# Print the metadata of a package, from the cache if none of its inputs
+# changed since the last dump.
+# $(1) => info file suffix, $(2) => package dir relative to $(SCAN_DIR)
+define scan_dump
+	c="$(SCAN_CACHE)/$(1)"; \
+	if [ -s "$$c/hash" ] && [ "$$($(call scan_hash,$$c,$(2)))" = "$$(cat "$$c/hash")" ]; then \
+		cat "$$c/dump"; \
+	else \
+		$(call progress,Collecting $(SCAN_NAME) info: $(SCAN_DIR)/$(2)) \
+		rm -rf "$$c"; \
+		mkdir -p "$$c"; \
+		if $(NO_TRACE_MAKE) --no-print-dir -r DUMP=1 FEED="$(call feedname,$(2))" -C $(SCAN_DIR)/$(2) -f Makefile -f $(TOPDIR)/include/scan-inputs.mk SCAN_INPUTS_FILE="$$c/inputs" $(SCAN_MAKEOPTS) > "$$c/dump" 2>/dev/null; then \
+			$(call scan_hash,$$c,$(2)) > "$$c/hash"; \
+			cat "$$c/dump"; \
+		else \
+			rm -rf "$$c"; \
+			mkdir -p "$(TOPDIR)/logs/$(SCAN_DIR)/$(2)"; \
+			$(NO_TRACE_MAKE) --no-print-dir -r DUMP=1 FEED="$(call feedname,$(2))" -C $(SCAN_DIR)/$(2) $(SCAN_MAKEOPTS) > $(TOPDIR)/logs/$(SCAN_DIR)/$(2)/dump.txt 2>&1; \
+			$(call progress,ERROR: please fix $(SCAN_DIR)/$(2)/Makefile - see logs/$(SCAN_DIR)/$(2)/dump.txt for details\n) \
+			rm -f $@; \
+		fi; \
+	fi
+endef
+
 define PackageDir
   $(TMP_DIR)/.$(SCAN_TARGET): $(TMP_DIR)/info/.$(SCAN_TARGET)-$(1)
-  $(TMP_DIR)/info/.$(SCAN_TARGET)-$(1): $(SCAN_DIR)/$(2)/Makefile $(SCAN_STAMP) $(foreach DEP,$(DEPS_$(SCAN_DIR)/$(2)/Makefile) $(SCAN_DEPS),$(wildcard $(if $(filter /%,$(DEP)),$(DEP),$(SCAN_DIR)/$(2)/$(DEP))))
+  $(TMP_DIR)/info/.$(SCAN_TARGET)-$(1): $(SCAN_DIR)/$(2)/Makefile $(call scan_deps,$(2))
 	{ \
-		$$(call progress,Collecting $(SCAN_NAME) info: $(SCAN_DIR)/$(2)) \
 		echo Source-Makefile: $(SCAN_DIR)/$(2)/Makefile; \
 		$(if $(3),echo Override: $(3),true); \
-		$(NO_TRACE_MAKE) --no-print-dir -r DUMP=1 FEED="$(call feedname,$(2))" -C $(SCAN_DIR)/$(2) $(SCAN_MAKEOPTS) 2>/dev/null || { \
-			mkdir -p "$(TOPDIR)/logs/$(SCAN_DIR)/$(2)"; \
-			$(NO_TRACE_MAKE) --no-print-dir -r DUMP=1 FEED="$(call feedname,$(2))" -C $(SCAN_DIR)/$(2) $(SCAN_MAKEOPTS) > $(TOPDIR)/logs/$(SCAN_DIR)/$(2)/dump.txt 2>&1; \
-			$$(call progress,ERROR: please fix $(SCAN_DIR)/$(2)/Makefile - see logs/$(SCAN_DIR)/$(2)/dump.txt for details\n) \
-			rm -f $$@; \
-		}; \
+		$$(call scan_dump,$(1),$(2)); \
 		echo; \
 	} > $$@ || true
 endef
@@ -91,7 +126,7 @@ $(TARGET_STAMP)::
 		} \
 	)
 
-$(TMP_DIR)/.$(SCAN_TARGET): $(TARGET_STAMP) $(SCAN_STAMP)
+$(TMP_DIR)/.$(SCAN_TARGET): $(TARGET_STAMP)
 	$(call progress,Collecting $(SCAN_NAME) info: merging...)
 	-cat $(FILELIST) | awk '{gsub(/\//, "_", $$0);print "$(TMP_DIR)/info/.$(SCAN_TARGET)-" $$0}' | xargs cat > $@ 2>/dev/null
 	$(call progress,Collecting $(SCAN_NAME) info: done)
@@ -99,4 +134,3 @@ $(TMP_DIR)/.$(SCAN_TARGET): $(TARGET_STAMP) $(SCAN_STAMP)
 
 FORCE:
 .PHONY: FORCE
-.NOTPARALLEL:
@@ -53,6 +53,7 @@
 #include <linux/types.h>
 #include <linux/errno.h>
 #include <linux/crypto.h>
+#include <linux/atomic.h>
 #include <linux/interrupt.h>
 #include <linux/delay.h>
 #include <asm/byteorder.h>
@@ -114,8 +115,26 @@ struct aes_ctx {
     int key_length;
     u32 buf[AES_MAX_KEY_SIZE];
     u8 nonce[CTR_RFC3686_NONCE_SIZE];
+    u32 key_id;
 };
 
+/* Every setkey hands out a new key id. As long as the id of a context
+   matches aes_loaded_key, its key is still in the engine and neither the
+   key registers nor the decryption key preprocessing need to be redone. */
+static atomic_t aes_key_seq = ATOMIC_INIT(0);
+static u32 aes_loaded_key;
+
+static u32 aes_new_key_id(void)
+{
+    u32 id;
+
+    do {
+        id = atomic_inc_return(&aes_key_seq);
+    } while (!id);
+
+    return id;
+}
+
 extern int disable_deudma;
 extern int disable_multiblock; 
 
@@ -144,6 +163,7 @@ int aes_set_key (struct crypto_tfm *tfm, const u8 *in_key, unsigned int key_len)
     ctx->key_length = key_len;
     DPRINTF(0, "ctx @%p, key_len %d, ctx->key_length %d\n", ctx, key_len, ctx->key_length);
     memcpy ((u8 *) (ctx->buf), in_key, key_len);
+    ctx->key_id = aes_new_key_id();
 
     return 0;
 }
@@ -178,6 +198,9 @@ void ifx_deu_aes (void *ctx_arg, u8 *out_arg, const u8 *in_arg,
 
 
     CRTCL_SECT_START;
+    if (ctx->key_id && ctx->key_id == aes_loaded_key)
+        goto key_loaded;
+
     /* 128, 192 or 256 bit key length */
     aes->controlr.K = key_len / 8 - 2;
         if (key_len == 128 / 8) {
@@ -214,7 +237,9 @@ void ifx_deu_aes (void *ctx_arg, u8 *out_arg, const u8 *in_arg,
        ENcryption is used). Key Valid (KV) bit is then only
        checked in decryption routine! */
     aes->controlr.PNK = 1;
+    aes_loaded_key = ctx->key_id;
 
+key_loaded:
 
     aes->controlr.E_D = !encdec;    //encryption
     aes->controlr.O = mode; //0 ECB 1 CBC 2 OFB 3 CFB 4 CTR 
@@ -250,12 +275,13 @@ void ifx_deu_aes (void *ctx_arg, u8 *out_arg, const u8 *in_arg,
     }
 
 
-    //tc.chen : copy iv_arg back
+    /* hand the chaining value of the last block back, so the next walk
+       chunk continues where this one stopped */
     if (mode > 0) {
-        *((u32 *) iv_arg) = DEU_ENDIAN_SWAP(*((u32 *) iv_arg));
-        *((u32 *) iv_arg + 1) = DEU_ENDIAN_SWAP(*((u32 *) iv_arg + 1));             
-        *((u32 *) iv_arg + 2) = DEU_ENDIAN_SWAP(*((u32 *) iv_arg + 2));             
-        *((u32 *) iv_arg + 3) = DEU_ENDIAN_SWAP(*((u32 *) iv_arg + 3));              
+        *((u32 *) iv_arg) = DEU_ENDIAN_SWAP(aes->IV3R);
+        *((u32 *) iv_arg + 1) = DEU_ENDIAN_SWAP(aes->IV2R);
+        *((u32 *) iv_arg + 2) = DEU_ENDIAN_SWAP(aes->IV1R);
+        *((u32 *) iv_arg + 3) = DEU_ENDIAN_SWAP(aes->IV0R);
     }
 
     CRTCL_SECT_END;
@@ -291,6 +317,7 @@ int ctr_rfc3686_aes_set_key (struct crypto_tfm *tfm, const uint8_t *in_key, unsi
     ctx->key_length = key_len;
     
     memcpy ((u8 *) (ctx->buf), in_key, key_len);
+    ctx->key_id = aes_new_key_id();
 
     return 0;
 }
@@ -438,6 +465,7 @@ struct crypto_alg ifxdeu_aes_alg = {
     .cra_flags      =   CRYPTO_ALG_TYPE_CIPHER,
     .cra_blocksize      =   AES_BLOCK_SIZE,
     .cra_ctxsize        =   sizeof(struct aes_ctx),
+    .cra_alignmask      =   3,
     .cra_module     =   THIS_MODULE,
     .cra_list       =   LIST_HEAD_INIT(ifxdeu_aes_alg.cra_list),
     .cra_u          =   {
@@ -522,6 +550,7 @@ struct crypto_alg ifxdeu_ecb_aes_alg = {
     .cra_flags      =   CRYPTO_ALG_TYPE_BLKCIPHER,
     .cra_blocksize      =   AES_BLOCK_SIZE,
     .cra_ctxsize        =   sizeof(struct aes_ctx),
+    .cra_alignmask      =   3,
     .cra_type       =   &crypto_blkcipher_type,
     .cra_module     =   THIS_MODULE,
     .cra_list       =   LIST_HEAD_INIT(ifxdeu_ecb_aes_alg.cra_list),
@@ -610,6 +639,7 @@ struct crypto_alg ifxdeu_cbc_aes_alg = {
     .cra_flags      =   CRYPTO_ALG_TYPE_BLKCIPHER,
     .cra_blocksize      =   AES_BLOCK_SIZE,
     .cra_ctxsize        =   sizeof(struct aes_ctx),
+    .cra_alignmask      =   3,
     .cra_type       =   &crypto_blkcipher_type,
     .cra_module     =   THIS_MODULE,
     .cra_list       =   LIST_HEAD_INIT(ifxdeu_cbc_aes_alg.cra_list),
@@ -699,6 +729,7 @@ struct crypto_alg ifxdeu_ctr_basic_aes_alg = {
     .cra_flags      =   CRYPTO_ALG_TYPE_BLKCIPHER,
     .cra_blocksize      =   AES_BLOCK_SIZE,
     .cra_ctxsize        =   sizeof(struct aes_ctx),
+    .cra_alignmask      =   3,
     .cra_type       =   &crypto_blkcipher_type,
     .cra_module     =   THIS_MODULE,
     .cra_list       =   LIST_HEAD_INIT(ifxdeu_ctr_basic_aes_alg.cra_list),
@@ -804,6 +835,7 @@ struct crypto_alg ifxdeu_ctr_rfc3686_aes_alg = {
     .cra_flags      	=   CRYPTO_ALG_TYPE_BLKCIPHER,
     .cra_blocksize      =   AES_BLOCK_SIZE,
     .cra_ctxsize        =   sizeof(struct aes_ctx),
+    .cra_alignmask      =   3,
     .cra_type       	=   &crypto_blkcipher_type,
     .cra_module     	=   THIS_MODULE,
     .cra_list       	=   LIST_HEAD_INIT(ifxdeu_ctr_rfc3686_aes_alg.cra_list),
@@ -46,6 +46,7 @@
 #include <linux/types.h>
 #include <linux/errno.h>
 #include <linux/crypto.h>
+#include <linux/atomic.h>
 #include <linux/interrupt.h>
 #include <linux/delay.h>
 #include <asm/byteorder.h>
@@ -110,8 +111,25 @@ struct des_ctx {
         int key_length;
         u8 iv[DES_BLOCK_SIZE];
         u32 expkey[DES3_EDE_EXPKEY_WORDS];
+        u32 key_id;
 };
 
+/* Same as for AES: a context whose key id matches des_loaded_key still
+   has its mode and keys programmed into the engine. */
+static atomic_t des_key_seq = ATOMIC_INIT(0);
+static u32 des_loaded_key;
+
+static u32 des_new_key_id(void)
+{
+        u32 id;
+
+        do {
+                id = atomic_inc_return(&des_key_seq);
+        } while (!id);
+
+        return id;
+}
+
 extern int disable_multiblock;
 extern int disable_deudma;
 
@@ -134,6 +152,7 @@ int des_setkey(struct crypto_tfm *tfm, const u8 *key,
         dctx->key_length = keylen;
 
         memcpy ((u8 *) (dctx->expkey), key, keylen);
+        dctx->key_id = des_new_key_id();
 
         return 0;
 }
@@ -164,6 +183,9 @@ void ifx_deu_des (void *ctx_arg, u8 *out_arg, const u8 *in_arg,
         
         CRTCL_SECT_START;
 
+        if (dctx->key_id && dctx->key_id == des_loaded_key)
+                goto key_loaded;
+
         des->controlr.M = dctx->controlr_M;
         if (dctx->controlr_M == 0)      // des
         {
@@ -194,6 +216,9 @@ void ifx_deu_des (void *ctx_arg, u8 *out_arg, const u8 *in_arg,
                         return;
                 }
         }
+        des_loaded_key = dctx->key_id;
+
+key_loaded:
 
         des->controlr.E_D = !encdec;    //encryption
         des->controlr.O = mode; //0 ECB 1 CBC 2 OFB 3 CFB 4 CTR hexdump(prin,sizeof(*des));
@@ -406,6 +431,7 @@ int des3_ede_setkey(struct crypto_tfm *tfm, const u8 *key,
         dctx->key_length = keylen;
 
         memcpy ((u8 *) (dctx->expkey), key, keylen);
+        dctx->key_id = des_new_key_id();
 
         return 0;
 }
@@ -523,6 +549,7 @@ struct crypto_alg ifxdeu_ecb_des_alg = {
         .cra_ctxsize            =       sizeof(struct des_ctx),
         .cra_type               =       &crypto_blkcipher_type,
         .cra_module             =       THIS_MODULE,
+        .cra_alignmask          =       3,
         .cra_list               =       LIST_HEAD_INIT(ifxdeu_ecb_des_alg.cra_list),
         .cra_u                  =       {
                 .blkcipher = {
@@ -546,6 +573,7 @@ struct crypto_alg ifxdeu_ecb_des3_ede_alg = {
         .cra_ctxsize            =       sizeof(struct des_ctx),
         .cra_type               =       &crypto_blkcipher_type,
         .cra_module             =       THIS_MODULE,
+        .cra_alignmask          =       3,
         .cra_list               =       LIST_HEAD_INIT(ifxdeu_ecb_des3_ede_alg.cra_list),
         .cra_u                  =       {
                 .blkcipher = {
@@ -635,6 +663,7 @@ struct crypto_alg ifxdeu_cbc_des_alg = {
         .cra_ctxsize            =       sizeof(struct des_ctx),
         .cra_type               =       &crypto_blkcipher_type,
         .cra_module             =       THIS_MODULE,
+        .cra_alignmask          =       3,
         .cra_list               =       LIST_HEAD_INIT(ifxdeu_cbc_des_alg.cra_list),
         .cra_u                  =       {
                 .blkcipher = {
@@ -659,6 +688,7 @@ struct crypto_alg ifxdeu_cbc_des3_ede_alg = {
         .cra_ctxsize            =       sizeof(struct des_ctx),
         .cra_type               =       &crypto_blkcipher_type,
         .cra_module             =       THIS_MODULE,
+        .cra_alignmask          =       3,
         .cra_list               =       LIST_HEAD_INIT(ifxdeu_cbc_des3_ede_alg.cra_list),
         .cra_u                  =       {
                 .blkcipher = {
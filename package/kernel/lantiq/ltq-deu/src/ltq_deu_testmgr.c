@@ -26,6 +26,7 @@
 #include <linux/delay.h>
 #include <linux/types.h>
 #include <linux/sched.h>
+#include <linux/math64.h>
 
 #include "internal.h"
 #include "ifxmips_testmgr.h"
@@ -86,6 +87,7 @@ static char *alg = NULL;
 static u32 type;
 static u32 mask;
 static int mode;
+static int bench;
 static char *tvmem[TVMEMSIZE];
 
 static char *check[] = {
@@ -3045,6 +3047,107 @@ out:
 	crypto_free_blkcipher(tfm);
 }
 
+/*
+ * Throughput of a single cipher driver in MB/s by block size. Every block
+ * size runs for sec seconds (one if unset) on the same tvmem pages.
+ */
+static u32 bench_sizes[] = { 16, 64, 256, 1024, 4096, 8192, 0 };
+
+static void test_cipher_throughput(const char *driver, int enc,
+				   unsigned int sec, const char *key,
+				   unsigned int klen)
+{
+	struct crypto_blkcipher *tfm;
+	struct blkcipher_desc desc;
+	struct scatterlist sg[TVMEMSIZE];
+	unsigned long start, end, kbps;
+	unsigned int iv_len, bcount, j;
+	char iv[128];
+	u32 *b_size;
+	u64 bytes;
+	int ret;
+
+	tfm = crypto_alloc_blkcipher(driver, 0, CRYPTO_ALG_ASYNC);
+	if (IS_ERR(tfm)) {
+		printk("failed to load transform for %s: %ld\n", driver,
+		       PTR_ERR(tfm));
+		return;
+	}
+	desc.tfm = tfm;
+	desc.flags = 0;
+
+	sg_init_table(sg, TVMEMSIZE);
+	for (j = 0; j < TVMEMSIZE; j++) {
+		memset(tvmem[j], 0xff, PAGE_SIZE);
+		sg_set_buf(sg + j, tvmem[j], PAGE_SIZE);
+	}
+
+	ret = crypto_blkcipher_setkey(tfm, key, klen);
+	if (ret) {
+		printk("%s: setkey() failed flags=%x\n", driver,
+		       crypto_blkcipher_get_flags(tfm));
+		goto out;
+	}
+
+	iv_len = crypto_blkcipher_ivsize(tfm);
+	if (iv_len) {
+		memset(iv, 0xff, iv_len);
+		crypto_blkcipher_set_iv(tfm, iv, iv_len);
+	}
+
+	for (b_size = bench_sizes; *b_size; b_size++) {
+		for (start = jiffies, end = start + sec * HZ, bcount = 0;
+		     time_before(jiffies, end); bcount++) {
+			if (enc)
+				ret = crypto_blkcipher_encrypt(&desc, sg, sg,
+							       *b_size);
+			else
+				ret = crypto_blkcipher_decrypt(&desc, sg, sg,
+							       *b_size);
+			if (ret) {
+				printk("%s: %s() failed\n", driver,
+				       enc ? "encrypt" : "decrypt");
+				goto out;
+			}
+		}
+
+		bytes = (u64)bcount * *b_size * HZ;
+		kbps = div_u64(bytes, (jiffies - start) * 1024);
+		printk("%-24s %s %5u byte blocks: %5lu.%02lu MB/s\n",
+		       driver, enc ? "enc" : "dec", *b_size,
+		       kbps / 1024, (kbps % 1024) * 100 / 1024);
+	}
+
+out:
+	crypto_free_blkcipher(tfm);
+}
+
+/*
+ * Compare the DEU driver of a cipher with its generic software version.
+ * A NULL key means an all 0xff key of klen bytes.
+ */
+static void test_cipher_bench(const char *algo, const char *generic,
+			      const char *key, unsigned int klen)
+{
+	char driver[CRYPTO_MAX_ALG_NAME];
+	char ffkey[32];
+	unsigned int s = sec ? sec : 1;
+
+	if (!key) {
+		memset(ffkey, 0xff, sizeof(ffkey));
+		key = ffkey;
+	}
+
+	printk("\n ******* throughput of %s (%d bit key) ******* \n",
+	       algo, klen * 8);
+
+	snprintf(driver, sizeof(driver), "ifxdeu-%s", algo);
+	test_cipher_throughput(driver, ENCRYPT, s, key, klen);
+	test_cipher_throughput(driver, DECRYPT, s, key, klen);
+	test_cipher_throughput(generic, ENCRYPT, s, key, klen);
+	test_cipher_throughput(generic, DECRYPT, s, key, klen);
+}
+
 static int test_hash_jiffies_digest(struct hash_desc *desc,
 				    struct scatterlist *sg, int blen,
 				    char *out, int sec)
@@ -3755,6 +3858,22 @@ static int do_test(int m)
 				speed_template_8);
 		break;
 
+	/* Throughput of the DEU ciphers against the generic ones */
+	case 500:
+#if defined(CONFIG_CRYPTO_DEV_AES)
+		test_cipher_bench("ecb(aes)", "ecb(aes-generic)", NULL, 16);
+		test_cipher_bench("cbc(aes)", "cbc(aes-generic)", NULL, 16);
+		test_cipher_bench("cbc(aes)", "cbc(aes-generic)", NULL, 32);
+		test_cipher_bench("ctr(aes)", "ctr(aes-generic)", NULL, 16);
+#endif
+#if defined(CONFIG_CRYPTO_DEV_DES)
+		test_cipher_bench("cbc(des)", "cbc(des-generic)", NULL, 8);
+		test_cipher_bench("cbc(des3_ede)", "cbc(des3_ede-generic)",
+				  des3_speed_template[0].key,
+				  des3_speed_template[0].klen);
+#endif
+		break;
+
 	case 1000:
 		test_available();
 		break;
@@ -3784,6 +3903,11 @@ static int __init tcrypt_mod_init(void)
 	}
 
 #if defined(CONFIG_CRYPTO_DEV_DEU)
+	if (bench) {
+		err = do_test(500);
+		goto fips_check;
+	}
+
 #if defined(CONFIG_CRYPTO_DEV_MD5)
         mode = 1; // test md5 only
         err = do_test(mode);
@@ -3954,6 +4078,9 @@ module_param(mode, int, 0);
 module_param(sec, uint, 0);
 MODULE_PARM_DESC(sec, "Length in seconds of speed tests "
 		      "(defaults to zero which uses CPU cycles instead)");
+module_param(bench, int, 0);
+MODULE_PARM_DESC(bench, "Only measure the cipher throughput in MB/s by "
+			"block size, DEU against the generic drivers");
 
 MODULE_LICENSE("GPL");
 MODULE_DESCRIPTION("Quick & dirty crypto testing module");
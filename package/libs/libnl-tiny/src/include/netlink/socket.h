@@ -26,6 +26,7 @@ extern "C" {
 #define NL_NO_AUTO_ACK		(1<<4)
 
 struct nl_cb;
+struct nl_msg;
 struct nl_sock
 {
 	struct sockaddr_nl	s_local;
@@ -36,6 +37,9 @@ struct nl_sock
 	unsigned int		s_seq_expect;
 	int			s_flags;
 	struct nl_cb *		s_cb;
+	unsigned char *		s_buf;
+	size_t			s_bufsize;
+	struct nl_msg *		s_msg;
 };
 
 
@@ -49,6 +53,7 @@ extern int		nl_socket_add_memberships(struct nl_sock *, int, ...);
 extern int		nl_socket_drop_memberships(struct nl_sock *, int, ...);
 
 extern int		nl_socket_set_buffer_size(struct nl_sock *, int, int);
+extern int		nl_socket_set_msg_buf_size(struct nl_sock *, size_t);
 extern int		nl_socket_set_passcred(struct nl_sock *, int);
 extern int		nl_socket_recv_pktinfo(struct nl_sock *, int);
 
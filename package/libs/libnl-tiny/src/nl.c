@@ -356,31 +356,23 @@ errout:
  * @{
  */
 
-/**
- * Receive data from netlink socket
- * @arg sk		Netlink socket.
- * @arg nla		Destination pointer for peer's netlink address.
- * @arg buf		Destination pointer for message content.
- * @arg creds		Destination pointer for credentials.
- *
- * Receives a netlink message, allocates a buffer in \c *buf and
- * stores the message content. The peer's netlink address is stored
- * in \c *nla. The caller is responsible for freeing the buffer allocated
- * in \c *buf if a positive value is returned.  Interruped system calls
- * are handled by repeating the read. The input buffer size is determined
- * by peeking before the actual read is done.
- *
- * A non-blocking sockets causes the function to return immediately with
- * a return value of 0 if no data is available.
- *
- * @return Number of octets read, 0 on EOF or a negative error code.
+/*
+ * Receive one datagram into a caller provided buffer of *size bytes,
+ * enlarging it as needed. The buffer is kept at its new size so that
+ * later reads do not need to grow it again. Credentials are returned in
+ * *creds if the socket has credential passing enabled.
  */
-int nl_recv(struct nl_sock *sk, struct sockaddr_nl *nla,
-	    unsigned char **buf, struct ucred **creds)
+static int __nl_recv(struct nl_sock *sk, struct sockaddr_nl *nla,
+		     unsigned char **buf, size_t *size,
+		     struct ucred *creds, int *have_creds)
 {
 	int n;
 	int flags = 0;
 	static int page_size = 0;
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(struct ucred))];
+	} cbuf;
 	struct iovec iov;
 	struct msghdr msg = {
 		.msg_name = (void *) nla,
@@ -392,6 +384,7 @@ int nl_recv(struct nl_sock *sk, struct sockaddr_nl *nla,
 		.msg_flags = 0,
 	};
 	struct cmsghdr *cmsg;
+	void *tmp;
 
 	if (sk->s_flags & NL_MSG_PEEK)
 		flags |= MSG_PEEK;
@@ -399,42 +392,51 @@ int nl_recv(struct nl_sock *sk, struct sockaddr_nl *nla,
 	if (page_size == 0)
 		page_size = getpagesize() * 4;
 
-	iov.iov_len = page_size;
-	iov.iov_base = *buf = malloc(iov.iov_len);
+	if (!*buf || *size < (size_t) page_size) {
+		if (*size < (size_t) page_size)
+			*size = page_size;
+		tmp = realloc(*buf, *size);
+		if (!tmp)
+			return -NLE_NOMEM;
+		*buf = tmp;
+	}
+
+	iov.iov_base = *buf;
+	iov.iov_len = *size;
 
+	*have_creds = 0;
+retry:
 	if (sk->s_flags & NL_SOCK_PASSCRED) {
-		msg.msg_controllen = CMSG_SPACE(sizeof(struct ucred));
-		msg.msg_control = calloc(1, msg.msg_controllen);
+		msg.msg_control = &cbuf;
+		msg.msg_controllen = sizeof(cbuf);
 	}
-retry:
+	msg.msg_namelen = sizeof(struct sockaddr_nl);
 
 	n = recvmsg(sk->s_fd, &msg, flags);
 	if (!n)
-		goto abort;
+		return 0;
 	else if (n < 0) {
 		if (errno == EINTR) {
 			NL_DBG(3, "recvmsg() returned EINTR, retrying\n");
 			goto retry;
 		} else if (errno == EAGAIN) {
 			NL_DBG(3, "recvmsg() returned EAGAIN, aborting\n");
-			goto abort;
-		} else {
-			free(msg.msg_control);
-			free(*buf);
+			return 0;
+		} else
 			return -nl_syserr2nlerr(errno);
-		}
 	}
 
 	if (iov.iov_len < n ||
 	    msg.msg_flags & MSG_TRUNC) {
 		/* Provided buffer is not long enough, enlarge it
 		 * and try again. */
-		iov.iov_len *= 2;
-		iov.iov_base = *buf = realloc(*buf, iov.iov_len);
-		goto retry;
-	} else if (msg.msg_flags & MSG_CTRUNC) {
-		msg.msg_controllen *= 2;
-		msg.msg_control = realloc(msg.msg_control, msg.msg_controllen);
+		tmp = realloc(*buf, *size * 2);
+		if (!tmp)
+			return -NLE_NOMEM;
+		*buf = tmp;
+		*size *= 2;
+		iov.iov_base = *buf;
+		iov.iov_len = *size;
 		goto retry;
 	} else if (flags != 0) {
 		/* Buffer is big enough, do the actual reading */
@@ -442,27 +444,126 @@ retry:
 		goto retry;
 	}
 
-	if (msg.msg_namelen != sizeof(struct sockaddr_nl)) {
-		free(msg.msg_control);
-		free(*buf);
+	if (msg.msg_namelen != sizeof(struct sockaddr_nl))
 		return -NLE_NOADDR;
-	}
 
 	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
 		if (cmsg->cmsg_level == SOL_SOCKET &&
 		    cmsg->cmsg_type == SCM_CREDENTIALS) {
-			*creds = calloc(1, sizeof(struct ucred));
-			memcpy(*creds, CMSG_DATA(cmsg), sizeof(struct ucred));
+			memcpy(creds, CMSG_DATA(cmsg), sizeof(struct ucred));
+			*have_creds = 1;
 			break;
 		}
 	}
 
-	free(msg.msg_control);
 	return n;
+}
+
+/**
+ * Receive data from netlink socket
+ * @arg sk		Netlink socket.
+ * @arg nla		Destination pointer for peer's netlink address.
+ * @arg buf		Destination pointer for message content.
+ * @arg creds		Destination pointer for credentials.
+ *
+ * Receives a netlink message, allocates a buffer in \c *buf and
+ * stores the message content. The peer's netlink address is stored
+ * in \c *nla. The caller is responsible for freeing the buffer allocated
+ * in \c *buf if a positive value is returned.  Interruped system calls
+ * are handled by repeating the read. The input buffer size is determined
+ * by peeking before the actual read is done.
+ *
+ * A non-blocking sockets causes the function to return immediately with
+ * a return value of 0 if no data is available.
+ *
+ * @return Number of octets read, 0 on EOF or a negative error code.
+ */
+int nl_recv(struct nl_sock *sk, struct sockaddr_nl *nla,
+	    unsigned char **buf, struct ucred **creds)
+{
+	struct ucred tmp;
+	size_t size = 0;
+	int have_creds = 0;
+	int n;
+
+	*buf = NULL;
+	n = __nl_recv(sk, nla, buf, &size, &tmp, &have_creds);
+	if (n <= 0) {
+		free(*buf);
+		*buf = NULL;
+		return n;
+	}
+
+	if (have_creds && creds) {
+		*creds = calloc(1, sizeof(struct ucred));
+		if (*creds)
+			memcpy(*creds, &tmp, sizeof(struct ucred));
+	}
+
+	return n;
+}
+
+/*
+ * Messages received through the socket buffer are handed to the callbacks
+ * as views into that buffer, using a message head that is kept with the
+ * socket. No memory is allocated per message.
+ */
+static struct nl_msg *recv_msg_view(struct nl_sock *sk, struct nlmsghdr *hdr,
+				    struct sockaddr_nl *nla,
+				    struct ucred *creds)
+{
+	struct nl_msg *nm = sk->s_msg;
+
+	if (!nm) {
+		nm = sk->s_msg = malloc(sizeof(*nm));
+		if (!nm)
+			return NULL;
+	}
+
+	memset(nm, 0, sizeof(*nm));
+	nm->nm_refcnt = 1;
+	nm->nm_nlh = hdr;
+	nm->nm_size = NLMSG_ALIGN(hdr->nlmsg_len);
+	nm->nm_protocol = sk->s_proto;
+	nm->nm_src = *nla;
+	if (creds)
+		nlmsg_set_creds(nm, creds);
+
+	return nm;
+}
+
+/*
+ * Called when the processing of a view is done. A callback that took a
+ * reference with nlmsg_get() gets to keep the message: it is detached from
+ * the socket and given its own copy of the data, since the receive buffer
+ * is about to be reused. If that copy cannot be allocated, the message is
+ * moved to the start of the receive buffer and takes the whole buffer with
+ * it, so that nlmsg_free() releases it. The socket then allocates a new one
+ * and -NLE_NOMEM tells the caller to stop parsing the old buffer.
+ */
+static int recv_msg_put(struct nl_sock *sk, struct nl_msg *nm)
+{
+	struct nlmsghdr *nlh;
+
+	if (!nm || nm->nm_refcnt <= 1)
+		return 0;
+
+	sk->s_msg = NULL;
+	nm->nm_refcnt--;
+
+	nlh = malloc(nm->nm_size);
+	if (!nlh) {
+		nlh = (struct nlmsghdr *) sk->s_buf;
+		memmove(nlh, nm->nm_nlh, nm->nm_nlh->nlmsg_len);
+		nm->nm_nlh = nlh;
+		sk->s_buf = NULL;
+		sk->s_bufsize = 0;
+		return -NLE_NOMEM;
+	}
+
+	memcpy(nlh, nm->nm_nlh, nm->nm_nlh->nlmsg_len);
+	nm->nm_nlh = nlh;
 
-abort:
-	free(msg.msg_control);
-	free(*buf);
 	return 0;
 }
 
@@ -482,6 +583,24 @@ do { \
 	} \
 } while (0)
 
+static void recvmsgs_release(struct nl_sock *sk, struct nl_cb *cb,
+			     struct nl_msg *msg, unsigned char *buf,
+			     struct ucred *creds)
+{
+	if (cb->cb_recv_ow) {
+		nlmsg_free(msg);
+		free(buf);
+		free(creds);
+	} else
+		recv_msg_put(sk, msg);
+}
+
+/*
+ * Without a cb_recv_ow override, datagrams are read into the receive buffer
+ * of the socket and the messages in it are passed to the callbacks without
+ * being copied. Such a message is only valid until the callback returns,
+ * unless the callback takes a reference with nlmsg_get().
+ */
 static int recvmsgs(struct nl_sock *sk, struct nl_cb *cb)
 {
 	int n, err = 0, multipart = 0;
@@ -490,13 +609,19 @@ static int recvmsgs(struct nl_sock *sk, struct nl_cb *cb)
 	struct sockaddr_nl nla = {0};
 	struct nl_msg *msg = NULL;
 	struct ucred *creds = NULL;
+	struct ucred sk_creds;
+	int have_creds;
 
 continue_reading:
 	NL_DBG(3, "Attempting to read from %p\n", sk);
-	if (cb->cb_recv_ow)
+	if (cb->cb_recv_ow) {
 		n = cb->cb_recv_ow(sk, &nla, &buf, &creds);
-	else
-		n = nl_recv(sk, &nla, &buf, &creds);
+	} else {
+		n = __nl_recv(sk, &nla, &sk->s_buf, &sk->s_bufsize,
+			      &sk_creds, &have_creds);
+		buf = sk->s_buf;
+		creds = have_creds ? &sk_creds : NULL;
+	}
 
 	if (n <= 0)
 		return n;
@@ -507,18 +632,30 @@ continue_reading:
 	while (nlmsg_ok(hdr, n)) {
 		NL_DBG(3, "recgmsgs(%p): Processing valid message...\n", sk);
 
-		nlmsg_free(msg);
-		msg = nlmsg_convert(hdr);
+		if (cb->cb_recv_ow) {
+			nlmsg_free(msg);
+			msg = nlmsg_convert(hdr);
+			if (msg) {
+				nlmsg_set_proto(msg, sk->s_proto);
+				nlmsg_set_src(msg, &nla);
+				if (creds)
+					nlmsg_set_creds(msg, creds);
+			}
+		} else {
+			if (recv_msg_put(sk, msg) < 0) {
+				/* The rest of the buffer went with the message */
+				msg = NULL;
+				buf = NULL;
+				err = -NLE_NOMEM;
+				goto out;
+			}
+			msg = recv_msg_view(sk, hdr, &nla, creds);
+		}
 		if (!msg) {
 			err = -NLE_NOMEM;
 			goto out;
 		}
 
-		nlmsg_set_proto(msg, sk->s_proto);
-		nlmsg_set_src(msg, &nla);
-		if (creds)
-			nlmsg_set_creds(msg, creds);
-
 		/* Raw callback is the first, it gives the most control
 		 * to the user and he can do his very own parsing. */
 		if (cb->cb_set[NL_CB_MSG_IN])
@@ -641,9 +778,7 @@ skip:
 		hdr = nlmsg_next(hdr, &n);
 	}
 	
-	nlmsg_free(msg);
-	free(buf);
-	free(creds);
+	recvmsgs_release(sk, cb, msg, buf, creds);
 	buf = NULL;
 	msg = NULL;
 	creds = NULL;
@@ -655,9 +790,7 @@ skip:
 stop:
 	err = 0;
 out:
-	nlmsg_free(msg);
-	free(buf);
-	free(creds);
+	recvmsgs_release(sk, cb, msg, buf, creds);
 
 	return err;
 }
@@ -138,6 +138,8 @@ void nl_socket_free(struct nl_sock *sk)
 		release_local_port(sk->s_local.nl_pid);
 
 	nl_cb_put(sk->s_cb);
+	free(sk->s_msg);
+	free(sk->s_buf);
 	free(sk);
 }
 
@@ -352,6 +354,26 @@ int nl_socket_set_buffer_size(struct nl_sock *sk, int rxbuf, int txbuf)
 	return 0;
 }
 
+/**
+ * Set initial size of the receive buffer of a netlink socket.
+ * @arg sk		Netlink socket.
+ * @arg bufsize		Initial buffer size in bytes, 0 to use the default.
+ *
+ * The buffer is kept with the socket and grows when a larger message
+ * arrives. Setting it to the expected size of the largest message saves
+ * the reads needed to find it out.
+ *
+ * @return 0 on success or a negative error code.
+ */
+int nl_socket_set_msg_buf_size(struct nl_sock *sk, size_t bufsize)
+{
+	free(sk->s_buf);
+	sk->s_buf = NULL;
+	sk->s_bufsize = bufsize;
+
+	return 0;
+}
+
 /**
  * Enable/disable credential passing on netlink socket.
  * @arg sk		Netlink socket.
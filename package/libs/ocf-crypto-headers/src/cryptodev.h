@@ -216,6 +216,43 @@ struct crypt_op {
 	caddr_t		iv;
 };
 
+/*
+ * Operations submitted with CIOCNCRYPTM are queued and the call returns
+ * without waiting for them, the status and reqid of each one are filled
+ * in.  Their results are collected with CIOCNCRYPTRETM, poll() reports
+ * the descriptor readable while there are any.  The buffers must stay
+ * valid until then.  An operation with dst == src and the MAC directly
+ * after the data may be done in place on the user's pages.
+ */
+struct crypt_n_op {
+	u_int32_t	ses;
+	u_int16_t	op;		/* i.e. COP_ENCRYPT */
+	u_int16_t	flags;		/* i.e. COP_F_BATCH */
+	u_int		len;
+	u_int32_t	reqid;		/* returns: request id */
+	int		status;		/* returns: submission status */
+	void		*opaque;	/* returned with the result */
+	caddr_t		src, dst;
+	caddr_t		mac;		/* must be big enough for chosen MAC */
+	caddr_t		iv;
+};
+
+struct crypt_mop {
+	u_int		count;		/* # of operations */
+	struct crypt_n_op *reqs;
+};
+
+struct crypt_result {
+	u_int32_t	reqid;		/* request id from crypt_n_op */
+	int		status;		/* 0 or errno of the operation */
+	void		*opaque;
+};
+
+struct cryptret {
+	u_int		count;		/* size of results, returns: # filled */
+	struct crypt_result *results;
+};
+
 /*
  * Parameters for looking up a crypto driver/device by
  * device name or by id.  The latter are returned for
@@ -273,6 +310,8 @@ struct crypt_kop {
 #define CIOCGSESSION2	_IOWR('c', 106, struct session2_op)
 #define CIOCKEY2	_IOWR('c', 107, struct crypt_kop)
 #define CIOCFINDDEV	_IOWR('c', 108, struct crypt_find_op)
+#define CIOCNCRYPTM	_IOWR('c', 109, struct crypt_mop)
+#define CIOCNCRYPTRETM	_IOWR('c', 110, struct cryptret)
 
 struct cryptotstat {
 	struct timespec	acc;		/* total accumulated time */
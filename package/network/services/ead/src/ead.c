@@ -15,6 +15,8 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/select.h>
+#include <poll.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stddef.h>
 #include <stdlib.h>
@@ -76,6 +78,16 @@ struct ead_instance {
 	bool br_check;
 };
 
+/* the transmit handle never needs to see any packets */
+static struct bpf_insn dropfilter_insns[] = {
+	{ .code = 0x0006, .jt = 0x00, .jf = 0x00, .k = 0x00000000 },
+};
+
+static struct bpf_program dropfilter = {
+	.bf_len = 1,
+	.bf_insns = dropfilter_insns,
+};
+
 static char ethmac[6] = "\x00\x13\x37\x00\x00\x00"; /* last 3 bytes will be randomized */
 static pcap_t *pcap_fp = NULL;
 static pcap_t *pcap_fp_rx = NULL;
@@ -142,15 +154,24 @@ ead_open_pcap(const char *ifname, char *errbuf, bool rx)
 	if (p == NULL)
 		goto out;
 
+	/*
+	 * Requests are sent to the broadcast address, so there is no need
+	 * for promiscuous mode. The filter passes nothing but requests, so
+	 * they can be delivered as soon as they arrive.
+	 */
 	pcap_set_snaplen(p, PCAP_MRU);
-	pcap_set_promisc(p, rx);
+	pcap_set_promisc(p, 0);
 	pcap_set_timeout(p, PCAP_TIMEOUT);
+	pcap_set_immediate_mode(p, rx);
 #ifdef HAS_PROTO_EXTENSION
 	pcap_set_protocol(p, (rx ? htons(ETH_P_IP) : 0));
 #endif
 	pcap_set_buffer_size(p, (rx ? 10 : 1) * PCAP_MRU);
 	pcap_activate(p);
 	set_recv_type(p, rx);
+	pcap_setfilter(p, rx ? &pktfilter : &dropfilter);
+	if (rx)
+		pcap_setnonblock(p, 1, errbuf);
 out:
 	return p;
 }
@@ -699,6 +720,16 @@ ead_pcap_reopen(bool first)
 			pcap_fp = ead_open_pcap(instance->ifname, errbuf, 1);
 		}
 
+		if (!pcap_fp_rx && pcap_fp && instance->bridge[0]) {
+			/*
+			 * The bridge could not be opened, receive on the
+			 * interface instead. Its handle was set up for
+			 * sending only, switch it over to requests.
+			 */
+			set_recv_type(pcap_fp, 1);
+			pcap_setfilter(pcap_fp, &pktfilter);
+			pcap_setnonblock(pcap_fp, 1, errbuf);
+		}
 		if (!pcap_fp_rx)
 			pcap_fp_rx = pcap_fp;
 		if (first && !pcap_fp) {
@@ -708,18 +739,39 @@ ead_pcap_reopen(bool first)
 		if (!pcap_fp)
 			sleep(1);
 	} while (!pcap_fp);
-	pcap_setfilter(pcap_fp_rx, &pktfilter);
 }
 
 
+/*
+ * Sleep until the kernel has queued a packet that passed the filter,
+ * then handle everything that is pending.
+ */
 static void
 ead_pktloop(void)
 {
+	struct pollfd pfd;
+
 	while (1) {
-		if (pcap_dispatch(pcap_fp_rx, 1, handle_packet, NULL) < 0) {
+		pfd.fd = pcap_get_selectable_fd(pcap_fp_rx);
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+
+		if (pfd.fd < 0) {
+			sleep(1);
+			ead_pcap_reopen(false);
+			continue;
+		}
+
+		if (poll(&pfd, 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
 			ead_pcap_reopen(false);
 			continue;
 		}
+
+		if ((pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) ||
+		    pcap_dispatch(pcap_fp_rx, -1, handle_packet, NULL) < 0)
+			ead_pcap_reopen(false);
 	}
 }
 
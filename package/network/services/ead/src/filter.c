@@ -1,25 +1,26 @@
-/* precompiled expression: udp and dst port 56026 */
+/* precompiled expression: ether broadcast and ip and udp dst port 56026 and udp[8:4] = 0xdadacafe */
 
 static struct bpf_insn pktfilter_insns[] = {
+	{ .code = 0x0020, .jt = 0x00, .jf = 0x00, .k = 0x00000002 },
+	{ .code = 0x0015, .jt = 0x00, .jf = 0x0e, .k = 0xffffffff },
+	{ .code = 0x0028, .jt = 0x00, .jf = 0x00, .k = 0x00000000 },
+	{ .code = 0x0015, .jt = 0x00, .jf = 0x0c, .k = 0x0000ffff },
 	{ .code = 0x0028, .jt = 0x00, .jf = 0x00, .k = 0x0000000c },
-	{ .code = 0x0015, .jt = 0x00, .jf = 0x04, .k = 0x000086dd },
-	{ .code = 0x0030, .jt = 0x00, .jf = 0x00, .k = 0x00000014 },
-	{ .code = 0x0015, .jt = 0x00, .jf = 0x0b, .k = 0x00000011 },
-	{ .code = 0x0028, .jt = 0x00, .jf = 0x00, .k = 0x00000038 },
-	{ .code = 0x0015, .jt = 0x08, .jf = 0x09, .k = 0x0000dada },
-	{ .code = 0x0015, .jt = 0x00, .jf = 0x08, .k = 0x00000800 },
+	{ .code = 0x0015, .jt = 0x00, .jf = 0x0a, .k = 0x00000800 },
 	{ .code = 0x0030, .jt = 0x00, .jf = 0x00, .k = 0x00000017 },
-	{ .code = 0x0015, .jt = 0x00, .jf = 0x06, .k = 0x00000011 },
+	{ .code = 0x0015, .jt = 0x00, .jf = 0x08, .k = 0x00000011 },
 	{ .code = 0x0028, .jt = 0x00, .jf = 0x00, .k = 0x00000014 },
-	{ .code = 0x0045, .jt = 0x04, .jf = 0x00, .k = 0x00001fff },
+	{ .code = 0x0045, .jt = 0x06, .jf = 0x00, .k = 0x00001fff },
 	{ .code = 0x00b1, .jt = 0x00, .jf = 0x00, .k = 0x0000000e },
 	{ .code = 0x0048, .jt = 0x00, .jf = 0x00, .k = 0x00000010 },
-	{ .code = 0x0015, .jt = 0x00, .jf = 0x01, .k = 0x0000dada },
+	{ .code = 0x0015, .jt = 0x00, .jf = 0x03, .k = 0x0000dada },
+	{ .code = 0x0040, .jt = 0x00, .jf = 0x00, .k = 0x00000016 },
+	{ .code = 0x0015, .jt = 0x00, .jf = 0x01, .k = 0xdadacafe },
 	{ .code = 0x0006, .jt = 0x00, .jf = 0x00, .k = 0x000005dc },
 	{ .code = 0x0006, .jt = 0x00, .jf = 0x00, .k = 0x00000000 },
 };
 
 static struct bpf_program pktfilter = {
-	.bf_len = 16,
+	.bf_len = 17,
 	.bf_insns = pktfilter_insns,
 };
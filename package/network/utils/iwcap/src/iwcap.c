@@ -26,15 +26,18 @@
 #include <signal.h>
 #include <syslog.h>
 #include <errno.h>
+#include <poll.h>
 #include <byteswap.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <net/ethernet.h>
 #include <net/if.h>
 #include <netinet/in.h>
 #include <linux/if_packet.h>
+#include <linux/filter.h>
 
 #define ARPHRD_IEEE80211_RADIOTAP	803
 
@@ -45,6 +48,13 @@
 #define FRAMETYPE_BEACON			0x80
 #define FRAMETYPE_DATA				0x08
 
+#define CAPTURE_BLOCK_SIZE			(1 << 16)
+#define CAPTURE_BLOCK_NR			8
+#define CAPTURE_FRAME_SIZE			2048
+#define CAPTURE_BLOCK_TIMEOUT		100 /* ms */
+
+#define OUTPUT_BUFSIZE				(1 << 16)
+
 #if __BYTE_ORDER == __BIG_ENDIAN
 #define le16(x) __bswap_16(x)
 #else
@@ -57,6 +67,7 @@ uint8_t run_daemon = 0;
 
 uint32_t frames_captured = 0;
 uint32_t frames_filtered = 0;
+uint32_t frames_dropped  = 0;
 
 int capture_sock = -1;
 const char *ifname = NULL;
@@ -69,6 +80,13 @@ struct ringbuf {
 	void *buf;               /* ring memory */
 };
 
+struct capture_ring {
+	uint8_t *map;            /* mmapped TPACKET_V3 ring */
+	uint32_t block_size;     /* size of one block */
+	uint32_t block_nr;       /* number of blocks */
+	uint32_t block;          /* next block to read */
+};
+
 struct ringbuf_entry {
 	uint32_t len;            /* used slot memory */
 	uint32_t olen;           /* original data size */
@@ -144,6 +162,98 @@ int set_promisc(int on)
 	return 0;
 }
 
+/*
+ * Classic BPF program doing the frame type filtering in the kernel, frames
+ * are dropped before they are copied to userspace. It also truncates the
+ * accepted frames to the snap length, which is only done for the capture
+ * ring: the ring keeps the original length in tp_len, while the length
+ * returned by recvfrom() on a trimmed frame is the truncated one.
+ */
+int attach_filter(uint8_t filter_beacon, uint8_t filter_data, uint32_t snaplen)
+{
+	struct sock_filter code[] = {
+		/* drop frames without room for a radiotap header */
+		BPF_STMT(BPF_LD  | BPF_W   | BPF_LEN, 0),
+		BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, sizeof(radiotap_hdr_t), 0, 15),
+
+		/* X = it_len (little endian) */
+		BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, 3),
+		BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 8),
+		BPF_STMT(BPF_MISC | BPF_TAX, 0),
+		BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, 2),
+		BPF_STMT(BPF_ALU | BPF_OR  | BPF_X, 0),
+		BPF_STMT(BPF_MISC | BPF_TAX, 0),
+
+		/* drop frames ending within the radiotap header */
+		BPF_STMT(BPF_LD  | BPF_W   | BPF_LEN, 0),
+		BPF_JUMP(BPF_JMP | BPF_JGT | BPF_X, 0, 0, 7),
+
+		/* frame type of the 802.11 header */
+		BPF_STMT(BPF_LD  | BPF_B   | BPF_IND, 0),
+		BPF_STMT(BPF_ALU | BPF_AND | BPF_K, FRAMETYPE_MASK),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, FRAMETYPE_BEACON, 2, 0),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, FRAMETYPE_DATA, 2, 0),
+
+		BPF_STMT(BPF_RET | BPF_K, snaplen),
+		BPF_STMT(BPF_RET | BPF_K, filter_beacon ? 0 : snaplen),
+		BPF_STMT(BPF_RET | BPF_K, filter_data ? 0 : snaplen),
+		BPF_STMT(BPF_RET | BPF_K, 0),
+	};
+
+	struct sock_fprog prog = {
+		.len    = sizeof(code) / sizeof(code[0]),
+		.filter = code,
+	};
+
+	return setsockopt(capture_sock, SOL_SOCKET, SO_ATTACH_FILTER,
+	                  &prog, sizeof(prog));
+}
+
+int setup_ring(struct capture_ring *r)
+{
+	int ver = TPACKET_V3;
+	struct tpacket_req3 req = {
+		.tp_block_size       = CAPTURE_BLOCK_SIZE,
+		.tp_block_nr         = CAPTURE_BLOCK_NR,
+		.tp_frame_size       = CAPTURE_FRAME_SIZE,
+		.tp_frame_nr         = CAPTURE_BLOCK_SIZE * CAPTURE_BLOCK_NR /
+		                       CAPTURE_FRAME_SIZE,
+		.tp_retire_blk_tov   = CAPTURE_BLOCK_TIMEOUT,
+	};
+
+	if (setsockopt(capture_sock, SOL_PACKET, PACKET_VERSION,
+	               &ver, sizeof(ver)))
+		return -1;
+
+	if (setsockopt(capture_sock, SOL_PACKET, PACKET_RX_RING,
+	               &req, sizeof(req)))
+		return -1;
+
+	r->map = mmap(NULL, req.tp_block_size * req.tp_block_nr,
+	              PROT_READ | PROT_WRITE, MAP_SHARED, capture_sock, 0);
+
+	if (r->map == MAP_FAILED)
+	{
+		r->map = NULL;
+		return -1;
+	}
+
+	r->block_size = req.tp_block_size;
+	r->block_nr = req.tp_block_nr;
+	r->block = 0;
+
+	return 0;
+}
+
+void update_stats(void)
+{
+	struct tpacket_stats_v3 st;
+	socklen_t len = sizeof(st);
+
+	if (!getsockopt(capture_sock, SOL_PACKET, PACKET_STATISTICS, &st, &len))
+		frames_dropped += st.tp_drops;
+}
+
 
 void sig_dump(int sig)
 {
@@ -219,20 +329,18 @@ struct ringbuf * ringbuf_init(uint32_t num_item, uint16_t len_item)
 	return NULL;
 }
 
-struct ringbuf_entry * ringbuf_add(struct ringbuf *r)
+struct ringbuf_entry * ringbuf_add(struct ringbuf *r,
+                                   uint32_t sec, uint32_t usec)
 {
-	struct timeval t;
 	struct ringbuf_entry *e;
 
-	gettimeofday(&t, NULL);
-
 	e = r->buf + (r->fill++ * r->slen);
 	r->fill %= r->len;
 
 	memset(e, 0, r->slen);
 
-	e->sec = t.tv_sec;
-	e->usec = t.tv_usec;
+	e->sec = sec;
+	e->usec = usec;
 
 	return e;
 }
@@ -254,6 +362,74 @@ void ringbuf_free(struct ringbuf *r)
 }
 
 
+void store_frame(struct ringbuf *ring, uint16_t pktcap, const uint8_t *data,
+                 uint32_t len, uint32_t olen, uint32_t sec, uint32_t usec)
+{
+	struct ringbuf_entry *e;
+
+	frames_captured++;
+
+	if (!ring)
+	{
+		write_pcap_frame(stdout, &sec, &usec, len, olen);
+		fwrite(data, 1, len, stdout);
+	}
+	else
+	{
+		e = ringbuf_add(ring, sec, usec);
+		e->olen = olen;
+		e->len = (len > pktcap) ? pktcap : len;
+
+		memcpy((void *)e + sizeof(*e), data, e->len);
+	}
+}
+
+/*
+ * Process the next block of the capture ring, or wait for the kernel to
+ * hand it over. Each block holds all frames received within the block
+ * timeout, streamed output is flushed once per block.
+ */
+void read_ring(struct capture_ring *rx, struct ringbuf *ring, uint16_t pktcap)
+{
+	uint32_t i;
+	struct tpacket_block_desc *bd;
+	struct tpacket3_hdr *th;
+	struct pollfd pfd = {
+		.fd     = capture_sock,
+		.events = POLLIN | POLLERR
+	};
+
+	bd = (struct tpacket_block_desc *)(rx->map + rx->block * rx->block_size);
+
+	if (!(*(volatile uint32_t *)&bd->hdr.bh1.block_status & TP_STATUS_USER))
+	{
+		poll(&pfd, 1, -1);
+		return;
+	}
+
+	__sync_synchronize();
+
+	th = (struct tpacket3_hdr *)((uint8_t *)bd +
+	                             bd->hdr.bh1.offset_to_first_pkt);
+
+	for (i = 0; i < bd->hdr.bh1.num_pkts; i++)
+	{
+		store_frame(ring, pktcap, (uint8_t *)th + th->tp_mac,
+		            th->tp_snaplen, th->tp_len,
+		            th->tp_sec, th->tp_nsec / 1000);
+
+		th = (struct tpacket3_hdr *)((uint8_t *)th + th->tp_next_offset);
+	}
+
+	if (!ring)
+		fflush(stdout);
+
+	__sync_synchronize();
+	bd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+	rx->block = (rx->block + 1) % rx->block_nr;
+}
+
+
 void msg(const char *fmt, ...)
 {
 	va_list ap;
@@ -271,8 +447,10 @@ void msg(const char *fmt, ...)
 int main(int argc, char **argv)
 {
 	int i, n;
-	struct ringbuf *ring;
+	struct ringbuf *ring = NULL;
 	struct ringbuf_entry *e;
+	struct capture_ring rx = { 0 };
+	struct timeval tv;
 	struct sockaddr_ll local = {
 		.sll_family   = AF_PACKET,
 		.sll_protocol = htons(ETH_P_ALL)
@@ -293,7 +471,7 @@ int main(int argc, char **argv)
 	uint8_t foreground     = 0;
 	uint8_t filter_data    = 0;
 	uint8_t filter_beacon  = 0;
-	uint8_t header_written = 0;
+	uint8_t filter_kernel  = 0;
 
 	uint32_t ringsz   = 1024 * 1024; /* 1 Mbyte ring buffer */
 	uint16_t pktcap   = 256;		 /* truncate frames after 265KB */
@@ -426,6 +604,13 @@ int main(int argc, char **argv)
 		return 6;
 	}
 
+	if (setup_ring(&rx))
+		rx.map = NULL;
+
+	/* the filter is in place before the socket is bound to the interface */
+	filter_kernel = !attach_filter(filter_beacon, filter_data,
+	                               (streaming || !rx.map) ? 0xFFFF : pktcap);
+
 	if (bind(capture_sock, (struct sockaddr *)&local, sizeof(local)) == -1)
 	{
 		msg("Unable to bind to interface: %s\n",
@@ -477,10 +662,16 @@ int main(int argc, char **argv)
 	{
 		msg("Monitoring interface %s ...\n", ifname);
 		msg(" * Streaming data to stdout\n");
+
+		setvbuf(stdout, NULL, _IOFBF, OUTPUT_BUFSIZE);
+		write_pcap_header(stdout);
+		fflush(stdout);
 	}
 
 	msg(" * Beacon frames are %sfiltered\n", filter_beacon ? "" : "not ");
 	msg(" * Data frames are %sfiltered\n", filter_data ? "" : "not ");
+	msg(" * Filtering frames in %s\n", filter_kernel ? "kernel" : "userspace");
+	msg(" * Using %s\n", rx.map ? "mmapped capture ring" : "socket reads");
 
 	signal(SIGINT, sig_teardown);
 	signal(SIGTERM, sig_teardown);
@@ -500,6 +691,9 @@ int main(int argc, char **argv)
 			if (ring)
 				ringbuf_free(ring);
 
+			if (rx.map)
+				munmap(rx.map, rx.block_size * rx.block_nr);
+
 			return 0;
 		}
 		else if (run_dump)
@@ -513,6 +707,7 @@ int main(int argc, char **argv)
 			}
 			else
 			{
+				setvbuf(o, NULL, _IOFBF, OUTPUT_BUFSIZE);
 				write_pcap_header(o);
 
 				/* sig_dump packet buffer */
@@ -528,55 +723,64 @@ int main(int argc, char **argv)
 
 				fclose(o);
 
+				update_stats();
+
 				msg(" * %d frames captured\n", frames_captured);
-				msg(" * %d frames filtered\n", frames_filtered);
+				if (!filter_kernel)
+					msg(" * %d frames filtered\n", frames_filtered);
+				msg(" * %d frames dropped\n", frames_dropped);
 				msg(" * %d frames dumped\n", n);
 			}
 
 			run_dump = 0;
 		}
 
-		pktlen = recvfrom(capture_sock, pktbuf, sizeof(pktbuf), 0, NULL, 0);
-		frames_captured++;
-
-		/* check received frametype, if we should filter it, rewind the ring */
-		rhdr = (radiotap_hdr_t *)pktbuf;
-
-		if (pktlen <= sizeof(radiotap_hdr_t) || le16(rhdr->it_len) >= pktlen)
+		if (rx.map)
 		{
-			frames_filtered++;
+			read_ring(&rx, ring, pktcap);
 			continue;
 		}
 
-		frametype = *(uint8_t *)(pktbuf + le16(rhdr->it_len));
+		/* MSG_TRUNC returns the original length of the frame */
+		pktlen = recvfrom(capture_sock, pktbuf, sizeof(pktbuf), MSG_TRUNC,
+		                  NULL, 0);
 
-		if ((filter_data   && (frametype & FRAMETYPE_MASK) == FRAMETYPE_DATA) ||
-		    (filter_beacon && (frametype & FRAMETYPE_MASK) == FRAMETYPE_BEACON))
-		{
-			frames_filtered++;
+		if (pktlen < 0)
 			continue;
-		}
 
-		if (streaming)
+		gettimeofday(&tv, NULL);
+
+		/* check received frametype, if we should filter it, rewind the ring */
+		if (!filter_kernel)
 		{
-			if (!header_written)
+			rhdr = (radiotap_hdr_t *)pktbuf;
+
+			if (pktlen <= sizeof(radiotap_hdr_t) ||
+			    le16(rhdr->it_len) >= pktlen ||
+			    le16(rhdr->it_len) >= sizeof(pktbuf))
 			{
-				write_pcap_header(stdout);
-				header_written = 1;
+				frames_captured++;
+				frames_filtered++;
+				continue;
 			}
 
-			write_pcap_frame(stdout, NULL, NULL, pktlen, pktlen);
-			fwrite(pktbuf, 1, pktlen, stdout);
-			fflush(stdout);
-		}
-		else
-		{
-			e = ringbuf_add(ring);
-			e->olen = pktlen;
-			e->len = (pktlen > pktcap) ? pktcap : pktlen;
+			frametype = *(uint8_t *)(pktbuf + le16(rhdr->it_len));
 
-			memcpy((void *)e + sizeof(*e), pktbuf, e->len);
+			if ((filter_data   && (frametype & FRAMETYPE_MASK) == FRAMETYPE_DATA) ||
+			    (filter_beacon && (frametype & FRAMETYPE_MASK) == FRAMETYPE_BEACON))
+			{
+				frames_captured++;
+				frames_filtered++;
+				continue;
+			}
 		}
+
+		store_frame(ring, pktcap, pktbuf,
+		            (pktlen > sizeof(pktbuf)) ? sizeof(pktbuf) : pktlen,
+		            pktlen, tv.tv_sec, tv.tv_usec);
+
+		if (!ring)
+			fflush(stdout);
 	}
 
 	return 0;
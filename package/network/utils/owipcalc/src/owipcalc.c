@@ -612,7 +612,8 @@ static bool cidr_print6(struct cidr *a)
 }
 
 
-static struct cidr * cidr_parse(const char *op, const char *s, int af_hint)
+static struct cidr * cidr_parse(const char *op, const char *s, int af_hint,
+                                int *status)
 {
 	char *r;
 	struct cidr *a;
@@ -625,7 +626,7 @@ static struct cidr * cidr_parse(const char *op, const char *s, int af_hint)
 		a = malloc(sizeof(struct cidr));
 
 		if (!a)
-			return NULL;
+			goto err;
 
 		if (af_hint == AF_INET)
 		{
@@ -654,7 +655,7 @@ static struct cidr * cidr_parse(const char *op, const char *s, int af_hint)
 		a = cidr_parse4(s);
 
 	if (!a)
-		return NULL;
+		goto err;
 
 	if (a->family != af_hint)
 	{
@@ -662,10 +663,19 @@ static struct cidr * cidr_parse(const char *op, const char *s, int af_hint)
 				op,
 				(af_hint == AF_INET) ? "ipv4" : "ipv6",
 				(af_hint != AF_INET) ? "ipv4" : "ipv6");
-		exit(4);
+
+		free(a);
+		*status = 4;
+		return NULL;
 	}
 
 	return a;
+
+err:
+	fprintf(stderr, "invalid address argument for '%s'\n", op);
+
+	*status = 3;
+	return NULL;
 }
 
 static bool cidr_howmany(struct cidr *a, struct cidr *b)
@@ -790,9 +800,14 @@ static void usage(const char *prog)
 	        "\n"
 	        "Usage:\n\n"
 	        "  %s {base address} operation [argument] "
-	        "[operation [argument] ...]\n\n"
+	        "[operation [argument] ...]\n"
+	        "  %s -\n\n"
+	        "The second form reads one \"[name=]{base address} operation ...\" "
+	        "expression\nper line from stdin and prints one line of output for "
+	        "each. If a name\nis given, the result is printed as name='result' "
+	        "for use with shell eval.\n\n"
 	        "Operations:\n\n",
-	        prog);
+	        prog, prog);
 
 	for (i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
 	{
@@ -826,8 +841,12 @@ static void usage(const char *prog)
 			"  192.168.1.250\n\n"
 			" Count number of prefixes:\n\n"
 			"  $ %s 2001:0DB8:FDEF::/48 howmany ::/64\n"
-			"  65536\n\n",
-	        prog, prog);
+			"  65536\n\n"
+			" Evaluate several expressions at once:\n\n"
+			"  $ printf 'START=10.0.0.1/24 network add 100\\nLIMIT=10.0.0.1/24 broadcast\\n' | %s -\n"
+			"  START='10.0.0.100'\n"
+			"  LIMIT='10.0.0.255'\n\n",
+	        prog, prog, prog);
 
 	exit(1);
 }
@@ -858,16 +877,10 @@ static bool runop(char ***arg, int *status)
 					return false;
 				}
 
-				b = cidr_parse(ops[i].name, arg2, a->family);
+				b = cidr_parse(ops[i].name, arg2, a->family, status);
 
 				if (!b)
-				{
-					fprintf(stderr, "invalid address argument for '%s'\n",
-							ops[i].name);
-
-					*status = 3;
 					return false;
-				}
 
 				*arg += 2;
 
@@ -878,6 +891,7 @@ static bool runop(char ***arg, int *status)
 					        ops[i].name,
 							(a->family == AF_INET) ? "ipv4" : "ipv6");
 
+					free(b);
 					*status = 5;
 					return false;
 				}
@@ -885,6 +899,7 @@ static bool runop(char ***arg, int *status)
 				*status = !((a->family == AF_INET) ? ops[i].f4.a2(a, b)
 				                                   : ops[i].f6.a2(a, b));
 
+				free(b);
 				return true;
 			}
 			else
@@ -913,28 +928,20 @@ static bool runop(char ***arg, int *status)
 	return false;
 }
 
-int main(int argc, char **argv)
+static int calc(char **arg)
 {
 	int status = 0;
-	char **arg = argv+2;
-	struct cidr *a;
-
-	if (argc < 3)
-		usage(argv[0]);
-
-	a = strchr(argv[1], ':') ? cidr_parse6(argv[1]) : cidr_parse4(argv[1]);
-
-	if (!a)
-		usage(argv[0]);
-
-	cidr_push(a);
 
 	while (runop(&arg, &status));
 
+	/* parsing the argument failed in a way that is fatal to the calculation */
+	if (status == 4)
+		return status;
+
 	if (*arg)
 	{
 		fprintf(stderr, "unknown operation '%s'\n", *arg);
-		exit(6);
+		return 6;
 	}
 
 	if (!printed && (status < 2))
@@ -945,7 +952,95 @@ int main(int argc, char **argv)
 			cidr_print6(stack);
 	}
 
-	qprintf("\n");
+	return status;
+}
+
+/*
+ * Batch mode, evaluate one "[name=]{base address} operation ..." expression
+ * per line of stdin and answer each with one line of output. Expressions
+ * prefixed with a variable name yield name='result' lines which can be
+ * eval'ed by shell scripts, so computing many values costs a single fork.
+ */
+static int batch(void)
+{
+	char line[1024], *args[64], *name, *p;
+	int n, status, rv = 0;
+	struct cidr *a;
+
+	while (fgets(line, sizeof(line), stdin))
+	{
+		for (n = 0, p = strtok(line, " \t\r\n");
+		     p && n < sizeof(args) / sizeof(args[0]) - 1;
+		     p = strtok(NULL, " \t\r\n"))
+			args[n++] = p;
+
+		args[n] = NULL;
+
+		if (n == 0 || *args[0] == '#')
+			continue;
+
+		name = NULL;
+
+		if ((p = strchr(args[0], '=')) != NULL)
+		{
+			*p++ = 0;
+			name = args[0];
+			args[0] = p;
+		}
+
+		quiet = false;
+		printed = false;
+
+		if (name)
+			printf("%s='", name);
+
+		a = strchr(args[0], ':') ? cidr_parse6(args[0]) : cidr_parse4(args[0]);
+
+		if (a)
+		{
+			cidr_push(a);
+			status = calc(args + 1);
+		}
+		else
+		{
+			fprintf(stderr, "invalid base address '%s'\n", args[0]);
+			status = 1;
+		}
+
+		while (cidr_pop(stack));
+
+		printf("%s\n", name ? "'" : "");
+		fflush(stdout);
+
+		if (status && !rv)
+			rv = status;
+	}
+
+	return rv;
+}
+
+int main(int argc, char **argv)
+{
+	struct cidr *a;
+	int status;
+
+	if (argc == 2 && !strcmp(argv[1], "-"))
+		return batch();
+
+	if (argc < 3)
+		usage(argv[0]);
+
+	a = strchr(argv[1], ':') ? cidr_parse6(argv[1]) : cidr_parse4(argv[1]);
+
+	if (!a)
+		usage(argv[0]);
+
+	cidr_push(a);
+
+	status = calc(argv + 2);
+
+	if ((status != 4) && (status != 6))
+		qprintf("\n");
 
 	exit(status);
 }
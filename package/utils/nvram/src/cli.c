@@ -25,13 +25,18 @@
 #include "nvram.h"
 
 
-static nvram_handle_t * nvram_open_rdonly(void)
+static const char * nvram_find_source(void)
 {
 	const char *file = nvram_find_staging();
 
 	if( file == NULL )
 		file = nvram_find_mtd();
 
+	return file;
+}
+
+static nvram_handle_t * nvram_open_rdonly(const char *file)
+{
 	if( file != NULL )
 		return nvram_open(file, NVRAM_RO);
 
@@ -79,6 +84,20 @@ static int do_get(nvram_handle_t *nvram, const char *var)
 	return stat;
 }
 
+static int do_get_index(nvram_index_t *idx, const char *var)
+{
+	const char *val;
+	int stat = 1;
+
+	if( (val = nvram_index_get(idx, var)) != NULL )
+	{
+		printf("%s\n", val);
+		stat = 0;
+	}
+
+	return stat;
+}
+
 static int do_unset(nvram_handle_t *nvram, const char *var)
 {
 	return nvram_unset(nvram, var);
@@ -133,6 +152,9 @@ static int do_info(nvram_handle_t *nvram)
 int main( int argc, const char *argv[] )
 {
 	nvram_handle_t *nvram;
+	nvram_index_t *idx;
+	const char *file = NULL;
+	int lookup = 0;
 	int commit = 0;
 	int write = 0;
 	int stat = 1;
@@ -150,7 +172,29 @@ int main( int argc, const char *argv[] )
 		}
 
 
-	nvram = write ? nvram_open_staging() : nvram_open_rdonly();
+	if( !write )
+	{
+		file = nvram_find_source();
+
+		/* Pure lookups can be answered from the index */
+		for( i = 1; (i + 1) < argc && !strcmp(argv[i], "get"); i += 2 );
+		lookup = (argc > 1 && i == argc);
+
+		if( lookup && file != NULL && (idx = nvram_index_open(file)) != NULL )
+		{
+			for( i = 1; i < argc; i += 2 )
+				stat = do_get_index(idx, argv[i+1]);
+
+			nvram_index_close(idx);
+			return stat;
+		}
+	}
+	else
+	{
+		unlink(NVRAM_INDEX);
+	}
+
+	nvram = write ? nvram_open_staging() : nvram_open_rdonly(file);
 
 	if( nvram != NULL && argc > 1 )
 	{
@@ -208,6 +252,8 @@ int main( int argc, const char *argv[] )
 
 		if( write )
 			stat = nvram_commit(nvram);
+		else if( lookup )
+			nvram_index_build(nvram, file);
 
 		nvram_close(nvram);
 
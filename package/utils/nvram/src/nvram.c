@@ -21,6 +21,9 @@
 /* Size of "nvram" MTD partition */
 size_t nvram_part_size = 0;
 
+/* Erase size of "nvram" MTD partition */
+size_t nvram_erase_size = 0;
+
 
 /*
  * -- Helper functions --
@@ -258,13 +261,22 @@ nvram_tuple_t * nvram_getall(nvram_handle_t *h)
 /* Regenerate NVRAM. */
 int nvram_commit(nvram_handle_t *h)
 {
-	nvram_header_t *header = nvram_header(h);
+	nvram_header_t *header;
 	char *init, *config, *refresh, *ncdl;
-	char *ptr, *end;
+	char *buf, *ptr, *end, *dst;
 	int i;
-	nvram_tuple_t *t;
+	nvram_tuple_t *t, *next;
 	nvram_header_t tmp;
 	uint8_t crc;
+	int truncated = 0;
+	size_t size = nvram_part_size - h->offset;
+	size_t pos, len, page = getpagesize();
+
+	/* Assemble the new contents off-line, see below */
+	if (!(buf = malloc(size)))
+		return -12; /* -ENOMEM */
+
+	header = (nvram_header_t *) buf;
 
 	/* Regenerate header */
 	header->magic = NVRAM_MAGIC;
@@ -286,17 +298,19 @@ int nvram_commit(nvram_handle_t *h)
 
 	/* Clear data area */
 	ptr = (char *) header + sizeof(nvram_header_t);
-	memset(ptr, 0xFF, nvram_part_size - h->offset - sizeof(nvram_header_t));
+	memset(ptr, 0xFF, size - sizeof(nvram_header_t));
 	memset(&tmp, 0, sizeof(nvram_header_t));
 
 	/* Leave space for a double NUL at the end */
-	end = (char *) header + nvram_part_size - h->offset - 2;
+	end = (char *) header + size - 2;
 
 	/* Write out all tuples */
 	for (i = 0; i < NVRAM_ARRAYSIZE(h->nvram_hash); i++) {
 		for (t = h->nvram_hash[i]; t; t = t->next) {
-			if ((ptr + strlen(t->name) + 1 + strlen(t->value) + 1) > end)
-				break;
+			if ((ptr + strlen(t->name) + 1 + strlen(t->value) + 1) > end) {
+				truncated = 1;
+				continue;
+			}
 			ptr += sprintf(ptr, "%s=%s", t->name, t->value) + 1;
 		}
 	}
@@ -305,8 +319,8 @@ int nvram_commit(nvram_handle_t *h)
 	*ptr = '\0';
 	ptr++;
 
-	if( (int)ptr % 4 )
-		memset(ptr, 0, 4 - ((int)ptr % 4));
+	if( (ptr - buf) % 4 )
+		memset(ptr, 0, 4 - ((ptr - buf) % 4));
 
 	ptr++;
 
@@ -327,12 +341,39 @@ int nvram_commit(nvram_handle_t *h)
 	/* Set new CRC8 */
 	header->crc_ver_init |= crc;
 
+	/*
+	 * Only copy the pages which actually changed into the mapping, so
+	 * msync() has to write back as little as possible.
+	 */
+	dst = (char *) nvram_header(h);
+	for (pos = 0; pos < size; pos += len) {
+		len = page - ((h->offset + pos) % page);
+		if (len > size - pos)
+			len = size - pos;
+
+		if (memcmp(dst + pos, buf + pos, len))
+			memcpy(dst + pos, buf + pos, len);
+	}
+
+	free(buf);
+
 	/* Write out */
 	msync(h->mmap, h->length, MS_SYNC);
 	fsync(h->fd);
 
-	/* Reinitialize hash table */
-	return _nvram_rehash(h);
+	/* Tuples which did not fit were dropped, reparse what was written */
+	if (truncated)
+		return _nvram_rehash(h);
+
+	/* Otherwise the hash table matches what was written */
+	for (t = h->nvram_dead; t; t = next) {
+		next = t->next;
+		free(t);
+	}
+
+	h->nvram_dead = NULL;
+
+	return 0;
 }
 
 /* Open NVRAM and obtain a handle. */
@@ -428,7 +469,7 @@ int nvram_close(nvram_handle_t *h)
 char * nvram_find_mtd(void)
 {
 	FILE *fp;
-	int i, part_size;
+	int i, part_size, erase_size;
 	char dev[PATH_MAX];
 	char *path = NULL;
 	struct stat s;
@@ -437,9 +478,10 @@ char * nvram_find_mtd(void)
 	{
 		while( fgets(dev, sizeof(dev), fp) )
 		{
-			if( strstr(dev, "nvram") && sscanf(dev, "mtd%d: %08x", &i, &part_size) )
+			if( strstr(dev, "nvram") && sscanf(dev, "mtd%d: %08x %08x", &i, &part_size, &erase_size) >= 2 )
 			{
 				nvram_part_size = part_size;
+				nvram_erase_size = erase_size;
 
 				sprintf(dev, "/dev/mtdblock%d", i);
 				if( stat(dev, &s) > -1 && (s.st_mode & S_IFBLK) )
@@ -510,21 +552,46 @@ int staging_to_nvram(void)
 	int fdmtd, fdstg, stat;
 	char *mtd = nvram_find_mtd();
 	char buf[nvram_part_size];
+	char cur[nvram_part_size];
+	size_t pos, len, block;
+	int have_cur;
 
 	stat = -1;
 
 	if( (mtd != NULL) && (nvram_part_size > 0) )
 	{
+		block = nvram_erase_size ? nvram_erase_size : nvram_part_size;
+
 		if( (fdstg = open(NVRAM_STAGING, O_RDONLY)) > -1 )
 		{
 			if( read(fdstg, buf, sizeof(buf)) == sizeof(buf) )
 			{
-				if( (fdmtd = open(mtd, O_WRONLY | O_SYNC)) > -1 )
+				if( (fdmtd = open(mtd, O_RDWR | O_SYNC)) > -1 )
 				{
-					write(fdmtd, buf, sizeof(buf));
+					/*
+					 * Only rewrite the erase blocks that differ,
+					 * every written block costs a full erase cycle.
+					 */
+					have_cur = (read(fdmtd, cur, sizeof(cur)) == sizeof(cur));
+
+					for( pos = 0, stat = 0; pos < sizeof(buf); pos += len )
+					{
+						len = block;
+						if( len > sizeof(buf) - pos )
+							len = sizeof(buf) - pos;
+
+						if( have_cur && !memcmp(cur + pos, buf + pos, len) )
+							continue;
+
+						if( pwrite(fdmtd, buf + pos, len, pos) != (ssize_t)len )
+						{
+							stat = -1;
+							break;
+						}
+					}
+
 					fsync(fdmtd);
 					close(fdmtd);
-					stat = 0;
 				}
 			}
 
@@ -538,3 +605,241 @@ int staging_to_nvram(void)
 	free(mtd);
 	return stat;
 }
+
+
+/*
+ * -- Lookup index --
+ *
+ * Parsing the whole partition into the hash table dominates the cost of
+ * a single "nvram get". The index stores the parsed variables as a sorted
+ * table in tmpfs, so further lookups are a binary search in a mapping.
+ * It is bound to the source file and the NVRAM header it was built from.
+ */
+
+static int _nvram_index_cmp(const void *a, const void *b)
+{
+	return strcmp((*(nvram_tuple_t **) a)->name, (*(nvram_tuple_t **) b)->name);
+}
+
+/*
+ * FNV-1a over the NVRAM header and data. The inode, size and mtime of an
+ * mtdblock device never change, so this is what detects a stale index.
+ */
+static uint32_t _nvram_index_sum(const unsigned char *data, size_t len)
+{
+	uint32_t sum = 0x811C9DC5;
+
+	while (len-- > 0)
+		sum = (sum ^ *data++) * 0x01000193;
+
+	return sum;
+}
+
+/* Write a lookup index of the NVRAM contents read from file. */
+int nvram_index_build(nvram_handle_t *h, const char *file)
+{
+	nvram_header_t *header = nvram_header(h);
+	struct nvram_index_header ih;
+	struct nvram_index_entry *ent;
+	nvram_tuple_t *t, **tuples;
+	char tmp[] = NVRAM_INDEX ".XXXXXX";
+	uint32_t i, n, len;
+	size_t size = 0;
+	struct stat s;
+	int fd, rv = -1;
+
+	if( stat(file, &s) < 0 || strlen(file) >= sizeof(ih.src) )
+		return -1;
+
+	for( i = 0, n = 0; i < NVRAM_ARRAYSIZE(h->nvram_hash); i++ )
+		for( t = h->nvram_hash[i]; t; t = t->next )
+			n++;
+
+	if( !(tuples = malloc(n * sizeof(*tuples))) )
+		return -1;
+
+	if( !(ent = malloc(n * sizeof(*ent))) )
+		goto out_tuples;
+
+	for( i = 0, n = 0; i < NVRAM_ARRAYSIZE(h->nvram_hash); i++ )
+		for( t = h->nvram_hash[i]; t; t = t->next )
+			tuples[n++] = t;
+
+	qsort(tuples, n, sizeof(*tuples), _nvram_index_cmp);
+
+	for( i = 0; i < n; i++ )
+	{
+		ent[i].name = size;
+		size += strlen(tuples[i]->name) + 1;
+		ent[i].value = size;
+		size += strlen(tuples[i]->value) + 1;
+	}
+
+	memset(&ih, 0, sizeof(ih));
+	ih.magic        = NVRAM_INDEX_MAGIC;
+	ih.version      = NVRAM_INDEX_VERSION;
+	ih.src_ino      = s.st_ino;
+	ih.src_size     = s.st_size;
+	ih.src_mtime    = s.st_mtime;
+	ih.offset       = h->offset;
+	ih.len          = header->len;
+	ih.crc_ver_init = header->crc_ver_init;
+	ih.data_sum     = _nvram_index_sum((unsigned char *) header, header->len);
+	ih.count        = n;
+	strcpy(ih.src, file);
+
+	if( (fd = mkstemp(tmp)) < 0 )
+		goto out_ent;
+
+	if( write(fd, &ih, sizeof(ih)) != sizeof(ih) ||
+	    write(fd, ent, n * sizeof(*ent)) != (ssize_t)(n * sizeof(*ent)) )
+		goto out_close;
+
+	for( i = 0; i < n; i++ )
+	{
+		len = ent[i].value - ent[i].name;
+		if( write(fd, tuples[i]->name, len) != len )
+			goto out_close;
+
+		len = strlen(tuples[i]->value) + 1;
+		if( write(fd, tuples[i]->value, len) != len )
+			goto out_close;
+	}
+
+	/* Replace atomically, concurrent readers keep their old mapping */
+	if( !rename(tmp, NVRAM_INDEX) )
+		rv = 0;
+
+out_close:
+	close(fd);
+	if( rv )
+		unlink(tmp);
+out_ent:
+	free(ent);
+out_tuples:
+	free(tuples);
+	return rv;
+}
+
+/* Open the lookup index for file, NULL if it is missing or stale. */
+nvram_index_t * nvram_index_open(const char *file)
+{
+	struct nvram_index_header *ih;
+	nvram_header_t header;
+	struct nvram_index_entry *ent;
+	nvram_index_t *idx;
+	struct stat s;
+	size_t maplen, strsize;
+	unsigned char *data;
+	char *map;
+	uint32_t i;
+	int fd, ok;
+
+	if( (fd = open(NVRAM_INDEX, O_RDONLY)) < 0 )
+		return NULL;
+
+	if( fstat(fd, &s) < 0 || s.st_size < sizeof(*ih) )
+	{
+		close(fd);
+		return NULL;
+	}
+
+	maplen = s.st_size;
+	map = mmap(NULL, maplen, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if( map == MAP_FAILED )
+		return NULL;
+
+	ih = (struct nvram_index_header *) map;
+
+	if( ih->magic != NVRAM_INDEX_MAGIC || ih->version != NVRAM_INDEX_VERSION ||
+	    ih->count >= (maplen - sizeof(*ih)) / sizeof(*ent) ||
+	    map[maplen - 1] != '\0' ||
+	    strncmp(ih->src, file, sizeof(ih->src)) )
+		goto err;
+
+	/*
+	 * Every offset has to point into the string blob, which is NUL
+	 * terminated at the end of the file, so lookups stay in the mapping.
+	 */
+	ent = (struct nvram_index_entry *) &ih[1];
+	strsize = maplen - sizeof(*ih) - ih->count * sizeof(*ent);
+
+	for( i = 0; i < ih->count; i++ )
+		if( ent[i].name >= strsize || ent[i].value >= strsize )
+			goto err;
+
+	/* The source must be unchanged since the index was built */
+	if( stat(file, &s) < 0 || s.st_ino != ih->src_ino ||
+	    s.st_size != ih->src_size || s.st_mtime != ih->src_mtime )
+		goto err;
+
+	if( (fd = open(file, O_RDONLY)) < 0 )
+		goto err;
+
+	if( pread(fd, &header, sizeof(header), ih->offset) != sizeof(header) ||
+	    header.magic != NVRAM_MAGIC || header.len != ih->len ||
+	    header.len < sizeof(header) ||
+	    header.crc_ver_init != ih->crc_ver_init ||
+	    !(data = malloc(header.len)) )
+	{
+		close(fd);
+		goto err;
+	}
+
+	ok = ( pread(fd, data, header.len, ih->offset) == (ssize_t)header.len &&
+	       _nvram_index_sum(data, header.len) == ih->data_sum );
+
+	free(data);
+	close(fd);
+
+	if( !ok )
+		goto err;
+
+	if( !(idx = malloc(sizeof(*idx))) )
+		goto err;
+
+	idx->mmap    = map;
+	idx->length  = maplen;
+	idx->header  = ih;
+	idx->entries = (struct nvram_index_entry *) &ih[1];
+	idx->strings = (char *) &idx->entries[ih->count];
+
+	return idx;
+
+err:
+	munmap(map, maplen);
+	return NULL;
+}
+
+/* Look up the value of an NVRAM variable in the index. */
+const char * nvram_index_get(nvram_index_t *idx, const char *name)
+{
+	uint32_t lo = 0, hi = idx->header->count, mid;
+	int cmp;
+
+	if (!name)
+		return NULL;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		cmp = strcmp(name, idx->strings + idx->entries[mid].name);
+
+		if (cmp == 0)
+			return idx->strings + idx->entries[mid].value;
+		else if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return NULL;
+}
+
+/* Close the lookup index. */
+void nvram_index_close(nvram_index_t *idx)
+{
+	munmap(idx->mmap, idx->length);
+	free(idx);
+}
@@ -52,9 +52,38 @@ struct nvram_handle {
 	struct nvram_tuple *nvram_dead;
 };
 
+/* On-disk lookup index, a sorted table of offsets into a string blob. */
+struct nvram_index_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t src_ino;
+	int64_t src_size;
+	int64_t src_mtime;
+	uint32_t offset;	/* offset of the NVRAM header in the source */
+	uint32_t len;		/* copy of the NVRAM header fields, used to */
+	uint32_t crc_ver_init;	/* detect stale indexes */
+	uint32_t data_sum;	/* FNV-1a over the NVRAM header and data */
+	uint32_t count;
+	char src[PATH_MAX];
+} __attribute__((__packed__));
+
+struct nvram_index_entry {
+	uint32_t name;
+	uint32_t value;
+} __attribute__((__packed__));
+
+struct nvram_index {
+	char *mmap;
+	size_t length;
+	struct nvram_index_header *header;
+	struct nvram_index_entry *entries;
+	char *strings;
+};
+
 typedef struct nvram_handle nvram_handle_t;
 typedef struct nvram_header nvram_header_t;
 typedef struct nvram_tuple  nvram_tuple_t;
+typedef struct nvram_index  nvram_index_t;
 
 
 /* Get nvram header. */
@@ -102,9 +131,26 @@ int staging_to_nvram(void);
 /* Check NVRAM staging file. */
 char * nvram_find_staging(void);
 
+/* Write a lookup index of the NVRAM contents read from file. */
+int nvram_index_build(nvram_handle_t *h, const char *file);
+
+/* Open the lookup index for file, NULL if it is missing or stale. */
+nvram_index_t * nvram_index_open(const char *file);
+
+/* Look up the value of an NVRAM variable in the index. */
+const char * nvram_index_get(nvram_index_t *idx, const char *name);
+
+/* Close the lookup index. */
+void nvram_index_close(nvram_index_t *idx);
+
 
 /* Staging file for NVRAM */
 #define NVRAM_STAGING		"/tmp/.nvram"
+
+/* Lookup index for NVRAM, lives in tmpfs so it never outlives a reboot */
+#define NVRAM_INDEX			"/tmp/.nvram.idx"
+#define NVRAM_INDEX_MAGIC	0x5849564E	/* 'NVIX' */
+#define NVRAM_INDEX_VERSION	2
 #define NVRAM_RO			1
 #define NVRAM_RW			0
 
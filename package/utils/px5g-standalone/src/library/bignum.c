@@ -711,7 +711,7 @@ int mpi_add_abs( mpi *X, mpi *A, mpi *B )
             p = X->p + i;
         }
 
-        *p += c; c = ( *p < c ); i++;
+        *p += c; c = ( *p < c ); i++; p++;
     }
 
 cleanup:
@@ -1656,46 +1656,50 @@ static const int small_prime[] =
 };
 
 /*
- * Miller-Rabin primality test  (HAC 4.24)
+ * Odd primes below SIEVE_LIMIT, used to sieve prime candidates
  */
-int mpi_is_prime( mpi *X, int (*f_rng)(void *), void *p_rng )
-{
-    int ret, i, j, n, s, xs;
-    mpi W, R, T, A, RR;
-    unsigned char *p;
+#define SIEVE_LIMIT     16384
 
-    if( mpi_cmp_int( X, 0 ) == 0 )
-        return( 0 );
+static unsigned short sieve_prime[1900];
+static int sieve_primes = 0;
 
-    mpi_init( &W, &R, &T, &A, &RR, NULL );
+static void mpi_sieve_init( void )
+{
+    unsigned char comp[SIEVE_LIMIT / 2];
+    int i, j;
 
-    xs = X->s; X->s = 1;
+    memset( comp, 0, sizeof( comp ) );
 
-    /*
-     * test trivial factors first
-     */
-    if( ( X->p[0] & 1 ) == 0 )
-        return( POLARSSL_ERR_MPI_NOT_ACCEPTABLE );
-
-    for( i = 0; small_prime[i] > 0; i++ )
+    /* comp[i] stands for 2 * i + 1 */
+    for( i = 1; i < SIEVE_LIMIT / 2; i++ )
     {
-        t_int r;
-
-        if( mpi_cmp_int( X, small_prime[i] ) <= 0 )
-            return( 0 );
+        if( comp[i] )
+            continue;
 
-        MPI_CHK( mpi_mod_int( &r, X, small_prime[i] ) );
+        sieve_prime[sieve_primes++] = (unsigned short)( 2 * i + 1 );
 
-        if( r == 0 )
-            return( POLARSSL_ERR_MPI_NOT_ACCEPTABLE );
+        for( j = 2 * i * ( i + 1 ); j < SIEVE_LIMIT / 2; j += 2 * i + 1 )
+            comp[j] = 1;
     }
+}
+
+/*
+ * Miller-Rabin primality test  (HAC 4.24), X must be odd and positive
+ */
+static int mpi_miller_rabin( mpi *X, int (*f_rng)(void *), void *p_rng )
+{
+    int ret, i, j, n, s;
+    mpi W, R, T, A, RR;
+    unsigned char *p;
+
+    mpi_init( &W, &R, &T, &A, &RR, NULL );
 
     /*
      * W = |X| - 1
      * R = W >> lsb( W )
      */
-    s = mpi_lsb( &W );
     MPI_CHK( mpi_sub_int( &W, X, 1 ) );
+    s = mpi_lsb( &W );
     MPI_CHK( mpi_copy( &R, &W ) );
     MPI_CHK( mpi_shift_r( &R, s ) );
 
@@ -1759,21 +1763,69 @@ int mpi_is_prime( mpi *X, int (*f_rng)(void *), void *p_rng )
 
 cleanup:
 
-    X->s = xs;
-
     mpi_free( &RR, &A, &T, &R, &W, NULL );
 
     return( ret );
 }
 
+/*
+ * Pseudo-primality test: trial division, then Miller-Rabin
+ */
+int mpi_is_prime( mpi *X, int (*f_rng)(void *), void *p_rng )
+{
+    int ret, i, xs;
+
+    if( mpi_cmp_int( X, 0 ) == 0 )
+        return( 0 );
+
+    xs = X->s; X->s = 1;
+
+    /*
+     * test trivial factors first
+     */
+    if( ( X->p[0] & 1 ) == 0 )
+    {
+        ret = POLARSSL_ERR_MPI_NOT_ACCEPTABLE;
+        goto cleanup;
+    }
+
+    for( i = 0; small_prime[i] > 0; i++ )
+    {
+        t_int r;
+
+        if( mpi_cmp_int( X, small_prime[i] ) <= 0 )
+        {
+            ret = 0;
+            goto cleanup;
+        }
+
+        MPI_CHK( mpi_mod_int( &r, X, small_prime[i] ) );
+
+        if( r == 0 )
+        {
+            ret = POLARSSL_ERR_MPI_NOT_ACCEPTABLE;
+            goto cleanup;
+        }
+    }
+
+    ret = mpi_miller_rabin( X, f_rng, p_rng );
+
+cleanup:
+
+    X->s = xs;
+
+    return( ret );
+}
+
 /*
  * Prime number generation
  */
 int mpi_gen_prime( mpi *X, int nbits, int dh_flag,
                    int (*f_rng)(void *), void *p_rng )
 {
-    int ret, k, n;
+    int ret, i, k, n;
     unsigned char *p;
+    t_int r[sizeof( sieve_prime ) / sizeof( sieve_prime[0] )];
     mpi Y;
 
     if( nbits < 3 )
@@ -1794,9 +1846,50 @@ int mpi_gen_prime( mpi *X, int nbits, int dh_flag,
     if( k < nbits ) MPI_CHK( mpi_shift_l( X, nbits - k ) );
     if( k > nbits ) MPI_CHK( mpi_shift_r( X, k - nbits ) );
 
+    /*
+     * Also set the second highest bit, so that the product of two
+     * such primes always has exactly 2 * nbits bits
+     */
+    X->p[( nbits - 2 ) / biL] |= (t_int) 1 << ( ( nbits - 2 ) % biL );
     X->p[0] |= 3;
 
-    if( dh_flag == 0 )
+    if( dh_flag == 0 && nbits > 32 )
+    {
+        /*
+         * Sieve: keep X mod sieve_prime[i] up to date while stepping
+         * through the candidates, only numbers without a small factor
+         * go through Miller-Rabin
+         */
+        if( sieve_primes == 0 )
+            mpi_sieve_init();
+
+        for( i = 0; i < sieve_primes; i++ )
+            MPI_CHK( mpi_mod_int( &r[i], X, sieve_prime[i] ) );
+
+        while( 1 )
+        {
+            for( i = 0; i < sieve_primes; i++ )
+                if( r[i] == 0 )
+                    break;
+
+            if( i == sieve_primes )
+            {
+                ret = mpi_miller_rabin( X, f_rng, p_rng );
+                if( ret != POLARSSL_ERR_MPI_NOT_ACCEPTABLE )
+                    goto cleanup;
+            }
+
+            MPI_CHK( mpi_add_int( X, X, 2 ) );
+
+            for( i = 0; i < sieve_primes; i++ )
+            {
+                r[i] += 2;
+                if( r[i] >= sieve_prime[i] )
+                    r[i] -= sieve_prime[i];
+            }
+        }
+    }
+    else if( dh_flag == 0 )
     {
         while( ( ret = mpi_is_prime( X, f_rng, p_rng ) ) != 0 )
         {
@@ -0,0 +1,421 @@
+/*
+ *  ECDSA on the NIST P-256 curve
+ *
+ *  Copyright (C) 2015 OpenWrt.org
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License, version 2.1 as published by the Free Software Foundation.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA  02110-1301  USA
+ */
+/*
+ *  SEC 1: Elliptic Curve Cryptography, version 2.0
+ *
+ *  http://www.secg.org/sec1-v2.pdf
+ *
+ *  The curve parameters are those of secp256r1 (NIST P-256):
+ *
+ *  http://www.secg.org/sec2-v2.pdf
+ */
+#include "polarssl/config.h"
+
+#if defined(POLARSSL_ECDSA_C)
+
+#include "polarssl/ecdsa.h"
+
+#include <string.h>
+
+/*
+ * Curve parameters: y^2 = x^3 - 3x + b over GF(p), base point G of
+ * prime order n
+ */
+static const char *p256_p =
+    "FFFFFFFF00000001000000000000000000000000FFFFFFFFFFFFFFFFFFFFFFFF";
+static const char *p256_n =
+    "FFFFFFFF00000000FFFFFFFFFFFFFFFFBCE6FAADA7179E84F3B9CAC2FC632551";
+static const char *p256_gx =
+    "6B17D1F2E12C4247F8BCE6E563A440F277037D812DEB33A0F4A13945D898C296";
+static const char *p256_gy =
+    "4FE342E2FE1A7F9B8EE7EB4A7C0F9E162BCE33576B315ECECBB6406837BF51F5";
+
+/*
+ * Point in Jacobian coordinates, (X / Z^2, Y / Z^3). Z = 0 is the
+ * point at infinity.
+ */
+typedef struct
+{
+    mpi X, Y, Z;
+}
+ecdsa_point;
+
+/*
+ * Curve and scratch space shared by the point operations
+ */
+typedef struct
+{
+    mpi P, N, Gx, Gy;
+    mpi T1, T2, T3, T4, T5;
+}
+ecdsa_group;
+
+static int ecdsa_group_load( ecdsa_group *grp )
+{
+    int ret;
+
+    mpi_init( &grp->P, &grp->N, &grp->Gx, &grp->Gy, &grp->T1,
+              &grp->T2, &grp->T3, &grp->T4, &grp->T5, NULL );
+
+    MPI_CHK( mpi_read_string( &grp->P,  16, (char *) p256_p  ) );
+    MPI_CHK( mpi_read_string( &grp->N,  16, (char *) p256_n  ) );
+    MPI_CHK( mpi_read_string( &grp->Gx, 16, (char *) p256_gx ) );
+    MPI_CHK( mpi_read_string( &grp->Gy, 16, (char *) p256_gy ) );
+
+cleanup:
+
+    return( ret );
+}
+
+static void ecdsa_group_free( ecdsa_group *grp )
+{
+    mpi_free( &grp->T5, &grp->T4, &grp->T3, &grp->T2, &grp->T1,
+              &grp->Gy, &grp->Gx, &grp->N, &grp->P, NULL );
+}
+
+/*
+ * Field arithmetic modulo P. Operands are always reduced, so sums and
+ * differences only need a single correction.
+ */
+static int mod_mul( ecdsa_group *grp, mpi *X, mpi *A, mpi *B )
+{
+    int ret;
+
+    MPI_CHK( mpi_mul_mpi( X, A, B ) );
+    MPI_CHK( mpi_mod_mpi( X, X, &grp->P ) );
+
+cleanup:
+
+    return( ret );
+}
+
+static int mod_add( ecdsa_group *grp, mpi *X, mpi *A, mpi *B )
+{
+    int ret;
+
+    MPI_CHK( mpi_add_mpi( X, A, B ) );
+    if( mpi_cmp_mpi( X, &grp->P ) >= 0 )
+        MPI_CHK( mpi_sub_abs( X, X, &grp->P ) );
+
+cleanup:
+
+    return( ret );
+}
+
+static int mod_sub( ecdsa_group *grp, mpi *X, mpi *A, mpi *B )
+{
+    int ret;
+
+    MPI_CHK( mpi_sub_mpi( X, A, B ) );
+    if( mpi_cmp_int( X, 0 ) < 0 )
+        MPI_CHK( mpi_add_mpi( X, X, &grp->P ) );
+
+cleanup:
+
+    return( ret );
+}
+
+/*
+ * X = 2 * X, mpi_add_mpi() cannot add an mpi to itself in place
+ */
+static int mod_dbl( ecdsa_group *grp, mpi *X )
+{
+    int ret;
+
+    MPI_CHK( mpi_shift_l( X, 1 ) );
+    if( mpi_cmp_mpi( X, &grp->P ) >= 0 )
+        MPI_CHK( mpi_sub_abs( X, X, &grp->P ) );
+
+cleanup:
+
+    return( ret );
+}
+
+/*
+ * R = 2 * R, "dbl-2001-b" formulas for a = -3
+ */
+static int ecdsa_double( ecdsa_group *grp, ecdsa_point *R )
+{
+    int ret;
+    mpi *delta = &grp->T1, *gamma = &grp->T2, *beta = &grp->T3;
+    mpi *alpha = &grp->T4, *t = &grp->T5;
+
+    if( mpi_cmp_int( &R->Z, 0 ) == 0 )
+        return( 0 );
+
+    MPI_CHK( mod_mul( grp, delta, &R->Z, &R->Z ) );
+    MPI_CHK( mod_mul( grp, gamma, &R->Y, &R->Y ) );
+    MPI_CHK( mod_mul( grp, beta, &R->X, gamma ) );
+
+    /* alpha = 3 * (X - delta) * (X + delta) */
+    MPI_CHK( mod_sub( grp, t, &R->X, delta ) );
+    MPI_CHK( mod_add( grp, alpha, &R->X, delta ) );
+    MPI_CHK( mod_mul( grp, alpha, alpha, t ) );
+    MPI_CHK( mod_add( grp, t, alpha, alpha ) );
+    MPI_CHK( mod_add( grp, alpha, alpha, t ) );
+
+    /* Z = (Y + Z)^2 - gamma - delta */
+    MPI_CHK( mod_add( grp, &R->Z, &R->Y, &R->Z ) );
+    MPI_CHK( mod_mul( grp, &R->Z, &R->Z, &R->Z ) );
+    MPI_CHK( mod_sub( grp, &R->Z, &R->Z, gamma ) );
+    MPI_CHK( mod_sub( grp, &R->Z, &R->Z, delta ) );
+
+    /* X = alpha^2 - 8 * beta, beta becomes 4 * beta */
+    MPI_CHK( mod_dbl( grp, beta ) );
+    MPI_CHK( mod_dbl( grp, beta ) );
+    MPI_CHK( mod_mul( grp, &R->X, alpha, alpha ) );
+    MPI_CHK( mod_sub( grp, &R->X, &R->X, beta ) );
+    MPI_CHK( mod_sub( grp, &R->X, &R->X, beta ) );
+
+    /* Y = alpha * (4 * beta - X) - 8 * gamma^2 */
+    MPI_CHK( mod_sub( grp, beta, beta, &R->X ) );
+    MPI_CHK( mod_mul( grp, &R->Y, alpha, beta ) );
+    MPI_CHK( mod_mul( grp, gamma, gamma, gamma ) );
+    MPI_CHK( mod_dbl( grp, gamma ) );
+    MPI_CHK( mod_dbl( grp, gamma ) );
+    MPI_CHK( mod_dbl( grp, gamma ) );
+    MPI_CHK( mod_sub( grp, &R->Y, &R->Y, gamma ) );
+
+cleanup:
+
+    return( ret );
+}
+
+/*
+ * R = R + (x, y), mixed Jacobian-affine addition
+ */
+static int ecdsa_add( ecdsa_group *grp, ecdsa_point *R, mpi *x, mpi *y )
+{
+    int ret;
+    mpi *u = &grp->T1, *s = &grp->T2, *h = &grp->T3;
+    mpi *hh = &grp->T4, *t = &grp->T5;
+
+    if( mpi_cmp_int( &R->Z, 0 ) == 0 )
+    {
+        MPI_CHK( mpi_copy( &R->X, x ) );
+        MPI_CHK( mpi_copy( &R->Y, y ) );
+        MPI_CHK( mpi_lset( &R->Z, 1 ) );
+        return( 0 );
+    }
+
+    /* u = x * Z^2, s = y * Z^3 */
+    MPI_CHK( mod_mul( grp, t, &R->Z, &R->Z ) );
+    MPI_CHK( mod_mul( grp, u, t, x ) );
+    MPI_CHK( mod_mul( grp, t, t, &R->Z ) );
+    MPI_CHK( mod_mul( grp, s, t, y ) );
+
+    /* h = u - X, s = s - Y */
+    MPI_CHK( mod_sub( grp, h, u, &R->X ) );
+    MPI_CHK( mod_sub( grp, s, s, &R->Y ) );
+
+    if( mpi_cmp_int( h, 0 ) == 0 )
+    {
+        if( mpi_cmp_int( s, 0 ) == 0 )
+            return( ecdsa_double( grp, R ) );
+
+        return( mpi_lset( &R->Z, 0 ) );
+    }
+
+    MPI_CHK( mod_mul( grp, &R->Z, &R->Z, h ) );
+
+    /* hh = h^2, h = h^3, u = X * h^2 */
+    MPI_CHK( mod_mul( grp, hh, h, h ) );
+    MPI_CHK( mod_mul( grp, h, hh, h ) );
+    MPI_CHK( mod_mul( grp, u, &R->X, hh ) );
+
+    /* X = s^2 - h^3 - 2 * u */
+    MPI_CHK( mod_mul( grp, &R->X, s, s ) );
+    MPI_CHK( mod_sub( grp, &R->X, &R->X, h ) );
+    MPI_CHK( mod_sub( grp, &R->X, &R->X, u ) );
+    MPI_CHK( mod_sub( grp, &R->X, &R->X, u ) );
+
+    /* Y = s * (u - X) - Y * h^3 */
+    MPI_CHK( mod_sub( grp, u, u, &R->X ) );
+    MPI_CHK( mod_mul( grp, h, h, &R->Y ) );
+    MPI_CHK( mod_mul( grp, &R->Y, s, u ) );
+    MPI_CHK( mod_sub( grp, &R->Y, &R->Y, h ) );
+
+cleanup:
+
+    return( ret );
+}
+
+/*
+ * (x, y) = k * G
+ */
+static int ecdsa_mul_base( ecdsa_group *grp, mpi *x, mpi *y, mpi *k )
+{
+    int ret, i;
+    ecdsa_point R;
+
+    mpi_init( &R.X, &R.Y, &R.Z, NULL );
+
+    MPI_CHK( mpi_lset( &R.Z, 0 ) );
+
+    for( i = mpi_msb( k ) - 1; i >= 0; i-- )
+    {
+        MPI_CHK( ecdsa_double( grp, &R ) );
+
+        if( ( k->p[i / ( sizeof( t_int ) << 3 )] >>
+                   ( i % ( sizeof( t_int ) << 3 ) ) ) & 1 )
+            MPI_CHK( ecdsa_add( grp, &R, &grp->Gx, &grp->Gy ) );
+    }
+
+    if( mpi_cmp_int( &R.Z, 0 ) == 0 )
+    {
+        ret = POLARSSL_ERR_ECDSA_BAD_INPUT_DATA;
+        goto cleanup;
+    }
+
+    /* x = X / Z^2, y = Y / Z^3 */
+    MPI_CHK( mpi_inv_mod( &grp->T1, &R.Z, &grp->P ) );
+    MPI_CHK( mod_mul( grp, &grp->T2, &grp->T1, &grp->T1 ) );
+    MPI_CHK( mod_mul( grp, x, &R.X, &grp->T2 ) );
+    MPI_CHK( mod_mul( grp, &grp->T2, &grp->T2, &grp->T1 ) );
+    MPI_CHK( mod_mul( grp, y, &R.Y, &grp->T2 ) );
+
+cleanup:
+
+    mpi_free( &R.Z, &R.Y, &R.X, NULL );
+
+    return( ret );
+}
+
+/*
+ * Random scalar in [1, n-1]
+ */
+static int ecdsa_gen_scalar( ecdsa_context *ctx, ecdsa_group *grp, mpi *k )
+{
+    int ret, i;
+    unsigned char buf[ECDSA_P256_LEN];
+
+    do
+    {
+        for( i = 0; i < ECDSA_P256_LEN; i++ )
+            buf[i] = (unsigned char) ctx->f_rng( ctx->p_rng );
+
+        MPI_CHK( mpi_read_binary( k, buf, ECDSA_P256_LEN ) );
+    }
+    while( mpi_cmp_int( k, 0 ) == 0 || mpi_cmp_mpi( k, &grp->N ) >= 0 );
+
+cleanup:
+
+    memset( buf, 0, sizeof( buf ) );
+
+    return( ret );
+}
+
+/*
+ * Initialize an ECDSA context
+ */
+void ecdsa_init( ecdsa_context *ctx,
+                 int (*f_rng)(void *),
+                 void *p_rng )
+{
+    memset( ctx, 0, sizeof( ecdsa_context ) );
+
+    ctx->f_rng = f_rng;
+    ctx->p_rng = p_rng;
+}
+
+/*
+ * Generate a P-256 key pair
+ */
+int ecdsa_gen_key( ecdsa_context *ctx )
+{
+    int ret;
+    ecdsa_group grp;
+
+    if( ctx->f_rng == NULL )
+        return( POLARSSL_ERR_ECDSA_BAD_INPUT_DATA );
+
+    MPI_CHK( ecdsa_group_load( &grp ) );
+    MPI_CHK( ecdsa_gen_scalar( ctx, &grp, &ctx->d ) );
+    MPI_CHK( ecdsa_mul_base( &grp, &ctx->Qx, &ctx->Qy, &ctx->d ) );
+
+cleanup:
+
+    ecdsa_group_free( &grp );
+
+    if( ret != 0 )
+    {
+        ecdsa_free( ctx );
+        return( POLARSSL_ERR_ECDSA_KEY_GEN_FAILED | ret );
+    }
+
+    return( 0 );
+}
+
+/*
+ * r = (k * G).x mod n, s = (e + r * d) / k mod n
+ */
+int ecdsa_sign( ecdsa_context *ctx,
+                unsigned char *hash, int hlen,
+                mpi *r, mpi *s )
+{
+    int ret;
+    mpi e, k, x, y;
+    ecdsa_group grp;
+
+    if( ctx->f_rng == NULL || hlen > ECDSA_P256_LEN )
+        return( POLARSSL_ERR_ECDSA_BAD_INPUT_DATA );
+
+    mpi_init( &e, &k, &x, &y, NULL );
+
+    MPI_CHK( ecdsa_group_load( &grp ) );
+    MPI_CHK( mpi_read_binary( &e, hash, hlen ) );
+
+    do
+    {
+        MPI_CHK( ecdsa_gen_scalar( ctx, &grp, &k ) );
+        MPI_CHK( ecdsa_mul_base( &grp, &x, &y, &k ) );
+        MPI_CHK( mpi_mod_mpi( r, &x, &grp.N ) );
+
+        if( mpi_cmp_int( r, 0 ) == 0 )
+            continue;
+
+        MPI_CHK( mpi_mul_mpi( s, r, &ctx->d ) );
+        MPI_CHK( mpi_add_mpi( s, s, &e ) );
+        MPI_CHK( mpi_inv_mod( &k, &k, &grp.N ) );
+        MPI_CHK( mpi_mul_mpi( s, s, &k ) );
+        MPI_CHK( mpi_mod_mpi( s, s, &grp.N ) );
+    }
+    while( mpi_cmp_int( r, 0 ) == 0 || mpi_cmp_int( s, 0 ) == 0 );
+
+cleanup:
+
+    ecdsa_group_free( &grp );
+    mpi_free( &y, &x, &k, &e, NULL );
+
+    if( ret != 0 )
+        return( POLARSSL_ERR_ECDSA_SIGN_FAILED | ret );
+
+    return( 0 );
+}
+
+/*
+ * Free the components of an ECDSA key
+ */
+void ecdsa_free( ecdsa_context *ctx )
+{
+    mpi_free( &ctx->Qy, &ctx->Qx, &ctx->d, NULL );
+}
+
+#endif
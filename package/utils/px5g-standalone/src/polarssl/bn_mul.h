@@ -545,35 +545,44 @@
 
 #endif /* Alpha */
 
-#if defined(__mips__)
+#if defined(__mips__) && !defined(__mips64)
 
+/*
+ * The three macros form a single asm statement, so the registers
+ * really stay live from one MULADDC_CORE to the next.
+ */
 #define MULADDC_INIT                            \
-    asm( "lw     $10, %0        " :: "m" (s));  \
-    asm( "lw     $11, %0        " :: "m" (d));  \
-    asm( "lw     $12, %0        " :: "m" (c));  \
-    asm( "lw     $13, %0        " :: "m" (b));
+    asm(                                        \
+        "lw     $10, %3         \n\t"           \
+        "lw     $11, %4         \n\t"           \
+        "lw     $12, %5         \n\t"           \
+        "lw     $13, %6         \n\t"
 
 #define MULADDC_CORE                            \
-    asm( "lw     $14, 0($10)    " );            \
-    asm( "multu  $13, $14       " );            \
-    asm( "addi   $10, $10, 4    " );            \
-    asm( "mflo   $14            " );            \
-    asm( "mfhi   $9             " );            \
-    asm( "addu   $14, $12, $14  " );            \
-    asm( "lw     $15, 0($11)    " );            \
-    asm( "sltu   $12, $14, $12  " );            \
-    asm( "addu   $15, $14, $15  " );            \
-    asm( "sltu   $14, $15, $14  " );            \
-    asm( "addu   $12, $12, $9   " );            \
-    asm( "sw     $15, 0($11)    " );            \
-    asm( "addu   $12, $12, $14  " );            \
-    asm( "addi   $11, $11, 4    " );
+        "lw     $14, 0($10)     \n\t"           \
+        "multu  $13, $14        \n\t"           \
+        "addiu  $10, $10, 4     \n\t"           \
+        "mflo   $14             \n\t"           \
+        "mfhi   $9              \n\t"           \
+        "addu   $14, $12, $14   \n\t"           \
+        "lw     $15, 0($11)     \n\t"           \
+        "sltu   $12, $14, $12   \n\t"           \
+        "addu   $15, $14, $15   \n\t"           \
+        "sltu   $14, $15, $14   \n\t"           \
+        "addu   $12, $12, $9    \n\t"           \
+        "sw     $15, 0($11)     \n\t"           \
+        "addu   $12, $12, $14   \n\t"           \
+        "addiu  $11, $11, 4     \n\t"
 
 #define MULADDC_STOP                            \
-    asm( "sw     $12, %0        " : "=m" (c));  \
-    asm( "sw     $11, %0        " : "=m" (d));  \
-    asm( "sw     $10, %0        " : "=m" (s) :: \
-    "$9", "$10", "$11", "$12", "$13", "$14", "$15" );
+        "sw     $12, %0         \n\t"           \
+        "sw     $11, %1         \n\t"           \
+        "sw     $10, %2         \n\t"           \
+        : "=m" (c), "=m" (d), "=m" (s)          \
+        : "m" (s), "m" (d), "m" (c), "m" (b)    \
+        : "$9", "$10", "$11", "$12", "$13",     \
+          "$14", "$15", "hi", "lo", "memory"    \
+    );
 
 #endif /* MIPS */
 #endif /* GNUC */
@@ -56,15 +56,24 @@
  */
 
 /*
- * Uncomment if the compiler supports long long.
-#define POLARSSL_HAVE_LONGLONG
+ * Comment if the compiler does not support long long. The double limb
+ * type must be twice as wide as a long: on 64-bit targets this needs the
+ * 128-bit type, see bignum.h.
  */
-
+#if !defined(__LP64__) || defined(__SIZEOF_INT128__)
+#define POLARSSL_HAVE_LONGLONG
+#endif
 
 /*
- * Uncomment to enable the use of assembly code.
+ * Uncomment to enable the use of assembly code. The 32-bit MIPS
+ * multiply-accumulate loop is always used, it cannot be assembled
+ * in MIPS16 mode though.
  */
 /* #define POLARSSL_HAVE_ASM */
+#if defined(__mips__) && !defined(__mips64) && !defined(__mips16) && \
+    !( defined(__mips_isa_rev) && __mips_isa_rev >= 6 )
+#define POLARSSL_HAVE_ASM
+#endif
 
 /*
  * Uncomment if the CPU supports SSE2 (IA-32 specific).
@@ -180,6 +189,15 @@
  */
 #define POLARSSL_DHM_C
 
+/*
+ * Module:  library/ecdsa.c
+ * Caller:  library/x509write.c
+ *
+ * This module adds ECDSA key generation and signing on the NIST P-256
+ * curve.
+ */
+#define POLARSSL_ECDSA_C
+
 /*
  * Module:  library/havege.c
  * Caller:
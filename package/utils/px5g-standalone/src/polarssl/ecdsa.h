@@ -0,0 +1,101 @@
+/**
+ * \file ecdsa.h
+ *
+ *  ECDSA on the NIST P-256 curve
+ *
+ *  Copyright (C) 2015 OpenWrt.org
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License, version 2.1 as published by the Free Software Foundation.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA  02110-1301  USA
+ */
+#ifndef POLARSSL_ECDSA_H
+#define POLARSSL_ECDSA_H
+
+#include "polarssl/bignum.h"
+
+#define POLARSSL_ERR_ECDSA_BAD_INPUT_DATA                  -0x0500
+#define POLARSSL_ERR_ECDSA_KEY_GEN_FAILED                  -0x0510
+#define POLARSSL_ERR_ECDSA_SIGN_FAILED                     -0x0520
+
+/*
+ * Size of a P-256 field element or scalar in chars
+ */
+#define ECDSA_P256_LEN  32
+
+/**
+ * \brief          ECDSA context structure
+ */
+typedef struct
+{
+    mpi d;                      /*!<  private scalar    */
+    mpi Qx;                     /*!<  public point, x   */
+    mpi Qy;                     /*!<  public point, y   */
+
+    int (*f_rng)(void *);       /*!<  RNG function      */
+    void *p_rng;                /*!<  RNG parameter     */
+}
+ecdsa_context;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief          Initialize an ECDSA context
+ *
+ * \param ctx      ECDSA context to be initialized
+ * \param f_rng    RNG function
+ * \param p_rng    RNG parameter
+ */
+void ecdsa_init( ecdsa_context *ctx,
+                 int (*f_rng)(void *),
+                 void *p_rng );
+
+/**
+ * \brief          Generate a P-256 key pair
+ *
+ * \param ctx      ECDSA context that will hold the key
+ *
+ * \note           ecdsa_init() must be called beforehand to setup
+ *                 the RNG.
+ *
+ * \return         0 if successful, or an POLARSSL_ERR_ECDSA_XXX code
+ */
+int ecdsa_gen_key( ecdsa_context *ctx );
+
+/**
+ * \brief          Sign a message digest
+ *
+ * \param ctx      ECDSA context holding the private key
+ * \param hash     message digest
+ * \param hlen     length of the digest, at most ECDSA_P256_LEN
+ * \param r        first half of the signature
+ * \param s        second half of the signature
+ *
+ * \return         0 if successful, or an POLARSSL_ERR_ECDSA_XXX code
+ */
+int ecdsa_sign( ecdsa_context *ctx,
+                unsigned char *hash, int hlen,
+                mpi *r, mpi *s );
+
+/**
+ * \brief          Free the components of an ECDSA key
+ */
+void ecdsa_free( ecdsa_context *ctx );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ecdsa.h */
@@ -27,6 +27,7 @@
 #include "polarssl/bignum.h"
 #include "polarssl/x509.h"
 #include "polarssl/rsa.h"
+#include "polarssl/ecdsa.h"
 
 #define PX5G_VERSION "0.1"
 #define PX5G_COPY "Copyright (c) 2009 Steven Barth <steven@midlink.org>"
@@ -75,14 +76,51 @@ int rsakey(char **arg) {
 	return 0;
 }
 
+int eckey(char **arg) {
+	havege_state hs;
+	ecdsa_context ec;
+
+	char *path = NULL;
+	int flag = X509_OUTPUT_PEM;
+
+	while (*arg && **arg == '-') {
+		if (!strcmp(*arg, "-out") && arg[1]) {
+			path = arg[1];
+			arg++;
+		} else if (!strcmp(*arg, "-der")) {
+			flag = X509_OUTPUT_DER;
+		}
+		arg++;
+	}
+
+	havege_init(&hs);
+	ecdsa_init(&ec, havege_rand, &hs);
+
+	fprintf(stderr, "Generating EC private key, P-256 curve\n");
+	if (ecdsa_gen_key(&ec)) {
+		fprintf(stderr, "error: key generation failed\n");
+		return 1;
+	}
+
+	if (x509write_ec_keyfile(&ec, path, flag)) {
+		fprintf(stderr, "error: I/O error\n");
+		return 1;
+	}
+
+	ecdsa_free(&ec);
+	return 0;
+}
+
 int selfsigned(char **arg) {
 	havege_state hs;
 	rsa_context rsa;
+	ecdsa_context ec;
 	x509_node node;
 
 	char *subject = "";
 	unsigned int ksize = 512;
 	int exp = 65537;
+	int use_ec = 0;
 	unsigned int days = 30;
 	char *keypath = NULL, *certpath = NULL;
 	int flag = X509_OUTPUT_PEM;
@@ -93,11 +131,14 @@ int selfsigned(char **arg) {
 		if (!strcmp(*arg, "-der")) {
 			flag = X509_OUTPUT_DER;
 		} else if (!strcmp(*arg, "-newkey") && arg[1]) {
-			if (strncmp(arg[1], "rsa:", 4)) {
+			if (!strcmp(arg[1], "ec")) {
+				use_ec = 1;
+			} else if (!strncmp(arg[1], "rsa:", 4)) {
+				ksize = (unsigned int)atoi(arg[1] + 4);
+			} else {
 				fprintf(stderr, "error: invalid algorithm");
 				return 1;
 			}
-			ksize = (unsigned int)atoi(arg[1] + 4);
 			arg++;
 		} else if (!strcmp(*arg, "-days") && arg[1]) {
 			days = (unsigned int)atoi(arg[1]);
@@ -141,15 +182,25 @@ int selfsigned(char **arg) {
 
 	havege_init(&hs);
 	rsa_init(&rsa, RSA_PKCS_V15, 0, havege_rand, &hs);
+	ecdsa_init(&ec, havege_rand, &hs);
 	x509write_init_node(&node);
-	fprintf(stderr, "Generating RSA private key, %i bit long modulus\n", ksize);
-	if (rsa_gen_key(&rsa, ksize, exp)) {
-		fprintf(stderr, "error: key generation failed\n");
-		return 1;
+	if (use_ec) {
+		fprintf(stderr, "Generating EC private key, P-256 curve\n");
+		if (ecdsa_gen_key(&ec)) {
+			fprintf(stderr, "error: key generation failed\n");
+			return 1;
+		}
+	} else {
+		fprintf(stderr, "Generating RSA private key, %i bit long modulus\n", ksize);
+		if (rsa_gen_key(&rsa, ksize, exp)) {
+			fprintf(stderr, "error: key generation failed\n");
+			return 1;
+		}
 	}
 
 	if (keypath) {
-		if (x509write_keyfile(&rsa, keypath, flag)) {
+		if (use_ec ? x509write_ec_keyfile(&ec, keypath, flag) :
+				x509write_keyfile(&rsa, keypath, flag)) {
 			fprintf(stderr, "error: I/O error\n");
 			return 1;
 		}
@@ -164,12 +215,16 @@ int selfsigned(char **arg) {
 
 	x509_raw cert;
 	x509write_init_raw(&cert);
-	x509write_add_pubkey(&cert, &rsa);
+	if (use_ec)
+		x509write_add_ec_pubkey(&cert, &ec);
+	else
+		x509write_add_pubkey(&cert, &rsa);
 	x509write_add_subject(&cert, (unsigned char*)subject);
 	x509write_add_validity(&cert, (unsigned char*)fstr, (unsigned char*)tstr);
 	fprintf(stderr, "Generating selfsigned certificate with subject '%s'"
 			" and validity %s-%s\n", subject, fstr, tstr);
-	if (x509write_create_selfsign(&cert, &rsa)) {
+	if (use_ec ? x509write_create_ec_selfsign(&cert, &ec) :
+			x509write_create_selfsign(&cert, &rsa)) {
 		fprintf(stderr, "error: certificate generation failed\n");
 	}
 
@@ -179,6 +234,7 @@ int selfsigned(char **arg) {
 	}
 
 	x509write_free_raw(&cert);
+	ecdsa_free(&ec);
 	rsa_free(&rsa);
 	return 0;
 }
@@ -188,6 +244,8 @@ int main(int argc, char *argv[]) {
 		//Usage
 	} else if (!strcmp(argv[1], "rsakey")) {
 		return rsakey(argv+2);
+	} else if (!strcmp(argv[1], "eckey")) {
+		return eckey(argv+2);
 	} else if (!strcmp(argv[1], "selfsigned")) {
 		return selfsigned(argv+2);
 	}
@@ -195,6 +253,6 @@ int main(int argc, char *argv[]) {
 	fprintf(stderr,
 		"PX5G X.509 Certificate Generator Utility v" PX5G_VERSION "\n" PX5G_COPY
 		"\nbased on PolarSSL by Christophe Devine and Paul Bakker\n\n");
-	fprintf(stderr, "Usage: %s [rsakey|selfsigned]\n", *argv);
+	fprintf(stderr, "Usage: %s [rsakey|eckey|selfsigned]\n", *argv);
 	return 1;
 }
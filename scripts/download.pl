@@ -1,5 +1,5 @@
 #!/usr/bin/env perl
-# 
+#
 # Copyright (C) 2006 OpenWrt.org
 #
 # This is free software, licensed under the GNU General Public License v2.
@@ -10,15 +10,17 @@ use strict;
 use warnings;
 use File::Basename;
 use File::Copy;
+use Digest::MD5;
+use Digest::SHA;
+use Text::ParseWords;
 
-@ARGV > 2 or die "Syntax: $0 <target dir> <filename> <md5sum> [<mirror> ...]\n";
+my $syntax = "Syntax: $0 <target dir> <filename> <md5sum|sha256sum> [<mirror> ...]\n" .
+	"        $0 [-j <jobs>] -f <list file>\n";
 
-my $target = shift @ARGV;
-my $filename = shift @ARGV;
-my $md5sum = shift @ARGV;
+my $target;
+my $filename;
+my $hash;
 my $scriptdir = dirname($0);
-my @mirrors;
-my $ok;
 
 sub localmirrors {
 	my @mlist;
@@ -46,36 +48,58 @@ sub localmirrors {
 	return @mlist;
 }
 
-sub which($) {
-	my $prog = shift;
-	my $res = `which $prog`;
-	$res or return undef;
-	$res =~ /^no / and return undef;
-	$res =~ /not found/ and return undef;
-	return $res;
+# The requested checksum selects the hash: 32 hex digits for MD5, 64 for
+# SHA-256. Anything else is not verified, but MD5 is still reported.
+sub hash_new() {
+	return Digest::SHA->new(256) if $hash =~ /^[0-9a-f]{64}$/i;
+	return Digest::MD5->new;
+}
+
+sub hash_known() {
+	return $hash =~ /^([0-9a-f]{32}|[0-9a-f]{64})$/i;
 }
 
-my $md5cmd = which("md5sum") || which("md5") || die 'no md5 checksum program found, please install md5 or md5sum';
-chomp $md5cmd;
+sub hash_check($) {
+	my $sum = shift;
+
+	if (hash_known() and $sum ne lc($hash)) {
+		print STDERR "Hash of the downloaded file does not match (file: $sum, requested: $hash) - deleting download.\n";
+		return 0;
+	}
+	return 1;
+}
 
 sub download
 {
 	my $mirror = shift;
 	my $options = $ENV{WGET_OPTIONS} || "";
+	my $dl = "$target/$filename.dl";
+	my $digest = hash_new();
+	my $streamed = 0;
 
 	$mirror =~ s!/$!!;
 
+	if (! -d "$target") {
+		system("mkdir", "-p", "$target/");
+	}
+
+	# Only continue a partial file fetched from this very mirror, and only
+	# if the result can be verified afterwards.
+	if (-e $dl) {
+		my $src;
+		if (open my $fh, "<", "$dl.src") {
+			chomp($src = <$fh> // "");
+			close $fh;
+		}
+		cleanup() unless hash_known() and defined $src and $src eq $mirror;
+	}
+
 	if ($mirror =~ s!^file://!!) {
 		if (! -d "$mirror") {
 			print STDERR "Wrong local cache directory -$mirror-.\n";
-			cleanup();
 			return;
 		}
 
-		if (! -d "$target") {
-			system("mkdir", "-p", "$target/");
-		}
-
 		if (! open TMPDLS, "find $mirror -follow -name $filename 2>/dev/null |") {
 			print("Failed to search for $filename in $mirror\n");
 			return;
@@ -99,113 +123,282 @@ sub download
 		}
 
 		print("Copying $filename from $link\n");
-		copy($link, "$target/$filename.dl");
-
-		if (system("$md5cmd '$target/$filename.dl' > '$target/$filename.md5sum'")) {
-			print("Failed to generate md5 sum for $filename\n");
+		if (!copy($link, $dl)) {
+			print STDERR "Failed to copy $link: $!\n";
+			cleanup();
+			return;
+		}
+	} elsif (-s $dl) {
+		# A previous attempt left a partial file behind, let wget continue
+		# it. Servers without range support send the whole file again.
+		print("Resuming $filename from $mirror\n");
+		if (system("wget -c -t5 --timeout=20 --no-check-certificate $options -O '$dl' '$mirror/$filename'")) {
+			print STDERR "Download failed.\n";
+			-s $dl ? keep_partial($mirror) : cleanup();
 			return;
 		}
 	} else {
 		open WGET, "wget -t5 --timeout=20 --no-check-certificate $options -O- '$mirror/$filename' |" or die "Cannot launch wget.\n";
-		open MD5SUM, "| $md5cmd > '$target/$filename.md5sum'" or die "Cannot launch md5sum.\n";
-		open OUTPUT, "> $target/$filename.dl" or die "Cannot create file $target/$filename.dl: $!\n";
+		open OUTPUT, "> $dl" or die "Cannot create file $dl: $!\n";
 		my $buffer;
 		while (read WGET, $buffer, 1048576) {
-			print MD5SUM $buffer;
+			$digest->add($buffer);
 			print OUTPUT $buffer;
 		}
-		close MD5SUM;
 		close WGET;
+		my $failed = $? >> 8;
 		close OUTPUT;
+		$streamed = 1;
 
-		if ($? >> 8) {
+		if ($failed) {
 			print STDERR "Download failed.\n";
-			cleanup();
+			-s $dl ? keep_partial($mirror) : cleanup();
 			return;
 		}
 	}
 
-	my $sum = `cat "$target/$filename.md5sum"`;
-	$sum =~ /^(\w+)\s*/ or die "Could not generate md5sum\n";
-	$sum = $1;
+	if (!$streamed) {
+		open my $fh, "<", $dl or do {
+			print STDERR "Cannot read $dl: $!\n";
+			cleanup();
+			return;
+		};
+		binmode $fh;
+		$digest->addfile($fh);
+		close $fh;
+	}
 
-	if (($md5sum =~ /\w{32}/) and ($sum ne $md5sum)) {
-		print STDERR "MD5 sum of the downloaded file does not match (file: $sum, requested: $md5sum) - deleting download.\n";
+	if (!hash_check($digest->hexdigest)) {
 		cleanup();
 		return;
 	}
 
 	unlink "$target/$filename";
-	system("mv", "$target/$filename.dl", "$target/$filename");
+	system("mv", $dl, "$target/$filename");
 	cleanup();
 }
 
 sub cleanup
 {
-	unlink "$target/$filename.dl";
-	unlink "$target/$filename.md5sum";
+	unlink "$target/$filename.dl", "$target/$filename.dl.src";
+}
+
+# Remember where a partial download came from, so that it is only resumed
+# from the same mirror.
+sub keep_partial($)
+{
+	my $mirror = shift;
+	my $fh;
+
+	if (hash_known() and open $fh, ">", "$target/$filename.dl.src") {
+		print $fh "$mirror\n";
+		close $fh;
+	} else {
+		cleanup();
+	}
+}
+
+sub expand_mirrors(@) {
+	my @mirrors;
+
+	foreach my $mirror (@_) {
+		if ($mirror =~ /^\@SF\/(.+)$/) {
+			# give sourceforge a few more tries, because it redirects to different mirrors
+			for (1 .. 5) {
+				push @mirrors, "http://downloads.sourceforge.net/$1";
+			}
+		} elsif ($mirror =~ /^\@GNU\/(.+)$/) {
+			push @mirrors, "http://ftpmirror.gnu.org/$1";
+			push @mirrors, "http://ftp.gnu.org/pub/gnu/$1";
+			push @mirrors, "ftp://ftp.belnet.be/mirror/ftp.gnu.org/gnu/$1";
+			push @mirrors, "ftp://ftp.mirror.nl/pub/mirror/gnu/$1";
+			push @mirrors, "http://mirror.switch.ch/ftp/mirror/gnu/$1";
+		} elsif ($mirror =~ /^\@SAVANNAH\/(.+)$/) {
+			push @mirrors, "http://download.savannah.gnu.org/releases/$1";
+			push @mirrors, "http://nongnu.uib.no/$1";
+			push @mirrors, "http://ftp.igh.cnrs.fr/pub/nongnu/$1";
+			push @mirrors, "http://download-mirror.savannah.gnu.org/releases/$1";
+		} elsif ($mirror =~ /^\@KERNEL\/(.+)$/) {
+			my @extra = ( $1 );
+			if ($filename =~ /linux-\d+\.\d+(?:\.\d+)?-rc/) {
+				push @extra, "$extra[0]/testing";
+			} elsif ($filename =~ /linux-(\d+\.\d+(?:\.\d+)?)/) {
+				push @extra, "$extra[0]/longterm/v$1";
+			}
+			foreach my $dir (@extra) {
+				push @mirrors, "ftp://ftp.all.kernel.org/pub/$dir";
+				push @mirrors, "http://ftp.all.kernel.org/pub/$dir";
+			}
+		} elsif ($mirror =~ /^\@GNOME\/(.+)$/) {
+			push @mirrors, "http://ftp.gnome.org/pub/GNOME/sources/$1";
+			push @mirrors, "http://ftp.unina.it/pub/linux/GNOME/sources/$1";
+			push @mirrors, "http://fr2.rpmfind.net/linux/gnome.org/sources/$1";
+			push @mirrors, "ftp://ftp.dit.upm.es/pub/GNOME/sources/$1";
+			push @mirrors, "ftp://ftp.no.gnome.org/pub/GNOME/sources/$1";
+			push @mirrors, "http://ftp.acc.umu.se/pub/GNOME/sources/$1";
+			push @mirrors, "http://ftp.belnet.be/mirror/ftp.gnome.org/sources/$1";
+			push @mirrors, "http://linorg.usp.br/gnome/sources/$1";
+			push @mirrors, "http://mirror.aarnet.edu.au/pub/GNOME/sources/$1";
+			push @mirrors, "http://mirrors.ibiblio.org/pub/mirrors/gnome/sources/$1";
+			push @mirrors, "ftp://ftp.cse.buffalo.edu/pub/Gnome/sources/$1";
+			push @mirrors, "ftp://ftp.nara.wide.ad.jp/pub/X11/GNOME/sources/$1";
+		} else {
+			push @mirrors, $mirror;
+		}
+	}
+
+	return @mirrors;
 }
 
-@mirrors = localmirrors();
-
-foreach my $mirror (@ARGV) {
-	if ($mirror =~ /^\@SF\/(.+)$/) {
-		# give sourceforge a few more tries, because it redirects to different mirrors
-		for (1 .. 5) {
-			push @mirrors, "http://downloads.sourceforge.net/$1";
-		}
-	} elsif ($mirror =~ /^\@GNU\/(.+)$/) {
-		push @mirrors, "http://ftpmirror.gnu.org/$1";
-		push @mirrors, "http://ftp.gnu.org/pub/gnu/$1";
-		push @mirrors, "ftp://ftp.belnet.be/mirror/ftp.gnu.org/gnu/$1";
-		push @mirrors, "ftp://ftp.mirror.nl/pub/mirror/gnu/$1";
-		push @mirrors, "http://mirror.switch.ch/ftp/mirror/gnu/$1";
-	} elsif ($mirror =~ /^\@SAVANNAH\/(.+)$/) {
-		push @mirrors, "http://download.savannah.gnu.org/releases/$1";
-		push @mirrors, "http://nongnu.uib.no/$1";
-		push @mirrors, "http://ftp.igh.cnrs.fr/pub/nongnu/$1";
-		push @mirrors, "http://download-mirror.savannah.gnu.org/releases/$1";
-	} elsif ($mirror =~ /^\@KERNEL\/(.+)$/) {
-		my @extra = ( $1 );
-		if ($filename =~ /linux-\d+\.\d+(?:\.\d+)?-rc/) {
-			push @extra, "$extra[0]/testing";
-		} elsif ($filename =~ /linux-(\d+\.\d+(?:\.\d+)?)/) {
-			push @extra, "$extra[0]/longterm/v$1";
-		}		
-		foreach my $dir (@extra) {
-			push @mirrors, "ftp://ftp.all.kernel.org/pub/$dir";
-			push @mirrors, "http://ftp.all.kernel.org/pub/$dir";
-		}
-    } elsif ($mirror =~ /^\@GNOME\/(.+)$/) {
-		push @mirrors, "http://ftp.gnome.org/pub/GNOME/sources/$1";
-		push @mirrors, "http://ftp.unina.it/pub/linux/GNOME/sources/$1";
-		push @mirrors, "http://fr2.rpmfind.net/linux/gnome.org/sources/$1";
-		push @mirrors, "ftp://ftp.dit.upm.es/pub/GNOME/sources/$1";
-		push @mirrors, "ftp://ftp.no.gnome.org/pub/GNOME/sources/$1";
-		push @mirrors, "http://ftp.acc.umu.se/pub/GNOME/sources/$1";
-		push @mirrors, "http://ftp.belnet.be/mirror/ftp.gnome.org/sources/$1";
-		push @mirrors, "http://linorg.usp.br/gnome/sources/$1";
-		push @mirrors, "http://mirror.aarnet.edu.au/pub/GNOME/sources/$1";
-		push @mirrors, "http://mirrors.ibiblio.org/pub/mirrors/gnome/sources/$1";
-		push @mirrors, "ftp://ftp.cse.buffalo.edu/pub/Gnome/sources/$1";
-		push @mirrors, "ftp://ftp.nara.wide.ad.jp/pub/X11/GNOME/sources/$1";
-    }
-    else {
-		push @mirrors, $mirror;
+# Probe the first DOWNLOAD_RACE (default 3) distinct remote mirrors at the
+# same time and move the first one that has the file to the front. The
+# others keep their order.
+sub race_mirrors(@) {
+	my @mirrors = @_;
+	my $count = $ENV{DOWNLOAD_RACE};
+	my (%seen, @race, %pids);
+
+	defined $count or $count = 3;
+	foreach my $mirror (@mirrors) {
+		last if @race >= $count;
+		next if $mirror !~ m!^(https?|ftp)://! or $seen{$mirror}++;
+		push @race, $mirror;
+	}
+	return @mirrors if @race < 2;
+
+	foreach my $mirror (@race) {
+		(my $url = $mirror) =~ s!/$!!;
+		my $pid = fork();
+		defined $pid or return @mirrors;
+		if (!$pid) {
+			open STDOUT, ">/dev/null";
+			open STDERR, ">/dev/null";
+			exec("wget", "-q", "-t1", "--timeout=10", "--spider", "--no-check-certificate", "$url/$filename");
+			exit 1;
+		}
+		$pids{$pid} = $mirror;
+	}
+
+	my $fastest;
+	while (%pids) {
+		my $pid = waitpid(-1, 0);
+		last if $pid <= 0;
+		my $mirror = delete $pids{$pid};
+		next unless defined $mirror;
+		if ($? == 0) {
+			$fastest = $mirror;
+			last;
+		}
+	}
+	kill "TERM", keys %pids;
+	waitpid($_, 0) foreach keys %pids;
+
+	return @mirrors unless $fastest;
+	foreach my $i (0 .. $#mirrors) {
+		next if $mirrors[$i] ne $fastest;
+		splice @mirrors, $i, 1;
+		last;
 	}
+	return ($fastest, @mirrors);
 }
 
-#push @mirrors, 'http://mirror1.openwrt.org';
-push @mirrors, 'http://mirror2.openwrt.org/sources';
-push @mirrors, 'http://downloads.openwrt.org/sources';
+sub fetch(@) {
+	my @mirrors = localmirrors();
+	my @remote = expand_mirrors(@_);
 
-while (!$ok) {
-	my $mirror = shift @mirrors;
-	$mirror or die "No more mirrors to try - giving up.\n";
+	#push @remote, 'http://mirror1.openwrt.org';
+	push @remote, 'http://mirror2.openwrt.org/sources';
+	push @remote, 'http://downloads.openwrt.org/sources';
 
-	download($mirror);
-	-f "$target/$filename" and $ok = 1;
+	foreach my $mirror (@mirrors) {
+		download($mirror);
+		return 1 if -f "$target/$filename";
+	}
+
+	# Only probe the remote mirrors once the local ones failed
+	foreach my $mirror (race_mirrors(@remote)) {
+		download($mirror);
+		return 1 if -f "$target/$filename";
+	}
+	return 0;
 }
 
-$SIG{INT} = \&cleanup;
+# Fetch all downloads listed in a file, one set of arguments per line, with
+# a pool of worker processes. The output of a worker is only shown if its
+# download failed.
+sub fetch_list($$) {
+	my $list = shift;
+	my $jobs = shift;
+	my (@queue, %seen, %running);
+	my $failed = 0;
+
+	open LIST, "<$list" or die "Cannot open $list: $!\n";
+	while (<LIST>) {
+		chomp;
+		my @args = shellwords($_);
+		next if @args < 3 or $seen{"$args[0]/$args[1]"}++;
+		next if -f "$args[0]/$args[1]";
+		push @queue, \@args;
+	}
+	close LIST;
+
+	while (@queue or %running) {
+		while (@queue and keys %running < $jobs) {
+			my $args = shift @queue;
+			my $log = "$args->[0]/$args->[1].log";
+			system("mkdir", "-p", $args->[0]) unless -d $args->[0];
+			my $pid = fork();
+			defined $pid or die "Cannot fork: $!\n";
+			if (!$pid) {
+				open STDOUT, ">", $log;
+				open STDERR, ">&STDOUT";
+				($target, $filename, $hash, my @urls) = @$args;
+				exit(fetch(@urls) ? 0 : 1);
+			}
+			print "Downloading $args->[1]\n";
+			$running{$pid} = [ $args->[1], $log ];
+		}
+
+		my $pid = waitpid(-1, 0);
+		last if $pid <= 0;
+		my $job = delete $running{$pid} or next;
+		if ($?) {
+			print STDERR "Failed to download $job->[0]:\n";
+			if (open my $fh, "<", $job->[1]) {
+				print STDERR while <$fh>;
+				close $fh;
+			}
+			$failed++;
+		}
+		unlink $job->[1];
+	}
+
+	return !$failed;
+}
+
+if (@ARGV > 0 and $ARGV[0] =~ /^-[jf]$/) {
+	my $jobs = 4;
+	my $list;
+
+	while (@ARGV > 0) {
+		my $opt = shift @ARGV;
+		if ($opt eq '-j') {
+			$jobs = shift @ARGV;
+		} elsif ($opt eq '-f') {
+			$list = shift @ARGV;
+		} else {
+			die $syntax;
+		}
+	}
+	$list and $jobs > 0 or die $syntax;
+	$| = 1;
+	exit(fetch_list($list, $jobs) ? 0 : 1);
+}
+
+@ARGV > 2 or die $syntax;
+
+$target = shift @ARGV;
+$filename = shift @ARGV;
+$hash = shift @ARGV;
 
+fetch(@ARGV) or die "No more mirrors to try - giving up.\n";
@@ -8,6 +8,9 @@ if [ -z $pkg_dir ] || [ ! -d $pkg_dir ]; then
 	exit 1
 fi
 
+# prefer the native implementation from tools/ipkg-make-index if available
+native=$(which ipkg-make-index 2>/dev/null) && exec "$native" "$pkg_dir"
+
 which md5sum >/dev/null 2>&1 || alias md5sum=md5
 empty=1
 
@@ -895,7 +895,48 @@ Available Commands:
 	$0 package_licensefull [file] 		Package license information (full list)
 	$0 version_filter [patchver] [list...]	Filter list of version tagged strings
 
+Prefix a command with -o [output] to write its result to a file. Several
+such commands can be given to produce all of them in one run.
+
 EOF
 }
 
-parse_command();
+my @outputs;
+
+sub run_commands() {
+	my @cmds;
+
+	while (@ARGV > 0) {
+		my $arg = shift @ARGV;
+		if ($arg eq '-o') {
+			push @cmds, [ shift @ARGV ];
+		} else {
+			push @{$cmds[-1]}, $arg;
+		}
+	}
+
+	foreach my $cmd (@cmds) {
+		my ($out, @args) = @$cmd;
+
+		push @outputs, "$out.tmp";
+		open my $fh, ">", "$out.tmp" or die "Cannot open '$out.tmp': $!\n";
+		my $stdout = select($fh);
+		@ARGV = @args;
+		clear_packages();
+		parse_command();
+		select($stdout);
+		close $fh or die "Cannot write '$out.tmp': $!\n";
+		rename "$out.tmp", $out or die "Cannot rename '$out.tmp': $!\n";
+		pop @outputs;
+	}
+}
+
+END {
+	unlink @outputs;
+}
+
+if (@ARGV > 0 and $ARGV[0] eq '-o') {
+	run_commands();
+} else {
+	parse_command();
+}
@@ -2,6 +2,8 @@ package metadata;
 use base 'Exporter';
 use strict;
 use warnings;
+use Storable qw(nfreeze thaw);
+use Digest::MD5;
 our @EXPORT = qw(%package %srcpackage %category %subdir %preconfig %features %overrides clear_packages parse_package_metadata parse_target_metadata get_multiline);
 
 our %package;
@@ -24,6 +26,56 @@ sub get_multiline {
 	return $str ? $str : "";
 }
 
+# Parsed metadata is kept in "<file>.cache", tagged with the MD5 of the file
+# it was parsed from, and reused for as long as the file stays the same.
+# Within one run, every caller gets its own copy of the parsed data.
+my %parsed;
+
+sub file_md5($) {
+	my $file = shift;
+	my $md5;
+
+	open my $fh, "<", $file or return "";
+	binmode $fh;
+	$md5 = Digest::MD5->new->addfile($fh)->hexdigest;
+	close $fh;
+	return $md5;
+}
+
+sub cache_get($$) {
+	my $file = shift;
+	my $md5 = shift;
+	my $data;
+
+	return thaw($parsed{$file}) if $parsed{$file};
+
+	open my $fh, "<", "$file.cache" or return undef;
+	binmode $fh;
+	my $tag = <$fh>;
+	if (defined $tag and $tag eq "$md5\n") {
+		local $/;
+		$data = <$fh>;
+	}
+	close $fh;
+	return undef unless defined $data;
+
+	$parsed{$file} = $data;
+	return eval { thaw($data) };
+}
+
+sub cache_put($$$) {
+	my $file = shift;
+	my $md5 = shift;
+	my $data = nfreeze(shift);
+	my $tmp = "$file.cache.$$";
+
+	$parsed{$file} = $data;
+	open my $fh, ">", $tmp or return;
+	binmode $fh;
+	print $fh "$md5\n", $data;
+	close $fh and rename($tmp, "$file.cache") or unlink($tmp);
+}
+
 sub confstr($) {
 	my $conf = shift;
 	$conf =~ tr#/\.\-/#___#;
@@ -35,6 +87,10 @@ sub parse_target_metadata($) {
 	my ($target, @target, $profile);
 	my %target;
 	my $makefile;
+	my $md5 = file_md5($file);
+	my $cache = cache_get($file, $md5);
+
+	return @$cache if $cache;
 
 	open FILE, "<$file" or do {
 		warn "Can't open file '$file': $!\n";
@@ -108,6 +164,7 @@ sub parse_target_metadata($) {
 			}
 		];
 	}
+	cache_put($file, $md5, \@target);
 	return @target;
 }
 
@@ -130,6 +187,24 @@ sub parse_package_metadata($) {
 	my $subdir;
 	my $src;
 	my $override;
+	my ($md5, $cache);
+
+	# only a parse into empty tables can be cached as a whole
+	unless (%package or %srcpackage or %category or %subdir or
+		%preconfig or %features or %overrides) {
+		$md5 = file_md5($file);
+		$cache = cache_get($file, $md5);
+	}
+	if ($cache) {
+		%package = %{$cache->{package}};
+		%srcpackage = %{$cache->{srcpackage}};
+		%category = %{$cache->{category}};
+		%subdir = %{$cache->{subdir}};
+		%preconfig = %{$cache->{preconfig}};
+		%features = %{$cache->{features}};
+		%overrides = %{$cache->{overrides}};
+		return 1;
+	}
 
 	open FILE, "<$file" or do {
 		warn "Cannot open '$file': $!\n";
@@ -253,6 +328,15 @@ sub parse_package_metadata($) {
 		/^Preconfig-Default:\s*(.*?)\s*$/ and $preconfig->{default} = $1;
 	}
 	close FILE;
+	$md5 and cache_put($file, $md5, {
+		package => \%package,
+		srcpackage => \%srcpackage,
+		category => \%category,
+		subdir => \%subdir,
+		preconfig => \%preconfig,
+		features => \%features,
+		overrides => \%overrides
+	});
 	return 1;
 }
 
@@ -1,5 +1,5 @@
 #!/usr/bin/env bash
-# 
+#
 # Copyright (C) 2006 OpenWrt.org
 #
 # This is free software, licensed under the GNU General Public License v2.
@@ -12,38 +12,104 @@ SELF=${0##*/}
   exit 1
 }
 
-TARGETS=$*
-
-[ -z "$TARGETS" ] && {
-  echo "$SELF: no directories / files specified"
-  echo "usage: $SELF [PATH...]"
-  exit 1
+# Stripped files are cached by the hash of their unstripped contents, so
+# unchanged binaries are not run through patchelf and strip again. The
+# cache is kept separately for every combination of strip commands.
+# Entries which have not been used for RSTRIP_CACHE_DAYS are dropped.
+[ -n "$TOPDIR" ] && [ -z "$RSTRIP_CACHE" ] && {
+  RSTRIP_CACHE_ROOT="$TOPDIR/tmp/.rstrip"
+  RSTRIP_CACHE="$RSTRIP_CACHE_ROOT/$(echo "$STRIP|$STRIP_KMOD|$NO_RENAME|$KEEP_SYMBOLS|$PATCHELF" | md5sum | cut -d' ' -f1)"
 }
 
-find $TARGETS -type f -a -exec file {} \; | \
-  sed -n -e 's/^\(.*\):.*ELF.*\(executable\|relocatable\|shared object\).*,.* stripped/\1:\2/p' | \
-(
-  IFS=":"
-  while read F S; do
-    echo "$SELF: $F: $S"
-	[ "${S}" = "relocatable" ] && {
-		eval "$STRIP_KMOD $F"
-	} || {
-		b=$(stat -c '%a' $F)
+rstrip_file() {
+	local F="$1" S="$2" H="$3"
+
+	echo "$SELF: $F: $S"
+	[ -n "$H" ] && [ -f "$RSTRIP_CACHE/$H" ] && {
+		cmp -s "$RSTRIP_CACHE/$H" "$F" || cat "$RSTRIP_CACHE/$H" > "$F"
+		touch "$RSTRIP_CACHE/$H"
+		return
+	}
+
+	if [ "${S}" = "relocatable" ]; then
+		eval "$STRIP_KMOD \"\$F\"" || return
+	else
+		b=$(stat -c '%a' "$F")
 		[ -z "$PATCHELF" ] || [ -z "$TOPDIR" ] || {
-			old_rpath="$($PATCHELF --print-rpath $F)"; new_rpath=""
+			old_rpath="$($PATCHELF --print-rpath "$F")"; new_rpath=""
 			for path in $old_rpath; do
 				case "$path" in
 					/lib/[^/]*|/usr/lib/[^/]*|\$ORIGIN/*) new_rpath="${new_rpath:+$new_rpath:}$path" ;;
 					*) echo "$SELF: $F: removing rpath $path" ;;
 				esac
 			done
-			[ "$new_rpath" = "$old_rpath" ] || $PATCHELF --set-rpath "$new_rpath" $F
+			[ "$new_rpath" = "$old_rpath" ] || $PATCHELF --set-rpath "$new_rpath" "$F"
+		}
+		eval "$STRIP \"\$F\"" || return
+		a=$(stat -c '%a' "$F")
+		[ "$a" = "$b" ] || chmod $b "$F"
+	fi
+
+	# remember the result both for the original and for the stripped
+	# contents, the latter so that stripped files are passed through
+	[ -n "$H" ] && mkdir -p "$RSTRIP_CACHE" && \
+		cp "$F" "$RSTRIP_CACHE/$H.$$" && \
+		mv "$RSTRIP_CACHE/$H.$$" "$RSTRIP_CACHE/$H" && \
+		ln -f "$RSTRIP_CACHE/$H" "$RSTRIP_CACHE/$(md5sum < "$F" | cut -d' ' -f1)" 2>/dev/null
+	true
+}
+
+[ "$1" = "--file" ] && {
+	shift
+	while [ $# -ge 3 ]; do
+		rstrip_file "$1" "$2" "$3"
+		shift 3
+	done
+	exit 0
+}
+
+TARGETS=$*
+
+[ -z "$TARGETS" ] && {
+  echo "$SELF: no directories / files specified"
+  echo "usage: $SELF [PATH...]"
+  exit 1
+}
+
+export RSTRIP_CACHE
+JOBS=${RSTRIP_JOBS:-$(getconf _NPROCESSORS_ONLN 2>/dev/null || echo 1)}
+
+# Identify ELF executables, shared objects and relocatables by their
+# header in a single pass instead of running file(1) on every file, and
+# hand them out to parallel workers as <file> <type> <hash> triplets.
+# Hardlinked files are only processed once.
+find $TARGETS -type f -print0 | perl -e '
+	use Digest::MD5;
+	my %type = (1 => "relocatable", 2 => "executable", 3 => "shared object");
+	my %seen;
+	$/ = "\0";
+	while (my $f = <STDIN>) {
+		chomp $f;
+		my @st = lstat($f) or next;
+		next if $st[3] > 1 && $seen{"$st[0]:$st[1]"}++;
+		open(my $fh, "<", $f) or next;
+		binmode $fh;
+		my $hdr;
+		next unless read($fh, $hdr, 18) == 18 && substr($hdr, 0, 4) eq "\x7fELF";
+		my $t = unpack(ord(substr($hdr, 5, 1)) == 2 ? "n" : "v", substr($hdr, 16, 2));
+		next unless $type{$t};
+		my $h = "";
+		if ($ENV{RSTRIP_CACHE}) {
+			seek($fh, 0, 0);
+			$h = Digest::MD5->new->addfile($fh)->hexdigest;
 		}
-		eval "$STRIP $F"
-		a=$(stat -c '%a' $F)
-		[ "$a" = "$b" ] || chmod $b $F
+		print "$f\0$type{$t}\0$h\0";
 	}
-  done
-  true
-)
+' | xargs -0 -r -n 3 -P "$JOBS" "$0" --file
+
+CACHE_DIR="${RSTRIP_CACHE_ROOT:-$RSTRIP_CACHE}"
+[ -n "$CACHE_DIR" ] && [ -d "$CACHE_DIR" ] && {
+  find "$CACHE_DIR" -type f -mtime +"${RSTRIP_CACHE_DAYS:-14}" -delete
+  find "$CACHE_DIR" -mindepth 1 -type d -empty -delete
+} 2>/dev/null
+true
@@ -28,8 +28,11 @@ ${CROSS}objcopy \
 	$ARGS \
 	"$MODULE" "$MODULE.tmp"
 
+# write the result back in place rather than renaming it, so that other
+# hardlinks to the module (and cached copies) see the stripped contents
 [ -n "$NO_RENAME" ] && {
-	mv "${MODULE}.tmp" "$MODULE"
+	cat "${MODULE}.tmp" > "$MODULE"
+	rm -f "${MODULE}.tmp"
 	exit 0
 }
 
@@ -46,5 +49,5 @@ $3 && $2 ~ /[brtd]/ && $3 !~ /\$LC/ && !def[$3] {
 ' > "$MODULE.tmp1"
 
 ${CROSS}objcopy `cat ${MODULE}.tmp1` ${MODULE}.tmp ${MODULE}.out
-mv "${MODULE}.out" "${MODULE}"
-rm -f "${MODULE}".t*
+cat "${MODULE}.out" > "${MODULE}"
+rm -f "${MODULE}".t* "${MODULE}.out"
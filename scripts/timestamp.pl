@@ -1,5 +1,5 @@
 #!/usr/bin/env perl
-# 
+#
 # Copyright (C) 2006 OpenWrt.org
 #
 # This is free software, licensed under the GNU General Public License v2.
@@ -8,25 +8,169 @@
 
 use strict;
 
-sub get_ts($$) {
-	my $path = shift;
-	my $options = shift;
-	my $ts = 0;
-	my $fn = "";
-	$path .= "/" if( -d $path);
-	open FIND, "find $path -type f -and -not -path \\*/.svn\\* -and -not -path \\*CVS\\* $options 2>/dev/null |";
-	while (<FIND>) {
+my @exclude = ("*/.svn*", "*CVS*");
+my ($exclude_re, $prune_re);
+my $follow = 0;
+my $walk_time = time();
+my $manifest;
+my %dirs;
+my %seen;
+my @files;
+
+# Turn a find -path style pattern into a regular expression: '*' and '?'
+# also match '/', a backslash quotes the following character.
+sub glob_to_re($) {
+	my $glob = shift;
+	my $re = "";
+
+	while ($glob =~ /\G(?:(\\(.?))|(\*)|(\?)|(\[!?\]?[^\]]*\])|(.))/gs) {
+		if (defined $1) {
+			$re .= quotemeta($2);
+		} elsif (defined $3) {
+			$re .= ".*";
+		} elsif (defined $4) {
+			$re .= ".";
+		} elsif (defined $5) {
+			my $class = $5;
+			$class =~ s/^\[!/[^/;
+			$re .= $class;
+		} else {
+			$re .= quotemeta($6);
+		}
+	}
+	return $re;
+}
+
+# Build the exclusion regex from all -x patterns. A directory can be skipped
+# entirely if every path below it is excluded anyway, i.e. a pattern ending
+# in '*' already matches "$dir/".
+sub compile_exclude() {
+	my @re = map { glob_to_re($_) } @exclude;
+	my @prune = grep { /\.\*$/ } @re;
+	$exclude_re = "^(?:" . join("|", @re) . ")\$";
+	$exclude_re = qr/$exclude_re/s;
+	$prune_re = @prune ? "^(?:" . join("|", @prune) . ")\$" : "^(?!)";
+	$prune_re = qr/$prune_re/s;
+}
+
+# Return the names in a directory as [ files, subdirectories ]. With a
+# manifest, the listing of a directory whose mtime has not changed since
+# the previous run is reused instead of being read again. Listings of
+# directories modified in the same second as the previous run are not
+# trusted, as later changes in that second would go unnoticed.
+sub list_dir($$) {
+	my $dir = shift;
+	my $mtime = shift;
+	my $cached = $manifest ? $manifest->{dirs}{$dir} : undef;
+
+	if ($cached && $cached->[0] == $mtime && $mtime < $manifest->{time}) {
+		$dirs{$dir} = $cached;
+		return $cached;
+	}
+
+	my (@f, @d);
+	opendir(my $dh, $dir) or return [ $mtime, [], [] ];
+	foreach my $name (sort readdir($dh)) {
+		next if $name eq "." or $name eq "..";
+		my @st = $follow ? stat("$dir/$name") : lstat("$dir/$name");
+		next unless @st;
+		if (-d _) {
+			push @d, $name;
+		} elsif (-f _) {
+			push @f, $name;
+		}
+	}
+	closedir($dh);
+
+	return $dirs{$dir} = [ $mtime, \@f, \@d ];
+}
+
+# Manifest format: the time of the run on the first line, followed by the
+# directories ("D <mtime> <path>") with their files ("f <name>") and
+# subdirectories ("d <name>"), and the files that were checked ("F <path>").
+sub read_manifest($) {
+	my $file = shift;
+	my $m = { dirs => {}, list => "" };
+	my $cur;
+
+	open(my $fh, "<", $file) or return undef;
+	$m->{time} = <$fh>;
+	defined $m->{time} and $m->{time} =~ /^\d+$/ or return undef;
+	while (<$fh>) {
 		chomp;
-		my $file = $_;
-		next if -l $file;
-		my $mt = (stat $file)[9];
-		if ($mt > $ts) {
-			$ts = $mt;
-			$fn = $file;
+		my ($t, $v) = split /\t/, $_, 2;
+		if ($t eq "D") {
+			my ($mtime, $dir) = split /\t/, $v, 2;
+			$cur = $m->{dirs}{$dir} = [ $mtime, [], [] ];
+		} elsif ($t eq "f" and $cur) {
+			push @{$cur->[1]}, $v;
+		} elsif ($t eq "d" and $cur) {
+			push @{$cur->[2]}, $v;
+		} elsif ($t eq "F") {
+			$m->{list} .= "$v\n";
 		}
 	}
-	close FIND;
-	return ($ts, $fn);
+	close($fh);
+	return $m;
+}
+
+sub write_manifest($$) {
+	my $file = shift;
+	my $list = shift;
+
+	open(my $fh, ">", "$file.$$") or return;
+	print $fh "$walk_time\n";
+	foreach my $dir (sort keys %dirs) {
+		my $d = $dirs{$dir};
+		print $fh "D\t$d->[0]\t$dir\n";
+		print $fh "f\t$_\n" foreach @{$d->[1]};
+		print $fh "d\t$_\n" foreach @{$d->[2]};
+	}
+	print $fh "F\t$_" foreach split /^/m, $list;
+	close($fh) and rename("$file.$$", $file) or unlink("$file.$$");
+}
+
+sub walk_dir($$$) {
+	my $dir = shift;
+	my $mtime = shift;
+	my $ts = shift;
+	my $list = list_dir($dir, $mtime);
+
+	foreach my $name (@{$list->[1]}) {
+		my $file = "$dir/$name";
+		next if $file =~ $exclude_re;
+		my @st = lstat($file);
+		next unless @st and -f _;
+		push @files, $file;
+		if ($st[9] > $ts->[0]) {
+			@$ts = ($st[9], $file);
+		}
+	}
+
+	foreach my $name (@{$list->[2]}) {
+		my $sub = "$dir/$name";
+		next if "$sub/" =~ $prune_re;
+		my @st = $follow ? stat($sub) : lstat($sub);
+		next unless @st and -d _;
+		next if $seen{"$st[0]:$st[1]"}++;
+		walk_dir($sub, $st[9], $ts);
+	}
+}
+
+sub get_ts($) {
+	my $path = shift;
+	my $ts = [ 0, "" ];
+
+	$path =~ s!(.)/+$!$1!;
+	if (-d $path) {
+		my @st = stat(_);
+		%seen = ( "$st[0]:$st[1]" => 1 );
+		walk_dir($path, $st[9], $ts);
+	} elsif (-f $path and not -l $path and $path !~ $exclude_re) {
+		push @files, $path;
+		$ts = [ (stat(_))[9], $path ];
+	}
+	return @$ts;
 }
 
 (@ARGV > 0) or push @ARGV, ".";
@@ -36,17 +180,20 @@ my %options;
 while (@ARGV > 0) {
 	my $path = shift @ARGV;
 	if ($path =~ /^-x/) {
-		my $str = shift @ARGV;
-		$options{"findopts"} .= " -and -not -path '".$str."'"
+		push @exclude, shift @ARGV;
 	} elsif ($path =~ /^-f/) {
-		$options{"findopts"} .= " -follow";
+		$follow = 1;
+	} elsif ($path =~ /^-m/) {
+		$options{$path} = shift @ARGV;
+		$manifest = read_manifest($options{$path});
 	} elsif ($path =~ /^-n/) {
 		my $arg = $ARGV[0];
 		$options{$path} = $arg;
 	} elsif ($path =~ /^-/) {
 		$options{$path} = 1;
 	} else {
-		my ($tmp, $fname) = get_ts($path, $options{"findopts"});
+		compile_exclude() unless $exclude_re;
+		my ($tmp, $fname) = get_ts($path);
 		if ($tmp > $ts) {
 			if ($options{'-F'}) {
 				$n = $fname;
@@ -58,6 +205,16 @@ while (@ARGV > 0) {
 	}
 }
 
+# With -l, files that were added or removed since the previous run also
+# count as a change.
+if ($options{"-m"}) {
+	my $list = join("", map { "$_\n" } sort @files);
+	if ($options{"-l"} and $manifest and $manifest->{list} ne $list) {
+		$n = "";
+	}
+	write_manifest($options{"-m"}, $list);
+}
+
 if ($options{"-n"}) {
 	exit ($n eq $options{"-n"} ? 0 : 1);
 } elsif ($options{"-p"}) {
@@ -0,0 +1,620 @@
+/*
+ * yaffs_sim - run yaffs2 against a NAND flash emulated in RAM
+ *
+ * Reads a workload script (see usage()) and reports mount and checkpoint
+ * times together with the NAND operations it caused, so that changes to
+ * the yaffs2 core can be measured without hardware.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <stdarg.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "yaffs_guts.h"
+#include "yaffs_trace.h"
+
+unsigned int yaffs_trace_mask = YAFFS_TRACE_BAD_BLOCKS | YAFFS_TRACE_ALWAYS;
+unsigned int yaffs_wr_attempts = YAFFS_WR_ATTEMPTS;
+
+/* Rough timings of a SLC NAND, used for the estimated flash time */
+#define NAND_READ_US	25
+#define NAND_PROG_US	250
+#define NAND_ERASE_US	2000
+
+struct nand_stats {
+	unsigned long long reads;
+	unsigned long long read_ops;
+	unsigned long long programs;
+	unsigned long long erases;
+	unsigned long long host_bytes;
+};
+
+static struct {
+	int page_size;
+	int oob_size;
+	int pages_per_block;
+	int n_blocks;
+	u8 *data;
+	u8 *oob;
+	u8 *bad;
+	struct nand_stats stats;
+} nand;
+
+static struct yaffs_dev dev;
+static int mounted;
+static int verbose;
+static int n_caches = 32;
+static int no_summary;
+static int no_multi_read;
+static int line_no;
+
+static void fail(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	fprintf(stderr, "line %d: ", line_no);
+	vfprintf(stderr, fmt, ap);
+	fprintf(stderr, "\n");
+	va_end(ap);
+	exit(1);
+}
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* RAM NAND driver */
+
+static int ram_write_chunk(struct yaffs_dev *dev, int nand_chunk,
+			   const u8 *data, int data_len,
+			   const u8 *oob, int oob_len)
+{
+	u8 *d = nand.data + (size_t) nand_chunk * nand.page_size;
+	u8 *o = nand.oob + (size_t) nand_chunk * nand.oob_size;
+	int i;
+
+	/* Programming can only clear bits */
+	for (i = 0; data && i < data_len; i++)
+		d[i] &= data[i];
+	for (i = 0; oob && i < oob_len; i++)
+		o[i] &= oob[i];
+
+	nand.stats.programs++;
+	return YAFFS_OK;
+}
+
+static int ram_read_chunk(struct yaffs_dev *dev, int nand_chunk,
+			  u8 *data, int data_len,
+			  u8 *oob, int oob_len,
+			  enum yaffs_ecc_result *ecc_result)
+{
+	if (data)
+		memcpy(data, nand.data + (size_t) nand_chunk * nand.page_size,
+		       data_len);
+	if (oob)
+		memcpy(oob, nand.oob + (size_t) nand_chunk * nand.oob_size,
+		       oob_len);
+	if (ecc_result)
+		*ecc_result = YAFFS_ECC_RESULT_NO_ERROR;
+
+	nand.stats.reads++;
+	nand.stats.read_ops++;
+	return YAFFS_OK;
+}
+
+static int ram_read_oob(struct yaffs_dev *dev, int nand_chunk, int n_chunks,
+			u8 *oob, int oob_len)
+{
+	int i;
+
+	for (i = 0; i < n_chunks; i++)
+		memcpy(oob + i * oob_len,
+		       nand.oob + (size_t) (nand_chunk + i) * nand.oob_size,
+		       oob_len);
+
+	nand.stats.reads += n_chunks;
+	nand.stats.read_ops++;
+	return YAFFS_OK;
+}
+
+static int ram_erase(struct yaffs_dev *dev, int block_no)
+{
+	size_t pages = nand.pages_per_block;
+
+	if (block_no < 0 || block_no >= nand.n_blocks)
+		return YAFFS_FAIL;
+
+	memset(nand.data + block_no * pages * nand.page_size, 0xff,
+	       pages * nand.page_size);
+	memset(nand.oob + block_no * pages * nand.oob_size, 0xff,
+	       pages * nand.oob_size);
+
+	nand.stats.erases++;
+	return YAFFS_OK;
+}
+
+static int ram_mark_bad(struct yaffs_dev *dev, int block_no)
+{
+	nand.bad[block_no] = 1;
+	return YAFFS_OK;
+}
+
+static int ram_check_bad(struct yaffs_dev *dev, int block_no)
+{
+	return nand.bad[block_no] ? YAFFS_FAIL : YAFFS_OK;
+}
+
+static int ram_init(struct yaffs_dev *dev)
+{
+	return YAFFS_OK;
+}
+
+static void nand_alloc(void)
+{
+	size_t pages = (size_t) nand.n_blocks * nand.pages_per_block;
+
+	nand.data = malloc(pages * nand.page_size);
+	nand.oob = malloc(pages * nand.oob_size);
+	nand.bad = calloc(nand.n_blocks, 1);
+	if (!nand.data || !nand.oob || !nand.bad) {
+		fprintf(stderr, "Cannot allocate %zu MiB of NAND\n",
+			(pages * nand.page_size) >> 20);
+		exit(1);
+	}
+	memset(nand.data, 0xff, pages * nand.page_size);
+	memset(nand.oob, 0xff, pages * nand.oob_size);
+}
+
+/* Mounting */
+
+static void print_stats(const char *what, double ms,
+			const struct nand_stats *before)
+{
+	struct nand_stats d = {
+		.reads = nand.stats.reads - before->reads,
+		.read_ops = nand.stats.read_ops - before->read_ops,
+		.programs = nand.stats.programs - before->programs,
+		.erases = nand.stats.erases - before->erases,
+	};
+	double flash_ms = (d.reads * NAND_READ_US +
+			   d.programs * NAND_PROG_US +
+			   d.erases * NAND_ERASE_US) / 1000.0;
+
+	printf("%-12s %9.2f ms cpu %9.2f ms flash  reads %llu (%llu ops) programs %llu erases %llu\n",
+	       what, ms, flash_ms, d.reads, d.read_ops, d.programs, d.erases);
+}
+
+static void do_mount(int skip_checkpoint)
+{
+	struct yaffs_param *param = &dev.param;
+	struct nand_stats before = nand.stats;
+	double t;
+
+	if (mounted)
+		fail("already mounted");
+
+	memset(&dev, 0, sizeof(dev));
+	param->name = "ram";
+	param->total_bytes_per_chunk = nand.page_size;
+	param->spare_bytes_per_chunk = nand.oob_size;
+	param->chunks_per_block = nand.pages_per_block;
+	param->start_block = 0;
+	param->end_block = nand.n_blocks - 1;
+	param->n_reserved_blocks = 5;
+	param->n_caches = n_caches;
+	param->disable_summary = no_summary;
+	param->is_yaffs2 = 1;
+	param->use_nand_ecc = 1;
+	param->enable_xattr = 1;
+	param->refresh_period = 500;
+	param->skip_checkpt_rd = skip_checkpoint;
+
+	dev.drv.drv_write_chunk_fn = ram_write_chunk;
+	dev.drv.drv_read_chunk_fn = ram_read_chunk;
+	if (!no_multi_read)
+		dev.drv.drv_read_oob_fn = ram_read_oob;
+	dev.drv.drv_erase_fn = ram_erase;
+	dev.drv.drv_mark_bad_fn = ram_mark_bad;
+	dev.drv.drv_check_bad_fn = ram_check_bad;
+	dev.drv.drv_initialise_fn = ram_init;
+	dev.drv.drv_deinitialise_fn = ram_init;
+
+	t = now_ms();
+	if (yaffs_guts_initialise(&dev) != YAFFS_OK)
+		fail("mount failed");
+	t = now_ms() - t;
+
+	mounted = 1;
+	print_stats(dev.is_checkpointed ? "mount (cp)" : "mount (scan)",
+		    t, &before);
+}
+
+static void do_sync(void)
+{
+	yaffs_flush_whole_cache(&dev, 0);
+	yaffs_update_dirty_dirs(&dev);
+}
+
+static void do_checkpoint(void)
+{
+	struct nand_stats before = nand.stats;
+	double t;
+
+	t = now_ms();
+	yaffs_checkpoint_save(&dev);
+	t = now_ms() - t;
+	print_stats("checkpoint", t, &before);
+}
+
+static void do_umount(int clean)
+{
+	if (!mounted)
+		fail("not mounted");
+
+	if (clean) {
+		do_sync();
+		do_checkpoint();
+	}
+
+	yaffs_deinitialise(&dev);
+	mounted = 0;
+}
+
+/* Object lookup */
+
+static struct yaffs_obj *lookup(const char *path, int parent, char **leaf)
+{
+	char buf[1024];
+	char *p, *s;
+	struct yaffs_obj *obj = yaffs_root(&dev);
+
+	if (!mounted)
+		fail("not mounted");
+
+	snprintf(buf, sizeof(buf), "%s", path);
+	p = buf;
+	while (*p == '/')
+		p++;
+
+	while (obj && (s = strsep(&p, "/"))) {
+		if (!*s)
+			continue;
+		if (parent && (!p || !*p)) {
+			*leaf = strdup(path + (s - buf));
+			return obj;
+		}
+		obj = yaffs_get_equivalent_obj(yaffs_find_by_name(obj, s));
+	}
+
+	if (parent)
+		fail("bad path %s", path);
+
+	return obj;
+}
+
+static struct yaffs_obj *lookup_file(const char *path)
+{
+	struct yaffs_obj *obj = lookup(path, 0, NULL);
+
+	if (!obj || obj->variant_type != YAFFS_OBJECT_TYPE_FILE)
+		fail("no such file %s", path);
+	return obj;
+}
+
+/* Workload commands */
+
+static void cmd_write(const char *path, long size, long chunk, int append)
+{
+	struct yaffs_obj *obj = lookup_file(path);
+	loff_t pos = append ? yaffs_get_obj_length(obj) : 0;
+	static u8 *buf;
+	static long buf_len;
+	long n;
+
+	if (chunk <= 0)
+		chunk = 4096;
+	if (chunk > buf_len) {
+		buf = realloc(buf, chunk);
+		buf_len = chunk;
+		memset(buf, 0x5a, chunk);
+	}
+
+	for (; size > 0; size -= n, pos += n) {
+		n = size < chunk ? size : chunk;
+		if (yaffs_wr_file(obj, buf, pos, n, 0) != n)
+			fail("write to %s failed", path);
+		nand.stats.host_bytes += n;
+	}
+}
+
+static void cmd_read(const char *path, long chunk)
+{
+	struct yaffs_obj *obj = lookup_file(path);
+	loff_t len = yaffs_get_obj_length(obj);
+	loff_t pos;
+	u8 *buf;
+
+	if (chunk <= 0)
+		chunk = 4096;
+	buf = malloc(chunk);
+	for (pos = 0; pos < len; pos += chunk)
+		yaffs_file_rd(obj, buf, pos, chunk);
+	free(buf);
+}
+
+static void cmd_create(const char *path, int dir)
+{
+	char *leaf;
+	struct yaffs_obj *parent = lookup(path, 1, &leaf);
+	struct yaffs_obj *obj;
+
+	if (dir)
+		obj = yaffs_create_dir(parent, leaf, S_IFDIR | 0755, 0, 0);
+	else
+		obj = yaffs_create_file(parent, leaf, S_IFREG | 0644, 0, 0);
+	if (!obj)
+		fail("cannot create %s", path);
+	free(leaf);
+}
+
+static void cmd_fill(const char *dir, long count, long size, long first)
+{
+	char path[512];
+	long i;
+
+	for (i = first; i < first + count; i++) {
+		snprintf(path, sizeof(path), "%s/file%05ld", dir, i);
+		cmd_create(path, 0);
+		if (size > 0)
+			cmd_write(path, size, 0, 0);
+	}
+}
+
+static void cmd_unlink(const char *path)
+{
+	char *leaf;
+	struct yaffs_obj *parent = lookup(path, 1, &leaf);
+
+	if (yaffs_unlinker(parent, leaf) != YAFFS_OK)
+		fail("cannot unlink %s", path);
+	free(leaf);
+}
+
+/* Append to the files made by fill in turn, like a set of log files */
+static void cmd_append_all(const char *dir, long count, long rounds,
+			   long size)
+{
+	char path[512];
+	struct nand_stats before = nand.stats;
+	double t;
+	long i, r;
+
+	t = now_ms();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < count; i++) {
+			snprintf(path, sizeof(path), "%s/file%05ld", dir, i);
+			cmd_write(path, size, 0, 1);
+		}
+	}
+	t = now_ms() - t;
+	print_stats("append-all", t, &before);
+}
+
+static void cmd_unlink_all(const char *dir, long count)
+{
+	char path[512];
+	long i;
+
+	for (i = 0; i < count; i++) {
+		snprintf(path, sizeof(path), "%s/file%05ld", dir, i);
+		cmd_unlink(path);
+	}
+}
+
+static void cmd_rename(const char *from, const char *to)
+{
+	char *old_leaf, *new_leaf;
+	struct yaffs_obj *old_dir = lookup(from, 1, &old_leaf);
+	struct yaffs_obj *new_dir = lookup(to, 1, &new_leaf);
+
+	if (yaffs_rename_obj(old_dir, old_leaf, new_dir, new_leaf) != YAFFS_OK)
+		fail("cannot rename %s to %s", from, to);
+	free(old_leaf);
+	free(new_leaf);
+}
+
+static void cmd_lookup(const char *dir, long count, long n_files)
+{
+	char path[512];
+	struct nand_stats before = nand.stats;
+	double t;
+	long i;
+
+	if (n_files <= 0)
+		fail("lookup needs the number of files");
+
+	t = now_ms();
+	for (i = 0; i < count; i++) {
+		snprintf(path, sizeof(path), "%s/file%05ld", dir,
+			 (i * 7919) % n_files);
+		if (!lookup(path, 0, NULL))
+			fail("lookup of %s failed", path);
+	}
+	t = now_ms() - t;
+	print_stats("lookup", t, &before);
+}
+
+static void cmd_stats(void)
+{
+	struct nand_stats *s = &nand.stats;
+	double wa = s->host_bytes ?
+		(double) s->programs * nand.page_size / s->host_bytes : 0;
+
+	printf("total        reads %llu (%llu ops) programs %llu erases %llu\n",
+	       s->reads, s->read_ops, s->programs, s->erases);
+	printf("             host bytes %llu write amplification %.2f\n",
+	       s->host_bytes, wa);
+	if (mounted)
+		printf("             free chunks %d gc blocks %u gc copies %u\n",
+		       yaffs_get_n_free_chunks(&dev),
+		       dev.n_gc_blocks, dev.n_gc_copies);
+	if (mounted)
+		printf("             cache hits %u misses %u\n",
+		       dev.cache_hits, dev.cache_misses);
+}
+
+static void run_line(char *line)
+{
+	char *argv[8];
+	int argc = 0;
+	char *s;
+
+	while (argc < 8 && (s = strsep(&line, " \t\n"))) {
+		if (*s)
+			argv[argc++] = s;
+	}
+	if (!argc || argv[0][0] == '#')
+		return;
+
+#define ARG(n)	(argc > (n) ? argv[n] : NULL)
+#define NUM(n)	(argc > (n) ? strtol(argv[n], NULL, 0) : 0)
+
+	if (verbose)
+		fprintf(stderr, "> %s\n", argv[0]);
+
+	if (!strcmp(argv[0], "mount"))
+		do_mount(0);
+	else if (!strcmp(argv[0], "mount-scan"))
+		do_mount(1);
+	else if (!strcmp(argv[0], "umount"))
+		do_umount(1);
+	else if (!strcmp(argv[0], "crash"))
+		do_umount(0);
+	else if (!strcmp(argv[0], "sync"))
+		do_sync();
+	else if (!strcmp(argv[0], "checkpoint"))
+		do_checkpoint();
+	else if (!strcmp(argv[0], "mkdir") && ARG(1))
+		cmd_create(ARG(1), 1);
+	else if (!strcmp(argv[0], "create") && ARG(1))
+		cmd_create(ARG(1), 0);
+	else if (!strcmp(argv[0], "write") && ARG(2))
+		cmd_write(ARG(1), NUM(2), NUM(3), 0);
+	else if (!strcmp(argv[0], "append") && ARG(2))
+		cmd_write(ARG(1), NUM(2), NUM(3), 1);
+	else if (!strcmp(argv[0], "read") && ARG(1))
+		cmd_read(ARG(1), NUM(2));
+	else if (!strcmp(argv[0], "fill") && ARG(2))
+		cmd_fill(ARG(1), NUM(2), NUM(3), NUM(4));
+	else if (!strcmp(argv[0], "append-all") && ARG(4))
+		cmd_append_all(ARG(1), NUM(2), NUM(3), NUM(4));
+	else if (!strcmp(argv[0], "unlink") && ARG(1))
+		cmd_unlink(ARG(1));
+	else if (!strcmp(argv[0], "unlink-all") && ARG(2))
+		cmd_unlink_all(ARG(1), NUM(2));
+	else if (!strcmp(argv[0], "rename") && ARG(2))
+		cmd_rename(ARG(1), ARG(2));
+	else if (!strcmp(argv[0], "lookup") && ARG(3))
+		cmd_lookup(ARG(1), NUM(2), NUM(3));
+	else if (!strcmp(argv[0], "summaries") && ARG(1))
+		no_summary = dev.param.disable_summary = !strcmp(ARG(1), "off");
+	else if (!strcmp(argv[0], "stats"))
+		cmd_stats();
+	else
+		fail("bad command %s", argv[0]);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-b blocks] [-p page size] [-o oob size] [-c pages per block] [-n caches] [-s] [-m] [-v] [script]\n"
+		"  -s  do not write block summaries\n"
+		"  -m  read the oob of one page at a time\n"
+		"\n"
+		"Script commands, one per line:\n"
+		"  mount | mount-scan        mount, mount-scan ignores the checkpoint\n"
+		"  umount | crash            unmount cleanly, or drop everything\n"
+		"  sync | checkpoint         flush caches, write a checkpoint\n"
+		"  mkdir <path> | create <path>\n"
+		"  write <file> <bytes> [chunk] | append <file> <bytes> [chunk]\n"
+		"  read <file> [chunk]\n"
+		"  fill <dir> <count> [bytes] [first]\n"
+		"                            create <dir>/fileNNNNN, from first on\n"
+		"  lookup <dir> <count> <files>  look up files made by fill\n"
+		"  append-all <dir> <files> <rounds> <bytes>\n"
+		"                            append to the files made by fill in turn\n"
+		"  unlink <path> | unlink-all <dir> <files> | rename <from> <to>\n"
+		"  summaries on|off          write block summaries or not\n"
+		"  stats\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	char line[1024];
+	FILE *f = stdin;
+	int opt;
+
+	nand.page_size = 2048;
+	nand.oob_size = 64;
+	nand.pages_per_block = 64;
+	nand.n_blocks = 1024;
+
+	while ((opt = getopt(argc, argv, "b:p:o:c:n:smv")) != -1) {
+		switch (opt) {
+		case 'b':
+			nand.n_blocks = atoi(optarg);
+			break;
+		case 'p':
+			nand.page_size = atoi(optarg);
+			break;
+		case 'o':
+			nand.oob_size = atoi(optarg);
+			break;
+		case 'c':
+			nand.pages_per_block = atoi(optarg);
+			break;
+		case 'n':
+			n_caches = atoi(optarg);
+			break;
+		case 's':
+			no_summary = 1;
+			break;
+		case 'm':
+			no_multi_read = 1;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind < argc && !(f = fopen(argv[optind], "r"))) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	nand_alloc();
+
+	while (fgets(line, sizeof(line), f)) {
+		line_no++;
+		run_line(line);
+	}
+
+	if (mounted)
+		do_umount(1);
+
+	return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * Userspace replacement for yportenv.h, force-included when building the
+ * yaffs2 core for the RAM NAND simulator.
+ */
+
+#ifndef __YPORTENV_H__
+#define __YPORTENV_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <dirent.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int32_t s32;
+typedef int64_t s64;
+
+#define KERNEL_VERSION(a, b, c) (((a) << 16) + ((b) << 8) + (c))
+#define LINUX_VERSION_CODE KERNEL_VERSION(3, 18, 0)
+#define MTD_VERSION(a, b, c) KERNEL_VERSION(a, b, c)
+#define MTD_VERSION_CODE LINUX_VERSION_CODE
+
+#define YCHAR char
+#define YUCHAR unsigned char
+#define _Y(x)     x
+
+#define YAFFS_LOSTNFOUND_NAME		"lost+found"
+#define YAFFS_LOSTNFOUND_PREFIX		"obj"
+
+#define YAFFS_ROOT_MODE			0755
+#define YAFFS_LOSTNFOUND_MODE		0700
+
+#define Y_CURRENT_TIME ((u32) time(NULL))
+#define Y_TIME_CONVERT(x) (x)
+
+#define compile_time_assertion(assertion) \
+	({ int x = __builtin_choose_expr(assertion, 0, (void)0); (void) x; })
+
+#define yaffs_printf(msk, fmt, ...) \
+	fprintf(stderr, "yaffs: " fmt "\n", ##__VA_ARGS__)
+
+#define yaffs_trace(msk, fmt, ...) do { \
+	if (yaffs_trace_mask & (msk)) \
+		fprintf(stderr, "yaffs: " fmt "\n", ##__VA_ARGS__); \
+} while (0)
+
+#define printk(fmt, ...) fprintf(stderr, fmt, ##__VA_ARGS__)
+#define KERN_DEBUG ""
+#define KERN_INFO ""
+#define KERN_WARNING ""
+#define KERN_ERR ""
+
+#define BUG() do { \
+	fprintf(stderr, "yaffs bug at %s:%d\n", __FILE__, __LINE__); \
+	abort(); \
+} while (0)
+
+#define GFP_NOFS 0
+#define kmalloc(size, flags) malloc(size)
+#define kfree(p) free(p)
+#define vmalloc(size) malloc(size)
+#define vfree(p) free(p)
+
+#define cond_resched() do { } while (0)
+
+#define likely(x) (x)
+#define unlikely(x) (x)
+
+static inline int hweight8(u8 x)
+{
+	return __builtin_popcount(x);
+}
+
+static inline int hweight32(u32 x)
+{
+	return __builtin_popcount(x);
+}
+
+static inline void sort(void *base, size_t num, size_t size,
+			int (*cmp)(const void *, const void *),
+			void (*swap)(void *, void *, int))
+{
+	qsort(base, num, size, cmp);
+}
+
+/* Doubly linked lists, as in <linux/list.h> */
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+#define LIST_HEAD_INIT(name) { &(name), &(name) }
+#define LIST_HEAD(name) struct list_head name = LIST_HEAD_INIT(name)
+
+static inline void INIT_LIST_HEAD(struct list_head *list)
+{
+	list->next = list;
+	list->prev = list;
+}
+
+static inline void __list_add(struct list_head *new, struct list_head *prev,
+			      struct list_head *next)
+{
+	next->prev = new;
+	new->next = next;
+	new->prev = prev;
+	prev->next = new;
+}
+
+static inline void list_add(struct list_head *new, struct list_head *head)
+{
+	__list_add(new, head, head->next);
+}
+
+static inline void list_add_tail(struct list_head *new,
+				 struct list_head *head)
+{
+	__list_add(new, head->prev, head);
+}
+
+static inline void list_del(struct list_head *entry)
+{
+	entry->next->prev = entry->prev;
+	entry->prev->next = entry->next;
+}
+
+static inline void list_del_init(struct list_head *entry)
+{
+	list_del(entry);
+	INIT_LIST_HEAD(entry);
+}
+
+static inline void list_move(struct list_head *list, struct list_head *head)
+{
+	list_del(list);
+	list_add(list, head);
+}
+
+static inline void list_move_tail(struct list_head *list,
+				  struct list_head *head)
+{
+	list_del(list);
+	list_add_tail(list, head);
+}
+
+static inline int list_empty(const struct list_head *head)
+{
+	return head->next == head;
+}
+
+#define list_entry(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define list_for_each(pos, head) \
+	for (pos = (head)->next; pos != (head); pos = pos->next)
+
+#define list_for_each_safe(pos, n, head) \
+	for (pos = (head)->next, n = pos->next; pos != (head); \
+		pos = n, n = pos->next)
+
+/* Attributes, as in <linux/fs.h> */
+#define ATTR_MODE	(1 << 0)
+#define ATTR_UID	(1 << 1)
+#define ATTR_GID	(1 << 2)
+#define ATTR_SIZE	(1 << 3)
+#define ATTR_ATIME	(1 << 4)
+#define ATTR_MTIME	(1 << 5)
+#define ATTR_CTIME	(1 << 6)
+
+struct iattr {
+	unsigned int ia_valid;
+	unsigned ia_mode;
+	struct { unsigned val; } ia_uid;
+	struct { unsigned val; } ia_gid;
+	loff_t ia_size;
+	unsigned ia_atime;
+	unsigned ia_mtime;
+	unsigned ia_ctime;
+};
+
+#define XATTR_CREATE	0x1
+#define XATTR_REPLACE	0x2
+
+#endif
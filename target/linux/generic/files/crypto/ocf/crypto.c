@@ -143,28 +143,21 @@ struct cryptocap {
 	int		cc_qblocked;		/* (q) symmetric q blocked */
 	int		cc_kqblocked;		/* (q) asymmetric q blocked */
 
-	int		cc_unqblocked;		/* (q) symmetric q blocked */
-	int		cc_unkqblocked;		/* (q) asymmetric q blocked */
+	int		cc_unblocks;		/* (q) symmetric q unblock count */
 };
 static struct cryptocap *crypto_drivers = NULL;
 static int crypto_drivers_num = 0;
 
 /*
- * There are two queues for crypto requests; one for symmetric (e.g.
- * cipher) operations and one for asymmetric (e.g. MOD)operations.
- * A single mutex is used to lock access to both queues.  We could
- * have one per-queue but having one simplifies handling of block/unblock
- * operations.
+ * Symmetric (e.g. cipher) requests are queued per CPU, see struct
+ * crypto_cpu_q below.  Asymmetric (e.g. MOD) operations are rare and
+ * use a single queue.  CRYPTO_Q_LOCK() protects that queue and the
+ * block/unblock state of the drivers.
  */
-static LIST_HEAD(crp_q);		/* crypto request queue */
 static LIST_HEAD(crp_kq);		/* asym request queue */
 
 static spinlock_t crypto_q_lock;
 
-int crypto_all_qblocked = 0;  /* protect with Q_LOCK */
-module_param(crypto_all_qblocked, int, 0444);
-MODULE_PARM_DESC(crypto_all_qblocked, "Are all crypto queues blocked");
-
 int crypto_all_kqblocked = 0; /* protect with Q_LOCK */
 module_param(crypto_all_kqblocked, int, 0444);
 MODULE_PARM_DESC(crypto_all_kqblocked, "Are all asym crypto queues blocked");
@@ -181,15 +174,12 @@ MODULE_PARM_DESC(crypto_all_kqblocked, "Are all asym crypto queues blocked");
 			 })
 
 /*
- * There are two queues for processing completed crypto requests; one
- * for the symmetric and one for the asymmetric ops.  We only need one
- * but have two to avoid type futzing (cryptop vs. cryptkop).  A single
- * mutex is used to lock access to both queues.  Note that this lock
- * must be separate from the lock on request queues to insure driver
- * callbacks don't generate lock order reversals.
+ * Completed symmetric requests go to a per CPU return queue as well,
+ * completed asymmetric ops to the single crp_ret_kq.  Note that the
+ * return queue locks must be separate from the locks on the request
+ * queues to insure driver callbacks don't generate lock order reversals.
  */
-static LIST_HEAD(crp_ret_q);		/* callback queues */
-static LIST_HEAD(crp_ret_kq);
+static LIST_HEAD(crp_ret_kq);		/* asym callback queue */
 
 static spinlock_t crypto_ret_q_lock;
 #define	CRYPTO_RETQ_LOCK() \
@@ -202,7 +192,6 @@ static spinlock_t crypto_ret_q_lock;
 			 	dprintk("%s,%d: RETQ_UNLOCK\n", __FILE__, __LINE__); \
 				spin_unlock_irqrestore(&crypto_ret_q_lock, r_flags); \
 			 })
-#define	CRYPTO_RETQ_EMPTY()	(list_empty(&crp_ret_q) && list_empty(&crp_ret_kq))
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,20)
 static kmem_cache_t *cryptop_zone;
@@ -229,8 +218,8 @@ EXPORT_SYMBOL(crypto_debug);
  * slow,  printing anything will just kill us
  */
 
-static int crypto_q_cnt = 0;
-module_param(crypto_q_cnt, int, 0444);
+static atomic_t crypto_q_cnt = ATOMIC_INIT(0);
+module_param_named(crypto_q_cnt, crypto_q_cnt.counter, int, 0444);
 MODULE_PARM_DESC(crypto_q_cnt,
 		"Current number of outstanding crypto requests");
 
@@ -272,14 +261,52 @@ module_param(crypto_max_loopcount, int, 0644);
 MODULE_PARM_DESC(crypto_max_loopcount,
 	   "Maximum number of crypto ops to do before yielding to other processes");
 
+/*
+ * Maximum number of requests the crypto thread takes off its queue at
+ * once.  They are handed to the drivers back to back, with
+ * CRYPTO_HINT_MORE set while the next one is for the same driver.
+ */
+static int crypto_batch_max = 16;
+module_param(crypto_batch_max, int, 0644);
+MODULE_PARM_DESC(crypto_batch_max,
+	   "Maximum number of crypto ops to take off the queue at once");
+
 #ifndef CONFIG_NR_CPUS
 #define CONFIG_NR_CPUS 1
 #endif
 
+/*
+ * Symmetric requests are queued on the CPU they were dispatched on and
+ * processed by the crypto thread bound to that CPU, so submitters on
+ * different CPUs do not contend for a single queue lock.  Completed
+ * requests are handed to the return thread of the CPU they completed on.
+ */
+struct crypto_cpu_q {
+	spinlock_t		lock;
+	struct list_head	q;		/* (l) crypto request queue */
+	int			qblocked;	/* (l) all of q is blocked */
+	wait_queue_head_t	wait;
+
+	spinlock_t		ret_lock;
+	struct list_head	ret_q;		/* (r) callback queue */
+	wait_queue_head_t	ret_wait;
+} ____cacheline_aligned_in_smp;
+
+static struct crypto_cpu_q crypto_cpu_q[CONFIG_NR_CPUS];
+
+static inline struct crypto_cpu_q *
+crypto_this_q(void)
+{
+#if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,4) || !defined(CONFIG_SMP)
+	return &crypto_cpu_q[0];
+#else
+	/* any queue will do if we are migrated after this */
+	return &crypto_cpu_q[raw_smp_processor_id()];
+#endif
+}
+
 static struct task_struct *cryptoproc[CONFIG_NR_CPUS];
 static struct task_struct *cryptoretproc[CONFIG_NR_CPUS];
-static DECLARE_WAIT_QUEUE_HEAD(cryptoproc_wait);
-static DECLARE_WAIT_QUEUE_HEAD(cryptoretproc_wait);
 
 static	int crypto_proc(void *arg);
 static	int crypto_ret_proc(void *arg);
@@ -774,27 +801,52 @@ crypto_unblock(u_int32_t driverid, int what)
 	struct cryptocap *cap;
 	int err;
 	unsigned long q_flags;
+	int cpu;
 
 	CRYPTO_Q_LOCK();
 	cap = crypto_checkdriver(driverid);
 	if (cap != NULL) {
 		if (what & CRYPTO_SYMQ) {
 			cap->cc_qblocked = 0;
-			cap->cc_unqblocked = 0;
-			crypto_all_qblocked = 0;
+			cap->cc_unblocks++;
 		}
 		if (what & CRYPTO_ASYMQ) {
 			cap->cc_kqblocked = 0;
-			cap->cc_unkqblocked = 0;
 			crypto_all_kqblocked = 0;
 		}
-		wake_up_interruptible(&cryptoproc_wait);
 		err = 0;
 	} else
 		err = EINVAL;
 	CRYPTO_Q_UNLOCK(); //DAVIDM should this be a driver lock
 
-	return err;
+	if (err)
+		return err;
+
+	/* requests for this driver may be waiting on any CPU */
+	ocf_for_each_cpu(cpu) {
+		struct crypto_cpu_q *q = &crypto_cpu_q[cpu];
+
+		spin_lock_irqsave(&q->lock, q_flags);
+		q->qblocked = 0;
+		wake_up_interruptible(&q->wait);
+		spin_unlock_irqrestore(&q->lock, q_flags);
+	}
+	return 0;
+}
+
+/*
+ * Mark a driver blocked for cryptop's after it returned ERESTART, unless
+ * it was unblocked since we read cc_unblocks (before invoking it).
+ */
+static void
+crypto_block(struct cryptocap *cap, int unblocks)
+{
+	unsigned long q_flags;
+
+	CRYPTO_Q_LOCK();
+	if (cap->cc_unblocks == unblocks)
+		cap->cc_qblocked = 1;
+	CRYPTO_Q_UNLOCK();
 }
 
 /*
@@ -803,21 +855,21 @@ crypto_unblock(u_int32_t driverid, int what)
 int
 crypto_dispatch(struct cryptop *crp)
 {
+	struct crypto_cpu_q *q;
 	struct cryptocap *cap;
 	int result = -1;
 	unsigned long q_flags;
+	int wake;
 
 	dprintk("%s()\n", __FUNCTION__);
 
 	cryptostats.cs_ops++;
 
-	CRYPTO_Q_LOCK();
-	if (crypto_q_cnt >= crypto_q_max) {
+	if (atomic_inc_return(&crypto_q_cnt) > crypto_q_max) {
+		atomic_dec(&crypto_q_cnt);
 		cryptostats.cs_drops++;
-		CRYPTO_Q_UNLOCK();
 		return ENOMEM;
 	}
-	crypto_q_cnt++;
 
 	/* make sure we are starting a fresh run on this crp. */
 	crp->crp_flags &= ~CRYPTO_F_DONE;
@@ -833,17 +885,23 @@ crypto_dispatch(struct cryptop *crp)
 		/* Driver cannot disappear when there is an active session. */
 		KASSERT(cap != NULL, ("%s: Driver disappeared.", __func__));
 		if (!cap->cc_qblocked) {
-			crypto_all_qblocked = 0;
-			crypto_drivers[hid].cc_unqblocked = 1;
-			CRYPTO_Q_UNLOCK();
+			int unblocks = cap->cc_unblocks;
+
 			result = crypto_invoke(cap, crp, 0);
-			CRYPTO_Q_LOCK();
 			if (result == ERESTART)
-				if (crypto_drivers[hid].cc_unqblocked)
-					crypto_drivers[hid].cc_qblocked = 1;
-			crypto_drivers[hid].cc_unqblocked = 0;
+				crypto_block(cap, unblocks);
 		}
 	}
+	if (result != ERESTART && result != -1)
+		return result;
+
+	q = crypto_this_q();
+	spin_lock_irqsave(&q->lock, q_flags);
+	/*
+	 * The crypto thread only needs waking if it may be sleeping, i.e.
+	 * if it had nothing it could process.
+	 */
+	wake = list_empty(&q->q) || q->qblocked;
 	if (result == ERESTART) {
 		/*
 		 * The driver ran out of resources, mark the
@@ -854,16 +912,15 @@ crypto_dispatch(struct cryptop *crp)
 		 * at the front.  This should be ok; putting
 		 * it at the end does not work.
 		 */
-		list_add(&crp->crp_next, &crp_q);
+		list_add(&crp->crp_next, &q->q);
 		cryptostats.cs_blocks++;
-		result = 0;
-	} else if (result == -1) {
-		TAILQ_INSERT_TAIL(&crp_q, crp, crp_next);
-		result = 0;
-	}
-	wake_up_interruptible(&cryptoproc_wait);
-	CRYPTO_Q_UNLOCK();
-	return result;
+	} else
+		list_add_tail(&crp->crp_next, &q->q);
+	q->qblocked = 0;
+	if (wake)
+		wake_up_interruptible(&q->wait);
+	spin_unlock_irqrestore(&q->lock, q_flags);
+	return 0;
 }
 
 /*
@@ -882,8 +939,8 @@ crypto_kdispatch(struct cryptkop *krp)
 	if (error == ERESTART) {
 		CRYPTO_Q_LOCK();
 		TAILQ_INSERT_TAIL(&crp_kq, krp, krp_next);
-		wake_up_interruptible(&cryptoproc_wait);
 		CRYPTO_Q_UNLOCK();
+		wake_up_interruptible(&crypto_this_q()->wait);
 		error = 0;
 	}
 	return error;
@@ -1086,21 +1143,26 @@ crypto_freereq(struct cryptop *crp)
 	{
 		struct cryptop *crp2;
 		unsigned long q_flags;
+		int cpu;
 
-		CRYPTO_Q_LOCK();
-		TAILQ_FOREACH(crp2, &crp_q, crp_next) {
-			KASSERT(crp2 != crp,
-			    ("Freeing cryptop from the crypto queue (%p).",
-			    crp));
-		}
-		CRYPTO_Q_UNLOCK();
-		CRYPTO_RETQ_LOCK();
-		TAILQ_FOREACH(crp2, &crp_ret_q, crp_next) {
-			KASSERT(crp2 != crp,
-			    ("Freeing cryptop from the return queue (%p).",
-			    crp));
+		ocf_for_each_cpu(cpu) {
+			struct crypto_cpu_q *q = &crypto_cpu_q[cpu];
+
+			spin_lock_irqsave(&q->lock, q_flags);
+			TAILQ_FOREACH(crp2, &q->q, crp_next) {
+				KASSERT(crp2 != crp,
+				    ("Freeing cryptop from the crypto queue (%p).",
+				    crp));
+			}
+			spin_unlock_irqrestore(&q->lock, q_flags);
+			spin_lock_irqsave(&q->ret_lock, q_flags);
+			TAILQ_FOREACH(crp2, &q->ret_q, crp_next) {
+				KASSERT(crp2 != crp,
+				    ("Freeing cryptop from the return queue (%p).",
+				    crp));
+			}
+			spin_unlock_irqrestore(&q->ret_lock, q_flags);
 		}
-		CRYPTO_RETQ_UNLOCK();
 	}
 #endif
 
@@ -1145,14 +1207,10 @@ crypto_getreq(int num)
 void
 crypto_done(struct cryptop *crp)
 {
-	unsigned long q_flags;
-
 	dprintk("%s()\n", __FUNCTION__);
 	if ((crp->crp_flags & CRYPTO_F_DONE) == 0) {
 		crp->crp_flags |= CRYPTO_F_DONE;
-		CRYPTO_Q_LOCK();
-		crypto_q_cnt--;
-		CRYPTO_Q_UNLOCK();
+		atomic_dec(&crypto_q_cnt);
 	} else
 		printk("crypto: crypto_done op already done, flags 0x%x",
 				crp->crp_flags);
@@ -1175,14 +1233,21 @@ crypto_done(struct cryptop *crp)
 		 */
 		crp->crp_callback(crp);
 	} else {
+		struct crypto_cpu_q *q = crypto_this_q();
 		unsigned long r_flags;
+		int wake;
+
 		/*
-		 * Normal case; queue the callback for the thread.
+		 * Normal case; queue the callback for the thread.  It is
+		 * only woken for the first one, it takes everything that
+		 * is queued by then in one go.
 		 */
-		CRYPTO_RETQ_LOCK();
-		wake_up_interruptible(&cryptoretproc_wait);/* shared wait channel */
-		TAILQ_INSERT_TAIL(&crp_ret_q, crp, crp_next);
-		CRYPTO_RETQ_UNLOCK();
+		spin_lock_irqsave(&q->ret_lock, r_flags);
+		wake = list_empty(&q->ret_q);
+		TAILQ_INSERT_TAIL(&q->ret_q, crp, crp_next);
+		if (wake)
+			wake_up_interruptible(&q->ret_wait);
+		spin_unlock_irqrestore(&q->ret_lock, r_flags);
 	}
 }
 
@@ -1230,9 +1295,9 @@ crypto_kdone(struct cryptkop *krp)
 		 * Normal case; queue the callback for the thread.
 		 */
 		CRYPTO_RETQ_LOCK();
-		wake_up_interruptible(&cryptoretproc_wait);/* shared wait channel */
 		TAILQ_INSERT_TAIL(&crp_ret_kq, krp, krp_next);
 		CRYPTO_RETQ_UNLOCK();
+		wake_up_interruptible(&crypto_this_q()->ret_wait);
 	}
 }
 
@@ -1260,39 +1325,34 @@ crypto_getfeat(int *featp)
 }
 
 /*
- * Crypto thread, dispatches crypto requests.
+ * Crypto thread, dispatches crypto requests queued on its CPU.
  */
 static int
 crypto_proc(void *arg)
 {
-	struct cryptop *crp, *submit;
+	struct crypto_cpu_q *q = &crypto_cpu_q[(unsigned long) arg];
+	struct cryptop *crp, *next;
 	struct cryptkop *krp, *krpp;
 	struct cryptocap *cap;
+	LIST_HEAD(batch);
 	u_int32_t hid;
-	int result, hint;
+	int result, hint, unblocks, n;
 	unsigned long q_flags;
 	int loopcount = 0;
 
 	set_current_state(TASK_INTERRUPTIBLE);
 
-	CRYPTO_Q_LOCK();
 	for (;;) {
 		/*
-		 * we need to make sure we don't get into a busy loop with nothing
-		 * to do,  the two crypto_all_*blocked vars help us find out when
-		 * we are all full and can do nothing on any driver or Q.  If so we
-		 * wait for an unblock.
+		 * Take the requests that can be processed now off the queue,
+		 * so the queue lock is taken once per batch rather than once
+		 * per request.  Requests for blocked drivers stay where they
+		 * are.  If all of them are blocked we need to wait for an
+		 * unblock, qblocked keeps us from busy looping until then.
 		 */
-		crypto_all_qblocked  = !list_empty(&crp_q);
-
-		/*
-		 * Find the first element in the queue that can be
-		 * processed and look-ahead to see if multiple ops
-		 * are ready for the same driver.
-		 */
-		submit = NULL;
-		hint = 0;
-		list_for_each_entry(crp, &crp_q, crp_next) {
+		n = 0;
+		spin_lock_irqsave(&q->lock, q_flags);
+		list_for_each_entry_safe(crp, next, &q->q, crp_next) {
 			hid = CRYPTO_SESID2HID(crp->crp_sid);
 			cap = crypto_checkdriver(hid);
 			/*
@@ -1301,114 +1361,109 @@ crypto_proc(void *arg)
 			 */
 			KASSERT(cap != NULL, ("%s:%u Driver disappeared.",
 			    __func__, __LINE__));
-			if (cap == NULL || cap->cc_dev == NULL) {
-				/* Op needs to be migrated, process it. */
-				if (submit == NULL)
-					submit = crp;
+			/* Ops that need to be migrated are processed too. */
+			if (cap != NULL && cap->cc_dev != NULL && cap->cc_qblocked)
+				continue;
+			list_move_tail(&crp->crp_next, &batch);
+			if (++n >= crypto_batch_max)
 				break;
-			}
-			if (!cap->cc_qblocked) {
-				if (submit != NULL) {
-					/*
-					 * We stop on finding another op,
-					 * regardless whether its for the same
-					 * driver or not.  We could keep
-					 * searching the queue but it might be
-					 * better to just use a per-driver
-					 * queue instead.
-					 */
-					if (CRYPTO_SESID2HID(submit->crp_sid) == hid)
-						hint = CRYPTO_HINT_MORE;
-					break;
-				} else {
-					submit = crp;
-					if ((submit->crp_flags & CRYPTO_F_BATCH) == 0)
-						break;
-					/* keep scanning for more are q'd */
-				}
-			}
 		}
-		if (submit != NULL) {
-			hid = CRYPTO_SESID2HID(submit->crp_sid);
-			crypto_all_qblocked = 0;
-			list_del(&submit->crp_next);
-			crypto_drivers[hid].cc_unqblocked = 1;
+		q->qblocked = n == 0 && !list_empty(&q->q);
+		spin_unlock_irqrestore(&q->lock, q_flags);
+
+		list_for_each_entry_safe(crp, next, &batch, crp_next) {
+			list_del(&crp->crp_next);
+			hid = CRYPTO_SESID2HID(crp->crp_sid);
 			cap = crypto_checkdriver(hid);
-			CRYPTO_Q_UNLOCK();
 			KASSERT(cap != NULL, ("%s:%u Driver disappeared.",
 			    __func__, __LINE__));
-			result = crypto_invoke(cap, submit, hint);
-			CRYPTO_Q_LOCK();
+			hint = 0;
+			if (!list_empty(&batch) &&
+			    CRYPTO_SESID2HID(next->crp_sid) == hid)
+				hint = CRYPTO_HINT_MORE;
+			unblocks = cap->cc_unblocks;
+			result = crypto_invoke(cap, crp, hint);
 			if (result == ERESTART) {
 				/*
 				 * The driver ran out of resources, mark the
 				 * driver ``blocked'' for cryptop's and put
-				 * the request back in the queue.  It would
-				 * best to put the request back where we got
-				 * it but that's hard so for now we put it
-				 * at the front.  This should be ok; putting
-				 * it at the end does not work.
+				 * the request and the rest of the batch back
+				 * at the front of the queue, in order.
 				 */
 				/* XXX validate sid again? */
-				list_add(&submit->crp_next, &crp_q);
+				crypto_block(cap, unblocks);
 				cryptostats.cs_blocks++;
-				if (crypto_drivers[hid].cc_unqblocked)
-					crypto_drivers[hid].cc_qblocked=0;
-				crypto_drivers[hid].cc_unqblocked=0;
+				list_add(&crp->crp_next, &batch);
+				spin_lock_irqsave(&q->lock, q_flags);
+				list_splice_init(&batch, &q->q);
+				spin_unlock_irqrestore(&q->lock, q_flags);
+				break;
 			}
-			crypto_drivers[hid].cc_unqblocked = 0;
+			loopcount++;
 		}
 
-		crypto_all_kqblocked = !list_empty(&crp_kq);
-
 		/* As above, but for key ops */
 		krp = NULL;
-		list_for_each_entry(krpp, &crp_kq, krp_next) {
-			cap = crypto_checkdriver(krpp->krp_hid);
-			if (cap == NULL || cap->cc_dev == NULL) {
+		if (!list_empty(&crp_kq)) {
+			CRYPTO_Q_LOCK();
+			crypto_all_kqblocked = !list_empty(&crp_kq);
+			list_for_each_entry(krpp, &crp_kq, krp_next) {
+				cap = crypto_checkdriver(krpp->krp_hid);
+				if (cap == NULL || cap->cc_dev == NULL) {
+					/*
+					 * Operation needs to be migrated,
+					 * invalidate the assigned device so it
+					 * will reselect a new one below.
+					 * Propagate the original crid selection
+					 * flags if supplied.
+					 */
+					krpp->krp_hid = krpp->krp_crid &
+					    (CRYPTOCAP_F_SOFTWARE|CRYPTOCAP_F_HARDWARE);
+					if (krpp->krp_hid == 0)
+						krpp->krp_hid =
+					    CRYPTOCAP_F_SOFTWARE|CRYPTOCAP_F_HARDWARE;
+					krp = krpp;
+					break;
+				}
+				if (!cap->cc_kqblocked) {
+					krp = krpp;
+					break;
+				}
+			}
+			if (krp != NULL) {
+				crypto_all_kqblocked = 0;
+				list_del(&krp->krp_next);
 				/*
-				 * Operation needs to be migrated, invalidate
-				 * the assigned device so it will reselect a
-				 * new one below.  Propagate the original
-				 * crid selection flags if supplied.
+				 * A migrated op only carries the selection
+				 * flags, there is no driver to block yet.
 				 */
-				krp->krp_hid = krp->krp_crid &
-				    (CRYPTOCAP_F_SOFTWARE|CRYPTOCAP_F_HARDWARE);
-				if (krp->krp_hid == 0)
-					krp->krp_hid =
-				    CRYPTOCAP_F_SOFTWARE|CRYPTOCAP_F_HARDWARE;
-				break;
-			}
-			if (!cap->cc_kqblocked) {
-				krp = krpp;
-				break;
+				hid = krp->krp_hid;
+				if (crypto_checkdriver(hid) != NULL)
+					crypto_drivers[hid].cc_kqblocked = 1;
+				CRYPTO_Q_UNLOCK();
+				result = crypto_kinvoke(krp, krp->krp_hid);
+				CRYPTO_Q_LOCK();
+				if (result == ERESTART) {
+					/*
+					 * The driver ran out of resources, put
+					 * the request back at the front of the
+					 * queue, the driver stays ``blocked''
+					 * for cryptkop's. For a migrated op
+					 * that is the driver just selected.
+					 */
+					/* XXX validate sid again? */
+					if (crypto_checkdriver(krp->krp_hid) != NULL)
+						crypto_drivers[krp->krp_hid].cc_kqblocked = 1;
+					list_add(&krp->krp_next, &crp_kq);
+					cryptostats.cs_kblocks++;
+				} else if (crypto_checkdriver(hid) != NULL)
+					crypto_drivers[hid].cc_kqblocked = 0;
+				loopcount++;
 			}
-		}
-		if (krp != NULL) {
-			crypto_all_kqblocked = 0;
-			list_del(&krp->krp_next);
-			crypto_drivers[krp->krp_hid].cc_kqblocked = 1;
 			CRYPTO_Q_UNLOCK();
-			result = crypto_kinvoke(krp, krp->krp_hid);
-			CRYPTO_Q_LOCK();
-			if (result == ERESTART) {
-				/*
-				 * The driver ran out of resources, mark the
-				 * driver ``blocked'' for cryptkop's and put
-				 * the request back in the queue.  It would
-				 * best to put the request back where we got
-				 * it but that's hard so for now we put it
-				 * at the front.  This should be ok; putting
-				 * it at the end does not work.
-				 */
-				/* XXX validate sid again? */
-				list_add(&krp->krp_next, &crp_kq);
-				cryptostats.cs_kblocks++;
-			} else
-				crypto_drivers[krp->krp_hid].cc_kqblocked = 0;
 		}
 
-		if (submit == NULL && krp == NULL) {
+		if (n == 0 && krp == NULL) {
 			/*
 			 * Nothing more to be processed.  Sleep until we're
 			 * woken because there are more ops to process.
@@ -1423,12 +1478,11 @@ crypto_proc(void *arg)
 			 */
 			dprintk("%s - sleeping (qe=%d qb=%d kqe=%d kqb=%d)\n",
 					__FUNCTION__,
-					list_empty(&crp_q), crypto_all_qblocked,
+					list_empty(&q->q), q->qblocked,
 					list_empty(&crp_kq), crypto_all_kqblocked);
 			loopcount = 0;
-			CRYPTO_Q_UNLOCK();
-			wait_event_interruptible(cryptoproc_wait,
-					!(list_empty(&crp_q) || crypto_all_qblocked) ||
+			wait_event_interruptible(q->wait,
+					!(list_empty(&q->q) || q->qblocked) ||
 					!(list_empty(&crp_kq) || crypto_all_kqblocked) ||
 					kthread_should_stop());
 			if (signal_pending (current)) {
@@ -1440,7 +1494,6 @@ crypto_proc(void *arg)
 				spin_unlock_irq(&current->sigmask_lock);
 #endif
 			}
-			CRYPTO_Q_LOCK();
 			dprintk("%s - awake\n", __FUNCTION__);
 			if (kthread_should_stop())
 				break;
@@ -1451,13 +1504,9 @@ crypto_proc(void *arg)
 			 * been using the CPU exclusively for a while.
 			 */
 			loopcount = 0;
-			CRYPTO_Q_UNLOCK();
 			schedule();
-			CRYPTO_Q_LOCK();
 		}
-		loopcount++;
 	}
-	CRYPTO_Q_UNLOCK();
 	return 0;
 }
 
@@ -1469,46 +1518,49 @@ crypto_proc(void *arg)
 static int
 crypto_ret_proc(void *arg)
 {
-	struct cryptop *crpt;
+	struct crypto_cpu_q *q = &crypto_cpu_q[(unsigned long) arg];
+	struct cryptop *crpt, *next;
 	struct cryptkop *krpt;
+	LIST_HEAD(ret);
 	unsigned long  r_flags;
 
 	set_current_state(TASK_INTERRUPTIBLE);
 
-	CRYPTO_RETQ_LOCK();
 	for (;;) {
 		/* Harvest return q's for completed ops */
-		crpt = NULL;
-		if (!list_empty(&crp_ret_q))
-			crpt = list_entry(crp_ret_q.next, typeof(*crpt), crp_next);
-		if (crpt != NULL)
-			list_del(&crpt->crp_next);
+		spin_lock_irqsave(&q->ret_lock, r_flags);
+		list_splice_init(&q->ret_q, &ret);
+		spin_unlock_irqrestore(&q->ret_lock, r_flags);
 
 		krpt = NULL;
-		if (!list_empty(&crp_ret_kq))
-			krpt = list_entry(crp_ret_kq.next, typeof(*krpt), krp_next);
-		if (krpt != NULL)
-			list_del(&krpt->krp_next);
-
-		if (crpt != NULL || krpt != NULL) {
+		if (!list_empty(&crp_ret_kq)) {
+			CRYPTO_RETQ_LOCK();
+			if (!list_empty(&crp_ret_kq)) {
+				krpt = list_entry(crp_ret_kq.next, typeof(*krpt),
+						krp_next);
+				list_del(&krpt->krp_next);
+			}
 			CRYPTO_RETQ_UNLOCK();
+		}
+
+		if (!list_empty(&ret) || krpt != NULL) {
 			/*
 			 * Run callbacks unlocked.
 			 */
-			if (crpt != NULL)
+			list_for_each_entry_safe(crpt, next, &ret, crp_next) {
+				list_del(&crpt->crp_next);
 				crpt->crp_callback(crpt);
+			}
 			if (krpt != NULL)
 				krpt->krp_callback(krpt);
-			CRYPTO_RETQ_LOCK();
 		} else {
 			/*
 			 * Nothing more to be processed.  Sleep until we're
 			 * woken because there are more returns to process.
 			 */
 			dprintk("%s - sleeping\n", __FUNCTION__);
-			CRYPTO_RETQ_UNLOCK();
-			wait_event_interruptible(cryptoretproc_wait,
-					!list_empty(&crp_ret_q) ||
+			wait_event_interruptible(q->ret_wait,
+					!list_empty(&q->ret_q) ||
 					!list_empty(&crp_ret_kq) ||
 					kthread_should_stop());
 			if (signal_pending (current)) {
@@ -1520,7 +1572,6 @@ crypto_ret_proc(void *arg)
 				spin_unlock_irq(&current->sigmask_lock);
 #endif
 			}
-			CRYPTO_RETQ_LOCK();
 			dprintk("%s - awake\n", __FUNCTION__);
 			if (kthread_should_stop()) {
 				dprintk("%s - EXITING!\n", __FUNCTION__);
@@ -1529,7 +1580,6 @@ crypto_ret_proc(void *arg)
 			cryptostats.cs_rets++;
 		}
 	}
-	CRYPTO_RETQ_UNLOCK();
 	return 0;
 }
 
@@ -1679,6 +1729,17 @@ crypto_init(void)
 
 	memset(crypto_drivers, 0, crypto_drivers_num * sizeof(struct cryptocap));
 
+	for (cpu = 0; cpu < CONFIG_NR_CPUS; cpu++) {
+		struct crypto_cpu_q *q = &crypto_cpu_q[cpu];
+
+		spin_lock_init(&q->lock);
+		INIT_LIST_HEAD(&q->q);
+		init_waitqueue_head(&q->wait);
+		spin_lock_init(&q->ret_lock);
+		INIT_LIST_HEAD(&q->ret_q);
+		init_waitqueue_head(&q->ret_wait);
+	}
+
 	ocf_for_each_cpu(cpu) {
 		cryptoproc[cpu] = kthread_create(crypto_proc, (void *) cpu,
 									"ocf_%d", (int) cpu);
@@ -58,6 +58,10 @@ __FBSDID("$FreeBSD: src/sys/opencrypto/cryptodev.c,v 1.34 2007/05/09 19:37:02 gn
 #include <linux/file.h>
 #include <linux/mount.h>
 #include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/highmem.h>
+#include <linux/poll.h>
+#include <linux/spinlock.h>
 #include <asm/uaccess.h>
 
 #include <cryptodev.h>
@@ -70,6 +74,20 @@ int cryptodev_debug = 0;
 module_param(cryptodev_debug, int, 0644);
 MODULE_PARM_DESC(cryptodev_debug, "Enable cryptodev debug");
 
+/*
+ * CIOCNCRYPTM operations on at least this many bytes are done directly on
+ * the user's pages where possible rather than on a copy, -1 disables it.
+ */
+static int cryptodev_zerocopy_min = 512;
+module_param(cryptodev_zerocopy_min, int, 0644);
+MODULE_PARM_DESC(cryptodev_zerocopy_min,
+		"Minimum size of operations done on the user's pages");
+
+static int cryptodev_max_reqs = 256;
+module_param(cryptodev_max_reqs, int, 0644);
+MODULE_PARM_DESC(cryptodev_max_reqs,
+		"Maximum number of CIOCNCRYPTM operations per descriptor");
+
 struct csession_info {
 	u_int16_t	blocksize;
 	u_int16_t	minkey, maxkey;
@@ -94,7 +112,6 @@ struct csession {
 
 	caddr_t		key;
 	int		keylen;
-	u_char		tmp_iv[EALG_MAX_BLOCK_LEN];
 
 	caddr_t		mackey;
 	int		mackeylen;
@@ -104,11 +121,44 @@ struct csession {
 	struct iovec	iovec;
 	struct uio	uio;
 	int		error;
+
+	int		pending;	/* CIOCNCRYPTM ops not completed yet */
 };
 
 struct fcrypt {
 	struct list_head	csessions;
 	int		sesn;
+
+	spinlock_t	lock;		/* protects the request lists */
+	struct list_head	pending;	/* submitted with CIOCNCRYPTM */
+	struct list_head	done;		/* completed, not collected yet */
+	int		nreqs;		/* ops on both lists */
+	u_int32_t	reqid;
+	wait_queue_head_t waitq;
+};
+
+/*
+ * An operation submitted with CIOCNCRYPTM.  It is on the pending list of
+ * the file until it completes and on the done list until its result is
+ * collected with CIOCNCRYPTRETM.  Only pending operations hold on to
+ * their session, so a session can be freed with results still queued.
+ */
+struct cryptodev_req {
+	struct list_head	list;
+	struct fcrypt	*fcr;
+	struct csession	*cse;
+	struct cryptop	*crp;
+
+	struct iovec	iovec;
+	struct uio	uio;
+	struct page	*page;		/* pinned user page, or NULL for a copy */
+
+	u_int32_t	reqid;
+	void		*opaque;
+	caddr_t		dst, mac;
+	u_int		len;
+	u_int16_t	authsize;
+	int		status;
 };
 
 static struct csession *csefind(struct fcrypt *, u_int);
@@ -119,6 +169,8 @@ static struct csession *csecreate(struct fcrypt *, u_int64_t,
 static int csefree(struct csession *);
 
 static	int cryptodev_op(struct csession *, struct crypt_op *);
+static	int cryptodev_nop(struct fcrypt *, struct crypt_n_op *);
+static	int cryptodev_nret(struct fcrypt *, struct cryptret *);
 static	int cryptodev_key(struct crypt_kop *);
 static	int cryptodev_find(struct crypt_find_op *);
 
@@ -163,54 +215,34 @@ checkcrid(int crid)
 }
 
 static int
-cryptodev_op(struct csession *cse, struct crypt_op *cop)
+cryptodev_check(struct csession *cse, u_int len)
 {
-	struct cryptop *crp = NULL;
-	struct cryptodesc *crde = NULL, *crda = NULL;
-	int error = 0;
-
-	dprintk("%s()\n", __FUNCTION__);
-	if (cop->len > CRYPTO_MAX_DATA_LEN) {
-		dprintk("%s: %d > %d\n", __FUNCTION__, cop->len, CRYPTO_MAX_DATA_LEN);
+	if (len > CRYPTO_MAX_DATA_LEN) {
+		dprintk("%s: %d > %d\n", __FUNCTION__, len, CRYPTO_MAX_DATA_LEN);
 		return (E2BIG);
 	}
 
-	if (cse->info.blocksize && (cop->len % cse->info.blocksize) != 0) {
+	if (cse->info.blocksize && (len % cse->info.blocksize) != 0) {
 		dprintk("%s: blocksize=%d len=%d\n", __FUNCTION__, cse->info.blocksize,
-				cop->len);
+				len);
 		return (EINVAL);
 	}
+	return (0);
+}
 
-	cse->uio.uio_iov = &cse->iovec;
-	cse->uio.uio_iovcnt = 1;
-	cse->uio.uio_offset = 0;
-#if 0
-	cse->uio.uio_resid = cop->len;
-	cse->uio.uio_segflg = UIO_SYSSPACE;
-	cse->uio.uio_rw = UIO_WRITE;
-	cse->uio.uio_td = td;
-#endif
-	cse->uio.uio_iov[0].iov_len = cop->len;
-	if (cse->info.authsize)
-		cse->uio.uio_iov[0].iov_len += cse->info.authsize;
-	cse->uio.uio_iov[0].iov_base = kmalloc(cse->uio.uio_iov[0].iov_len,
-			GFP_KERNEL);
-
-	if (cse->uio.uio_iov[0].iov_base == NULL) {
-		dprintk("%s: iov_base kmalloc(%d) failed\n", __FUNCTION__,
-				(int)cse->uio.uio_iov[0].iov_len);
-		return (ENOMEM);
-	}
-
-	crp = crypto_getreq((cse->info.blocksize != 0) + (cse->info.authsize != 0));
-	if (crp == NULL) {
-		dprintk("%s: ENOMEM\n", __FUNCTION__);
-		error = ENOMEM;
-		goto bail;
-	}
+/*
+ * Fill in the descriptors of crp for an operation on len bytes of data
+ * followed by room for the MAC.
+ */
+static int
+cryptodev_prep(struct csession *cse, struct cryptop *crp, u_int16_t op,
+		u_int len, caddr_t iv, caddr_t mac)
+{
+	struct cryptodesc *crde = NULL, *crda = NULL;
+	int error;
 
 	if (cse->info.authsize && cse->info.blocksize) {
-		if (cop->op == COP_ENCRYPT) {
+		if (op == COP_ENCRYPT) {
 			crde = crp->crp_desc;
 			crda = crde->crd_next;
 		} else {
@@ -223,20 +255,13 @@ cryptodev_op(struct csession *cse, struct crypt_op *cop)
 		crde = crp->crp_desc;
 	} else {
 		dprintk("%s: bad request\n", __FUNCTION__);
-		error = EINVAL;
-		goto bail;
-	}
-
-	if ((error = copy_from_user(cse->uio.uio_iov[0].iov_base, cop->src,
-					cop->len))) {
-		dprintk("%s: bad copy\n", __FUNCTION__);
-		goto bail;
+		return (EINVAL);
 	}
 
 	if (crda) {
 		crda->crd_skip = 0;
-		crda->crd_len = cop->len;
-		crda->crd_inject = cop->len;
+		crda->crd_len = len;
+		crda->crd_inject = len;
 
 		crda->crd_alg = cse->mac;
 		crda->crd_key = cse->mackey;
@@ -244,11 +269,11 @@ cryptodev_op(struct csession *cse, struct crypt_op *cop)
 	}
 
 	if (crde) {
-		if (cop->op == COP_ENCRYPT)
+		if (op == COP_ENCRYPT)
 			crde->crd_flags |= CRD_F_ENCRYPT;
 		else
 			crde->crd_flags &= ~CRD_F_ENCRYPT;
-		crde->crd_len = cop->len;
+		crde->crd_len = len;
 		crde->crd_inject = 0;
 
 		crde->crd_alg = cse->cipher;
@@ -256,31 +281,20 @@ cryptodev_op(struct csession *cse, struct crypt_op *cop)
 		crde->crd_klen = cse->keylen * 8;
 	}
 
-	crp->crp_ilen = cse->uio.uio_iov[0].iov_len;
-	crp->crp_flags = CRYPTO_F_IOV | CRYPTO_F_CBIMM
-		       | (cop->flags & COP_F_BATCH);
-	crp->crp_buf = (caddr_t)&cse->uio;
-	crp->crp_callback = (int (*) (struct cryptop *)) cryptodev_cb;
-	crp->crp_sid = cse->sid;
-	crp->crp_opaque = (void *)cse;
-
-	if (cop->iv) {
+	if (iv) {
 		if (crde == NULL) {
-			error = EINVAL;
 			dprintk("%s no crde\n", __FUNCTION__);
-			goto bail;
+			return (EINVAL);
 		}
 		if (cse->cipher == CRYPTO_ARC4) { /* XXX use flag? */
-			error = EINVAL;
 			dprintk("%s arc4 with IV\n", __FUNCTION__);
-			goto bail;
+			return (EINVAL);
 		}
-		if ((error = copy_from_user(cse->tmp_iv, cop->iv,
+		if ((error = copy_from_user(crde->crd_iv, iv,
 						cse->info.blocksize))) {
 			dprintk("%s bad iv copy\n", __FUNCTION__);
-			goto bail;
+			return (error);
 		}
-		memcpy(crde->crd_iv, cse->tmp_iv, cse->info.blocksize);
 		crde->crd_flags |= CRD_F_IV_EXPLICIT | CRD_F_IV_PRESENT;
 		crde->crd_skip = 0;
 	} else if (cse->cipher == CRYPTO_ARC4) { /* XXX use flag? */
@@ -291,12 +305,70 @@ cryptodev_op(struct csession *cse, struct crypt_op *cop)
 		crde->crd_len -= cse->info.blocksize;
 	}
 
-	if (cop->mac && crda == NULL) {
-		error = EINVAL;
+	if (mac && crda == NULL) {
 		dprintk("%s no crda\n", __FUNCTION__);
+		return (EINVAL);
+	}
+	return (0);
+}
+
+static int
+cryptodev_op(struct csession *cse, struct crypt_op *cop)
+{
+	struct cryptop *crp = NULL;
+	int error = 0;
+
+	dprintk("%s()\n", __FUNCTION__);
+	error = cryptodev_check(cse, cop->len);
+	if (error)
+		return (error);
+
+	cse->uio.uio_iov = &cse->iovec;
+	cse->uio.uio_iovcnt = 1;
+	cse->uio.uio_offset = 0;
+#if 0
+	cse->uio.uio_resid = cop->len;
+	cse->uio.uio_segflg = UIO_SYSSPACE;
+	cse->uio.uio_rw = UIO_WRITE;
+	cse->uio.uio_td = td;
+#endif
+	cse->uio.uio_iov[0].iov_len = cop->len;
+	if (cse->info.authsize)
+		cse->uio.uio_iov[0].iov_len += cse->info.authsize;
+	cse->uio.uio_iov[0].iov_base = kmalloc(cse->uio.uio_iov[0].iov_len,
+			GFP_KERNEL);
+
+	if (cse->uio.uio_iov[0].iov_base == NULL) {
+		dprintk("%s: iov_base kmalloc(%d) failed\n", __FUNCTION__,
+				(int)cse->uio.uio_iov[0].iov_len);
+		return (ENOMEM);
+	}
+
+	crp = crypto_getreq((cse->info.blocksize != 0) + (cse->info.authsize != 0));
+	if (crp == NULL) {
+		dprintk("%s: ENOMEM\n", __FUNCTION__);
+		error = ENOMEM;
+		goto bail;
+	}
+
+	if ((error = copy_from_user(cse->uio.uio_iov[0].iov_base, cop->src,
+					cop->len))) {
+		dprintk("%s: bad copy\n", __FUNCTION__);
 		goto bail;
 	}
 
+	crp->crp_ilen = cse->uio.uio_iov[0].iov_len;
+	crp->crp_flags = CRYPTO_F_IOV | CRYPTO_F_CBIMM
+		       | (cop->flags & COP_F_BATCH);
+	crp->crp_buf = (caddr_t)&cse->uio;
+	crp->crp_callback = (int (*) (struct cryptop *)) cryptodev_cb;
+	crp->crp_sid = cse->sid;
+	crp->crp_opaque = (void *)cse;
+
+	error = cryptodev_prep(cse, crp, cop->op, cop->len, cop->iv, cop->mac);
+	if (error)
+		goto bail;
+
 	/*
 	 * Let the dispatch run unlocked, then, interlock against the
 	 * callback before checking if the operation completed and going
@@ -393,6 +465,251 @@ cryptodev_cb(void *op)
 	return (0);
 }
 
+/*
+ * Try to run a CIOCNCRYPTM operation directly on the user's buffer.  This
+ * is only done if the buffer is within a single lowmem page, as several
+ * drivers cannot handle more than one iovec.
+ */
+static int
+cryptodev_pin(struct cryptodev_req *req, caddr_t buf, size_t len)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,27)
+	unsigned long addr = (unsigned long) buf;
+
+	if (cryptodev_zerocopy_min < 0 || len < cryptodev_zerocopy_min ||
+			offset_in_page(addr) + len > PAGE_SIZE)
+		return (0);
+
+	if (get_user_pages_fast(addr, 1, 1, &req->page) != 1) {
+		req->page = NULL;
+		return (0);
+	}
+	if (PageHighMem(req->page)) {
+		put_page(req->page);
+		req->page = NULL;
+		return (0);
+	}
+	req->iovec.iov_base = page_address(req->page) + offset_in_page(addr);
+	return (1);
+#else
+	return (0);
+#endif
+}
+
+static void
+cryptodev_req_free(struct cryptodev_req *req)
+{
+	if (req->crp)
+		crypto_freereq(req->crp);
+	if (req->page) {
+		flush_dcache_page(req->page);
+		set_page_dirty_lock(req->page);
+		put_page(req->page);
+	} else if (req->iovec.iov_base)
+		kfree(req->iovec.iov_base);
+	kfree(req);
+}
+
+static int
+cryptodev_ncb(void *op)
+{
+	struct cryptop *crp = (struct cryptop *) op;
+	struct cryptodev_req *req = (struct cryptodev_req *) crp->crp_opaque;
+	struct fcrypt *fcr = req->fcr;
+	unsigned long flags;
+	int error;
+
+	dprintk("%s()\n", __FUNCTION__);
+	error = crp->crp_etype;
+	if (error == EAGAIN) {
+		crp->crp_flags &= ~CRYPTO_F_DONE;
+		error = crypto_dispatch(crp);
+		if (error == 0)
+			return (0);
+	}
+
+	/* fcr may go away once we drop the lock, see cryptodev_release */
+	spin_lock_irqsave(&fcr->lock, flags);
+	req->status = error;
+	req->cse->pending--;
+	req->cse = NULL;
+	list_move_tail(&req->list, &fcr->done);
+	wake_up(&fcr->waitq);
+	spin_unlock_irqrestore(&fcr->lock, flags);
+	return (0);
+}
+
+/*
+ * Submit one operation of a CIOCNCRYPTM request, its result is collected
+ * later with CIOCNCRYPTRETM.
+ */
+static int
+cryptodev_nop(struct fcrypt *fcr, struct crypt_n_op *cnop)
+{
+	struct cryptodev_req *req;
+	struct csession *cse;
+	struct cryptop *crp;
+	unsigned long flags;
+	int inplace, error;
+
+	dprintk("%s()\n", __FUNCTION__);
+	cse = csefind(fcr, cnop->ses);
+	if (cse == NULL)
+		return (EINVAL);
+	error = cryptodev_check(cse, cnop->len);
+	if (error)
+		return (error);
+
+	spin_lock_irqsave(&fcr->lock, flags);
+	if (fcr->nreqs >= cryptodev_max_reqs) {
+		spin_unlock_irqrestore(&fcr->lock, flags);
+		return (EAGAIN);
+	}
+	fcr->nreqs++;
+	spin_unlock_irqrestore(&fcr->lock, flags);
+
+	req = kmalloc(sizeof(*req), GFP_KERNEL);
+	if (req == NULL) {
+		error = ENOMEM;
+		goto unreserve;
+	}
+	memset(req, 0, sizeof(*req));
+	INIT_LIST_HEAD(&req->list);
+	req->fcr = fcr;
+	req->cse = cse;
+	req->opaque = cnop->opaque;
+	req->dst = cnop->dst;
+	req->mac = cnop->mac;
+	req->len = cnop->len;
+	req->authsize = cse->info.authsize;
+
+	req->uio.uio_iov = &req->iovec;
+	req->uio.uio_iovcnt = 1;
+	req->iovec.iov_len = cnop->len + cse->info.authsize;
+
+	/*
+	 * The operation can be done in place if the result goes back to
+	 * the source (or the data is not changed) and the MAC directly
+	 * follows the data.  Otherwise use a copy.
+	 */
+	inplace = (cnop->dst == cnop->src ||
+			(cnop->dst == NULL && !cse->info.blocksize)) &&
+		(!cse->info.authsize || cnop->mac == cnop->src + cnop->len);
+	if (!inplace || !cryptodev_pin(req, cnop->src, req->iovec.iov_len)) {
+		req->iovec.iov_base = kmalloc(req->iovec.iov_len, GFP_KERNEL);
+		if (req->iovec.iov_base == NULL) {
+			error = ENOMEM;
+			goto bail;
+		}
+		if (copy_from_user(req->iovec.iov_base, cnop->src, cnop->len)) {
+			dprintk("%s: bad copy\n", __FUNCTION__);
+			error = EFAULT;
+			goto bail;
+		}
+	}
+
+	crp = crypto_getreq((cse->info.blocksize != 0) + (cse->info.authsize != 0));
+	if (crp == NULL) {
+		error = ENOMEM;
+		goto bail;
+	}
+	req->crp = crp;
+
+	crp->crp_ilen = req->iovec.iov_len;
+	crp->crp_flags = CRYPTO_F_IOV | CRYPTO_F_CBIMM
+		       | (cnop->flags & COP_F_BATCH);
+	crp->crp_buf = (caddr_t)&req->uio;
+	crp->crp_callback = (int (*) (struct cryptop *)) cryptodev_ncb;
+	crp->crp_sid = cse->sid;
+	crp->crp_opaque = (void *)req;
+
+	error = cryptodev_prep(cse, crp, cnop->op, cnop->len, cnop->iv,
+			cnop->mac);
+	if (error)
+		goto bail;
+
+	spin_lock_irqsave(&fcr->lock, flags);
+	req->reqid = ++fcr->reqid;
+	cse->pending++;
+	list_add_tail(&req->list, &fcr->pending);
+	spin_unlock_irqrestore(&fcr->lock, flags);
+	cnop->reqid = req->reqid;
+
+	error = crypto_dispatch(crp);
+	if (error) {
+		dprintk("%s error in crypto_dispatch\n", __FUNCTION__);
+		spin_lock_irqsave(&fcr->lock, flags);
+		list_del(&req->list);
+		cse->pending--;
+		spin_unlock_irqrestore(&fcr->lock, flags);
+		goto bail;
+	}
+	return (0);
+
+bail:
+	cryptodev_req_free(req);
+unreserve:
+	spin_lock_irqsave(&fcr->lock, flags);
+	fcr->nreqs--;
+	spin_unlock_irqrestore(&fcr->lock, flags);
+	return (error);
+}
+
+/*
+ * Return up to cret->count completed CIOCNCRYPTM operations.
+ */
+static int
+cryptodev_nret(struct fcrypt *fcr, struct cryptret *cret)
+{
+	struct cryptodev_req *req;
+	struct crypt_result res;
+	unsigned long flags;
+	u_int n;
+	int error = 0;
+
+	dprintk("%s()\n", __FUNCTION__);
+	for (n = 0; n < cret->count; n++) {
+		req = NULL;
+		spin_lock_irqsave(&fcr->lock, flags);
+		if (!list_empty(&fcr->done)) {
+			req = list_entry(fcr->done.next, struct cryptodev_req, list);
+			list_del(&req->list);
+			fcr->nreqs--;
+		}
+		spin_unlock_irqrestore(&fcr->lock, flags);
+		if (req == NULL)
+			break;
+
+		memset(&res, 0, sizeof(res));
+		res.reqid = req->reqid;
+		res.opaque = req->opaque;
+		res.status = req->status;
+		if (res.status == 0 && req->page == NULL) {
+			if (req->dst && copy_to_user(req->dst,
+						req->iovec.iov_base, req->len))
+				res.status = EFAULT;
+			else if (req->mac && copy_to_user(req->mac,
+						(caddr_t)req->iovec.iov_base + req->len,
+						req->authsize))
+				res.status = EFAULT;
+		}
+
+		if (copy_to_user(&cret->results[n], &res, sizeof(res))) {
+			dprintk("%s bad result copy\n", __FUNCTION__);
+			/* keep the result for the next call */
+			spin_lock_irqsave(&fcr->lock, flags);
+			list_add(&req->list, &fcr->done);
+			fcr->nreqs++;
+			spin_unlock_irqrestore(&fcr->lock, flags);
+			error = EFAULT;
+			break;
+		}
+		cryptodev_req_free(req);
+	}
+	cret->count = n;
+	return (error);
+}
+
 static int
 cryptodevkey_cb(void *op)
 {
@@ -632,9 +949,14 @@ cryptodev_ioctl(
 	struct crypt_op cop;
 	struct crypt_kop kop;
 	struct crypt_find_op fop;
+	struct crypt_mop mop;
+	struct crypt_n_op cnop;
+	struct cryptret cret;
 	u_int64_t sid;
 	u_int32_t ses = 0;
-	int feat, fd, error = 0, crid;
+	int feat, fd, error = 0, crid, pending;
+	unsigned long flags;
+	u_int i;
 	mm_segment_t fs;
 
 	dprintk("%s(cmd=%x arg=%lx)\n", __FUNCTION__, cmd, arg);
@@ -878,6 +1200,15 @@ bail:
 			dprintk("%s(CIOCFSESSION) - Fail %d\n", __FUNCTION__, error);
 			break;
 		}
+		spin_lock_irqsave(&fcr->lock, flags);
+		pending = cse->pending;
+		spin_unlock_irqrestore(&fcr->lock, flags);
+		if (pending) {
+			error = EBUSY;
+			dprintk("%s(CIOCFSESSION) - %d ops pending\n", __FUNCTION__,
+					pending);
+			break;
+		}
 		csedelete(fcr, cse);
 		error = csefree(cse);
 		break;
@@ -901,6 +1232,41 @@ bail:
 			goto bail;
 		}
 		break;
+	case CIOCNCRYPTM:
+		dprintk("%s(CIOCNCRYPTM)\n", __FUNCTION__);
+		if (copy_from_user(&mop, (void*)arg, sizeof(mop))) {
+			dprintk("%s(CIOCNCRYPTM) - bad copy\n", __FUNCTION__);
+			error = EFAULT;
+			break;
+		}
+		for (i = 0; i < mop.count; i++) {
+			if (copy_from_user(&cnop, &mop.reqs[i], sizeof(cnop))) {
+				dprintk("%s(CIOCNCRYPTM) - bad op copy\n", __FUNCTION__);
+				error = EFAULT;
+				break;
+			}
+			cnop.status = cryptodev_nop(fcr, &cnop);
+			if (copy_to_user(&mop.reqs[i], &cnop, sizeof(cnop))) {
+				dprintk("%s(CIOCNCRYPTM) - bad return copy\n",
+						__FUNCTION__);
+				error = EFAULT;
+				break;
+			}
+		}
+		break;
+	case CIOCNCRYPTRETM:
+		dprintk("%s(CIOCNCRYPTRETM)\n", __FUNCTION__);
+		if (copy_from_user(&cret, (void*)arg, sizeof(cret))) {
+			dprintk("%s(CIOCNCRYPTRETM) - bad copy\n", __FUNCTION__);
+			error = EFAULT;
+			break;
+		}
+		error = cryptodev_nret(fcr, &cret);
+		if (copy_to_user((void*)arg, &cret, sizeof(cret))) {
+			dprintk("%s(CIOCNCRYPTRETM) - bad return copy\n", __FUNCTION__);
+			error = EFAULT;
+		}
+		break;
 	case CIOCKEY:
 	case CIOCKEY2:
 		dprintk("%s(CIOCKEY)\n", __FUNCTION__);
@@ -996,6 +1362,10 @@ cryptodev_open(struct inode *inode, struct file *filp)
 	memset(fcr, 0, sizeof(*fcr));
 
 	INIT_LIST_HEAD(&fcr->csessions);
+	spin_lock_init(&fcr->lock);
+	INIT_LIST_HEAD(&fcr->pending);
+	INIT_LIST_HEAD(&fcr->done);
+	init_waitqueue_head(&fcr->waitq);
 	filp->private_data = fcr;
 	return(0);
 }
@@ -1005,6 +1375,7 @@ cryptodev_release(struct inode *inode, struct file *filp)
 {
 	struct fcrypt *fcr = filp->private_data;
 	struct csession *cse, *tmp;
+	struct cryptodev_req *req, *rtmp;
 
 	dprintk("%s()\n", __FUNCTION__);
 	if (!filp) {
@@ -1012,6 +1383,18 @@ cryptodev_release(struct inode *inode, struct file *filp)
 		return(0);
 	}
 
+	/*
+	 * Operations still in progress reference fcr and their session,
+	 * wait for them and for the last callback to drop the lock.
+	 */
+	wait_event(fcr->waitq, list_empty(&fcr->pending));
+	spin_lock_irq(&fcr->lock);
+	spin_unlock_irq(&fcr->lock);
+	list_for_each_entry_safe(req, rtmp, &fcr->done, list) {
+		list_del(&req->list);
+		cryptodev_req_free(req);
+	}
+
 	list_for_each_entry_safe(cse, tmp, &fcr->csessions, list) {
 		list_del(&cse->list);
 		(void)csefree(cse);
@@ -1021,10 +1404,30 @@ cryptodev_release(struct inode *inode, struct file *filp)
 	return(0);
 }
 
+/*
+ * The descriptor is readable while there are completed CIOCNCRYPTM
+ * operations to collect.
+ */
+static unsigned int
+cryptodev_poll(struct file *filp, poll_table *wait)
+{
+	struct fcrypt *fcr = filp->private_data;
+	unsigned int mask = 0;
+	unsigned long flags;
+
+	poll_wait(filp, &fcr->waitq, wait);
+	spin_lock_irqsave(&fcr->lock, flags);
+	if (!list_empty(&fcr->done))
+		mask |= POLLIN | POLLRDNORM;
+	spin_unlock_irqrestore(&fcr->lock, flags);
+	return(mask);
+}
+
 static struct file_operations cryptodev_fops = {
 	.owner = THIS_MODULE,
 	.open = cryptodev_open,
 	.release = cryptodev_release,
+	.poll = cryptodev_poll,
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,36)
 	.ioctl = cryptodev_ioctl,
 #endif
@@ -42,6 +42,8 @@
 #include <linux/sched.h>
 #include <linux/spinlock.h>
 #include <linux/interrupt.h>
+#include <linux/ktime.h>
+#include <linux/sort.h>
 #include <cryptodev.h>
 
 #ifdef I_HAVE_AN_XSCALE_WITH_INTEL_SDK
@@ -71,6 +73,15 @@ static int request_q_len = 40;
 module_param(request_q_len, int, 0);
 MODULE_PARM_DESC(request_q_len, "Number of outstanding requests");
 
+/*
+ * optionally repeat the OCF benchmark for each of these numbers of
+ * outstanding requests instead of request_q_len
+ */
+static int request_q_sweep[16];
+static int request_q_sweep_num;
+module_param_array(request_q_sweep, int, &request_q_sweep_num, 0);
+MODULE_PARM_DESC(request_q_sweep, "List of request_q_len values to run");
+
 /*
  * how many requests we want to have processed
  */
@@ -108,6 +119,7 @@ typedef struct  {
 	IX_MBUF mbuf;
 #endif
 	unsigned char *buffer;
+	ktime_t start;
 } request_t;
 
 static request_t *requests;
@@ -116,6 +128,12 @@ static spinlock_t ocfbench_counter_lock;
 static int outstanding;
 static int total;
 
+/*
+ * latency of the first request_num requests in usecs
+ */
+static u32 *latency;
+static int latency_num;
+
 /*************************************************************************/
 /*
  * OCF benchmark routines
@@ -167,6 +185,7 @@ static int
 ocf_cb(struct cryptop *crp)
 {
 	request_t *r = (request_t *) crp->crp_opaque;
+	u32 usecs = ktime_to_us(ktime_sub(ktime_get(), r->start));
 	unsigned long flags;
 
 	if (crp->crp_etype)
@@ -177,6 +196,8 @@ ocf_cb(struct cryptop *crp)
 	/* do all requests  but take at least 1 second */
 	spin_lock_irqsave(&ocfbench_counter_lock, flags);
 	total++;
+	if (latency_num < request_num)
+		latency[latency_num++] = usecs;
 	if (total > request_num && jstart + HZ < jiffies) {
 		outstanding--;
 		spin_unlock_irqrestore(&ocfbench_counter_lock, flags);
@@ -234,7 +255,13 @@ ocf_request(void *arg)
 	crp->crp_callback = ocf_cb;
 	crp->crp_sid = ocf_cryptoid;
 	crp->crp_opaque = (caddr_t) r;
-	crypto_dispatch(crp);
+	r->start = ktime_get();
+	if (crypto_dispatch(crp)) {
+		crypto_freereq(crp);
+		spin_lock_irqsave(&ocfbench_counter_lock, flags);
+		outstanding--;
+		spin_unlock_irqrestore(&ocfbench_counter_lock, flags);
+	}
 }
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,20)
@@ -252,6 +279,55 @@ ocf_done(void)
 	crypto_freesession(ocf_cryptoid);
 }
 
+static int
+cmp_u32(const void *a, const void *b)
+{
+	u32 x = *(const u32 *) a, y = *(const u32 *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void
+ocf_bench(int qlen)
+{
+	unsigned long mbps, ops;
+	unsigned long flags;
+	int i;
+
+	spin_lock_init(&ocfbench_counter_lock);
+	total = outstanding = latency_num = 0;
+	jstart = jiffies;
+	for (i = 0; i < qlen; i++) {
+		spin_lock_irqsave(&ocfbench_counter_lock, flags);
+		outstanding++;
+		spin_unlock_irqrestore(&ocfbench_counter_lock, flags);
+		ocf_request(&requests[i]);
+	}
+	while (outstanding > 0)
+		schedule();
+	jstop = jiffies;
+
+	mbps = ops = 0;
+	if (jstop > jstart) {
+		mbps = (unsigned long) total * (unsigned long) request_size * 8;
+		mbps /= ((jstop - jstart) * 1000) / HZ;
+		ops = (unsigned long) total * HZ / (jstop - jstart);
+	}
+	printk("OCF: %d requests of %d bytes in %d jiffies (%d.%03d Mbps, "
+			"%lu ops/s) with %d outstanding\n",
+			total, request_size, (int)(jstop - jstart),
+			((int)mbps) / 1000, ((int)mbps) % 1000, ops, qlen);
+
+	if (latency_num > 0) {
+		sort(latency, latency_num, sizeof(*latency), cmp_u32, NULL);
+		printk("OCF: latency usecs p50 %u p90 %u p99 %u max %u\n",
+				latency[latency_num * 50 / 100],
+				latency[latency_num * 90 / 100],
+				latency[latency_num * 99 / 100],
+				latency[latency_num - 1]);
+	}
+}
+
 /*************************************************************************/
 #ifdef BENCH_IXP_ACCESS_LIB
 /*************************************************************************/
@@ -405,19 +481,36 @@ ixp_done(void)
 int
 ocfbench_init(void)
 {
-	int i;
+	int i, max_q_len, ret = -EINVAL;
+#ifdef BENCH_IXP_ACCESS_LIB
 	unsigned long mbps;
 	unsigned long flags;
+#endif
 
 	printk("Crypto Speed tests\n");
 
-	requests = kmalloc(sizeof(request_t) * request_q_len, GFP_KERNEL);
-	if (!requests) {
+	max_q_len = request_q_len;
+	for (i = 0; i < request_q_sweep_num; i++) {
+		if (request_q_sweep[i] <= 0) {
+			printk("invalid request_q_sweep value %d\n",
+					request_q_sweep[i]);
+			return -EINVAL;
+		}
+		if (request_q_sweep[i] > max_q_len)
+			max_q_len = request_q_sweep[i];
+	}
+
+	latency = kmalloc(sizeof(*latency) * request_num, GFP_KERNEL);
+	requests = kmalloc(sizeof(request_t) * max_q_len, GFP_KERNEL);
+	if (requests)
+		memset(requests, 0, sizeof(request_t) * max_q_len);
+	if (!requests || !latency) {
 		printk("malloc failed\n");
-		return -EINVAL;
+		ret = -ENOMEM;
+		goto out;
 	}
 
-	for (i = 0; i < request_q_len; i++) {
+	for (i = 0; i < max_q_len; i++) {
 		/* +64 for return data */
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,20)
 		INIT_WORK(&requests[i].work, ocf_request_wq);
@@ -427,7 +520,8 @@ ocfbench_init(void)
 		requests[i].buffer = kmalloc(request_size + 128, GFP_DMA);
 		if (!requests[i].buffer) {
 			printk("malloc failed\n");
-			return -EINVAL;
+			ret = -ENOMEM;
+			goto out;
 		}
 		memset(requests[i].buffer, '0' + i, request_size + 128);
 	}
@@ -437,29 +531,12 @@ ocfbench_init(void)
 	 */
 	printk("OCF: testing ...\n");
 	if (ocf_init() == -1)
-		return -EINVAL;
-
-	spin_lock_init(&ocfbench_counter_lock);
-	total = outstanding = 0;
-	jstart = jiffies;
-	for (i = 0; i < request_q_len; i++) {
-		spin_lock_irqsave(&ocfbench_counter_lock, flags);
-		outstanding++;
-		spin_unlock_irqrestore(&ocfbench_counter_lock, flags);
-		ocf_request(&requests[i]);
-	}
-	while (outstanding > 0)
-		schedule();
-	jstop = jiffies;
+		goto out;
 
-	mbps = 0;
-	if (jstop > jstart) {
-		mbps = (unsigned long) total * (unsigned long) request_size * 8;
-		mbps /= ((jstop - jstart) * 1000) / HZ;
-	}
-	printk("OCF: %d requests of %d bytes in %d jiffies (%d.%03d Mbps)\n",
-			total, request_size, (int)(jstop - jstart),
-			((int)mbps) / 1000, ((int)mbps) % 1000);
+	if (request_q_sweep_num == 0)
+		ocf_bench(request_q_len);
+	for (i = 0; i < request_q_sweep_num; i++)
+		ocf_bench(request_q_sweep[i]);
 	ocf_done();
 
 #ifdef BENCH_IXP_ACCESS_LIB
@@ -496,10 +573,13 @@ ocfbench_init(void)
 	ixp_done();
 #endif /* BENCH_IXP_ACCESS_LIB */
 
-	for (i = 0; i < request_q_len; i++)
-		kfree(requests[i].buffer);
+out:
+	if (requests)
+		for (i = 0; i < max_q_len; i++)
+			kfree(requests[i].buffer);
 	kfree(requests);
-	return -EINVAL; /* always fail to load so it can be re-run quickly ;-) */
+	kfree(latency);
+	return ret; /* always fail to load so it can be re-run quickly ;-) */
 }
 
 static void __exit ocfbench_exit(void)
@@ -16,12 +16,159 @@
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/magic.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <linux/mtd/mtd.h>
 #include <linux/mtd/partitions.h>
 #include <linux/byteorder/generic.h>
 
 #include "mtdsplit.h"
 
+/*
+ * The firmware parsers are tried one after the other on the same partition
+ * and most of them look for their header at every eraseblock. Keep the
+ * first bytes of each eraseblock of the partition being split, so that the
+ * parsers share a single read per eraseblock. The cache is only used while
+ * the built-in drivers are probed, it is dropped after that, or as soon as
+ * the partition it belongs to is removed. The length covers the largest
+ * header read by a parser (TP-Link, 512 bytes).
+ */
+#define MTDSPLIT_HEAD_LEN	512
+
+static DEFINE_MUTEX(mtdsplit_heads_lock);
+static struct mtd_info *mtdsplit_heads_mtd;
+static uint64_t mtdsplit_heads_size;
+static unsigned int mtdsplit_heads_nr;
+static u_char *mtdsplit_heads;
+static unsigned long *mtdsplit_heads_valid;
+static bool mtdsplit_heads_disabled;
+
+/* Flash offset of the rootfs as passed by the bootloader, 0 if unknown */
+static unsigned long rootfs_offset;
+module_param(rootfs_offset, ulong, 0444);
+MODULE_PARM_DESC(rootfs_offset, "Expected flash offset of the rootfs");
+
+static void mtdsplit_free_heads(void)
+{
+	vfree(mtdsplit_heads);
+	kfree(mtdsplit_heads_valid);
+	mtdsplit_heads = NULL;
+	mtdsplit_heads_valid = NULL;
+	mtdsplit_heads_mtd = NULL;
+	mtdsplit_heads_nr = 0;
+}
+
+static u_char *mtdsplit_get_head(struct mtd_info *mtd, size_t offset)
+{
+	unsigned int eb;
+	size_t retlen;
+	u_char *head;
+	int ret;
+
+	if (mtdsplit_heads_disabled)
+		return NULL;
+
+	if (mtd != mtdsplit_heads_mtd || mtd->size != mtdsplit_heads_size) {
+		unsigned int nr = mtd_div_by_eb(mtd->size, mtd);
+
+		mtdsplit_free_heads();
+		mtdsplit_heads = vmalloc(nr * MTDSPLIT_HEAD_LEN);
+		mtdsplit_heads_valid = kcalloc(BITS_TO_LONGS(nr),
+					       sizeof(unsigned long),
+					       GFP_KERNEL);
+		if (!mtdsplit_heads || !mtdsplit_heads_valid) {
+			mtdsplit_free_heads();
+			return NULL;
+		}
+
+		mtdsplit_heads_mtd = mtd;
+		mtdsplit_heads_size = mtd->size;
+		mtdsplit_heads_nr = nr;
+	}
+
+	eb = mtd_div_by_eb(offset, mtd);
+	if (eb >= mtdsplit_heads_nr)
+		return NULL;
+
+	head = mtdsplit_heads + eb * MTDSPLIT_HEAD_LEN;
+	if (!test_bit(eb, mtdsplit_heads_valid)) {
+		ret = mtd_read(mtd, offset, MTDSPLIT_HEAD_LEN, &retlen, head);
+		if (ret || retlen != MTDSPLIT_HEAD_LEN)
+			return NULL;
+
+		set_bit(eb, mtdsplit_heads_valid);
+	}
+
+	return head;
+}
+
+static void mtdsplit_notify_add(struct mtd_info *mtd)
+{
+}
+
+static void mtdsplit_notify_remove(struct mtd_info *mtd)
+{
+	mutex_lock(&mtdsplit_heads_lock);
+	if (mtd == mtdsplit_heads_mtd)
+		mtdsplit_free_heads();
+	mutex_unlock(&mtdsplit_heads_lock);
+}
+
+static struct mtd_notifier mtdsplit_notifier = {
+	.add	= mtdsplit_notify_add,
+	.remove	= mtdsplit_notify_remove,
+};
+
+int mtd_read_head(struct mtd_info *mtd, size_t offset, size_t len, void *buf)
+{
+	u_char *head = NULL;
+	size_t retlen;
+	int ret;
+
+	if (len <= MTDSPLIT_HEAD_LEN && !mtd_mod_by_eb(offset, mtd)) {
+		mutex_lock(&mtdsplit_heads_lock);
+		head = mtdsplit_get_head(mtd, offset);
+		if (head)
+			memcpy(buf, head, len);
+		mutex_unlock(&mtdsplit_heads_lock);
+	}
+
+	if (head)
+		return 0;
+
+	ret = mtd_read(mtd, offset, len, &retlen, buf);
+	if (ret)
+		return ret;
+
+	if (retlen != len)
+		return -EIO;
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(mtd_read_head);
+
+static int __init mtdsplit_init_heads(void)
+{
+	register_mtd_user(&mtdsplit_notifier);
+	return 0;
+}
+subsys_initcall(mtdsplit_init_heads);
+
+static int __init mtdsplit_drop_heads(void)
+{
+	unregister_mtd_user(&mtdsplit_notifier);
+
+	mutex_lock(&mtdsplit_heads_lock);
+	mtdsplit_heads_disabled = true;
+	mtdsplit_free_heads();
+	mutex_unlock(&mtdsplit_heads_lock);
+
+	return 0;
+}
+late_initcall_sync(mtdsplit_drop_heads);
+
 struct squashfs_super_block {
 	__le32 s_magic;
 	__le32 pad0[9];
@@ -36,8 +183,8 @@ int mtd_get_squashfs_len(struct mtd_info *master,
 	size_t retlen;
 	int err;
 
-	err = mtd_read(master, offset, sizeof(sb), &retlen, (void *)&sb);
-	if (err || (retlen != sizeof(sb))) {
+	err = mtd_read_head(master, offset, sizeof(sb), &sb);
+	if (err) {
 		pr_alert("error occured while reading from \"%s\"\n",
 			 master->name);
 		return -EIO;
@@ -73,17 +220,12 @@ static ssize_t mtd_next_eb(struct mtd_info *mtd, size_t offset)
 int mtd_check_rootfs_magic(struct mtd_info *mtd, size_t offset)
 {
 	u32 magic;
-	size_t retlen;
 	int ret;
 
-	ret = mtd_read(mtd, offset, sizeof(magic), &retlen,
-		       (unsigned char *) &magic);
+	ret = mtd_read_head(mtd, offset, sizeof(magic), &magic);
 	if (ret)
 		return ret;
 
-	if (retlen != sizeof(magic))
-		return -EIO;
-
 	if (le32_to_cpu(magic) != SQUASHFS_MAGIC &&
 	    magic != 0x19852003)
 		return -EINVAL;
@@ -97,9 +239,20 @@ int mtd_find_rootfs_from(struct mtd_info *mtd,
 			 size_t limit,
 			 size_t *ret_offset)
 {
+	uint64_t part_offset = mtdpart_get_offset(mtd);
 	size_t offset;
 	int err;
 
+	/* Try the offset given by the bootloader before searching */
+	if (rootfs_offset && rootfs_offset >= part_offset) {
+		offset = rootfs_offset - part_offset;
+		if (offset >= from && offset < limit &&
+		    !mtd_check_rootfs_magic(mtd, offset)) {
+			*ret_offset = offset;
+			return 0;
+		}
+	}
+
 	for (offset = from; offset < limit;
 	     offset = mtd_next_eb(mtd, offset)) {
 		err = mtd_check_rootfs_magic(mtd, offset);
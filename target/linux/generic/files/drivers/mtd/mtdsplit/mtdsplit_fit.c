@@ -49,7 +49,7 @@ mtdsplit_fit_parse(struct mtd_info *mtd, struct mtd_partition **pparts,
 	           struct mtd_part_parser_data *data)
 {
 	struct fdt_header hdr;
-	size_t hdr_len, retlen;
+	size_t hdr_len;
 	size_t offset;
 	size_t fit_offset, fit_size;
 	size_t rootfs_offset, rootfs_size;
@@ -60,18 +60,13 @@ mtdsplit_fit_parse(struct mtd_info *mtd, struct mtd_partition **pparts,
 
 	/* Parse the MTD device & search for the FIT image location */
 	for(offset = 0; offset < mtd->size; offset += mtd->erasesize) {
-		ret = mtd_read(mtd, 0, hdr_len, &retlen, (void*) &hdr);
+		ret = mtd_read_head(mtd, offset, hdr_len, &hdr);
 		if (ret) {
 			pr_err("read error in \"%s\" at offset 0x%llx\n",
 			       mtd->name, (unsigned long long) offset);
 			return ret;
 		}
 
-		if (retlen != hdr_len) {
-			pr_err("short read in \"%s\"\n", mtd->name);
-			return -EIO;
-		}
-
 		/* Check the magic - see if this is a FIT image */
 		if (be32_to_cpu(hdr.magic) != OF_DT_HEADER) {
 			pr_debug("no valid FIT image found in \"%s\" at offset %llx\n",
@@ -83,6 +78,9 @@ mtdsplit_fit_parse(struct mtd_info *mtd, struct mtd_partition **pparts,
 		break;
 	}
 
+	if (offset >= mtd->size)
+		return -ENODEV;
+
 	fit_offset = offset;
 	fit_size = be32_to_cpu(hdr.totalsize);
 
@@ -352,6 +352,9 @@ int yaffs_check_alloc_available(struct yaffs_dev *dev, int n_chunks)
 	reserved_chunks =
 	    (reserved_blocks + checkpt_blocks) * dev->param.chunks_per_block;
 
+	/* Dirty cache chunks are flushed from the reserve, keep room for them */
+	reserved_chunks += dev->n_dirty_caches;
+
 	return (dev->n_free_chunks > (reserved_chunks + n_chunks));
 }
 
@@ -721,6 +724,141 @@ static u16 yaffs_calc_name_sum(const YCHAR *name)
 	return sum;
 }
 
+/*
+ * Directory name index.
+ *
+ * Directories that are searched past YAFFS_DIR_INDEX_MIN entries get a hash
+ * table of their children keyed by name sum, so that lookups only compare
+ * names of objects with the same sum. Objects that are found by a special
+ * name or whose sum is not known yet (not lazy-loaded, no header) are kept
+ * on the unsorted list, which is always searched. The index only lives in
+ * memory.
+ */
+
+static inline struct list_head *yaffs_dir_index_bucket(
+					struct yaffs_dir_index *index, u16 sum)
+{
+	return &index->buckets[sum & (index->n_buckets - 1)];
+}
+
+static int yaffs_dir_index_sorted(struct yaffs_obj *obj)
+{
+	return obj->hdr_chunk > 0 && !obj->lazy_loaded &&
+	    obj->obj_id != YAFFS_OBJECTID_LOSTNFOUND;
+}
+
+static void yaffs_dir_index_free(struct yaffs_obj *directory)
+{
+	struct yaffs_dir_index *index = directory->variant.dir_variant.index;
+	struct list_head *lh;
+
+	if (!index)
+		return;
+
+	list_for_each(lh, &directory->variant.dir_variant.children)
+		INIT_LIST_HEAD(&list_entry(lh, struct yaffs_obj,
+					   siblings)->name_link);
+
+	directory->variant.dir_variant.index = NULL;
+	kfree(index);
+}
+
+static void yaffs_dir_index_insert(struct yaffs_obj *directory,
+				   struct yaffs_obj *obj)
+{
+	struct yaffs_dir_index *index = directory->variant.dir_variant.index;
+
+	if (!index)
+		return;
+
+	if (yaffs_dir_index_sorted(obj))
+		list_add(&obj->name_link,
+			 yaffs_dir_index_bucket(index, obj->sum));
+	else
+		list_add(&obj->name_link, &index->unsorted);
+	index->n_entries++;
+}
+
+static void yaffs_dir_index_remove(struct yaffs_obj *directory,
+				   struct yaffs_obj *obj)
+{
+	if (list_empty(&obj->name_link))
+		return;
+
+	list_del_init(&obj->name_link);
+	if (directory && directory->variant.dir_variant.index)
+		directory->variant.dir_variant.index->n_entries--;
+}
+
+/* Move an indexed object to the list matching its current sum and header */
+static void yaffs_dir_index_rehash(struct yaffs_obj *obj)
+{
+	if (list_empty(&obj->name_link))
+		return;
+
+	yaffs_dir_index_remove(obj->parent, obj);
+	yaffs_dir_index_insert(obj->parent, obj);
+}
+
+static void yaffs_dir_index_build(struct yaffs_obj *directory)
+{
+	struct yaffs_dir_index *index;
+	struct list_head *lh;
+	int n_entries = 0;
+	int n_buckets = 16;
+	int i;
+
+	list_for_each(lh, &directory->variant.dir_variant.children)
+		n_entries++;
+
+	while (n_buckets < n_entries / 4 &&
+	       n_buckets < YAFFS_DIR_INDEX_MAX_BUCKETS)
+		n_buckets <<= 1;
+
+	yaffs_dir_index_free(directory);
+
+	index = kmalloc(sizeof(*index) + n_buckets * sizeof(struct list_head),
+			GFP_NOFS);
+	if (!index)
+		return;	/* Not fatal, lookups just stay linear */
+
+	index->n_buckets = n_buckets;
+	index->n_entries = 0;
+	INIT_LIST_HEAD(&index->unsorted);
+	for (i = 0; i < n_buckets; i++)
+		INIT_LIST_HEAD(&index->buckets[i]);
+
+	directory->variant.dir_variant.index = index;
+
+	list_for_each(lh, &directory->variant.dir_variant.children)
+		yaffs_dir_index_insert(directory,
+				       list_entry(lh, struct yaffs_obj,
+						  siblings));
+
+	yaffs_trace(YAFFS_TRACE_OS,
+		"dir %d: indexed %d entries in %d buckets",
+		directory->obj_id, index->n_entries, n_buckets);
+}
+
+/*
+ * Add a new child to the index, keeping the chains short as the directory
+ * grows. Only called when a child is added, never while the index is being
+ * built or walked.
+ */
+static void yaffs_dir_index_add(struct yaffs_obj *directory,
+				struct yaffs_obj *obj)
+{
+	struct yaffs_dir_index *index = directory->variant.dir_variant.index;
+
+	if (!index)
+		return;
+
+	yaffs_dir_index_insert(directory, obj);
+
+	if (index->n_entries > 8 * index->n_buckets &&
+	    index->n_buckets < YAFFS_DIR_INDEX_MAX_BUCKETS)
+		yaffs_dir_index_build(directory);
+}
 
 void yaffs_set_obj_name(struct yaffs_obj *obj, const YCHAR * name)
 {
@@ -737,6 +875,9 @@ void yaffs_set_obj_name(struct yaffs_obj *obj, const YCHAR * name)
 	}
 
 	obj->sum = yaffs_calc_name_sum(name);
+
+	/* The name sum may have changed, rehash in the parent's index */
+	yaffs_dir_index_rehash(obj);
 }
 
 void yaffs_set_obj_name_from_oh(struct yaffs_obj *obj,
@@ -792,6 +933,21 @@ static void yaffs_free_tnode(struct yaffs_dev *dev, struct yaffs_tnode *tn)
 
 static void yaffs_deinit_tnodes_and_objs(struct yaffs_dev *dev)
 {
+	struct yaffs_obj *obj;
+	struct list_head *lh;
+	int i;
+
+	/* Directory indices are the only memory objects own */
+	for (i = 0; i < YAFFS_NOBJECT_BUCKETS; i++) {
+		list_for_each(lh, &dev->obj_bucket[i].list) {
+			obj = list_entry(lh, struct yaffs_obj, hash_link);
+			if (obj->variant_type == YAFFS_OBJECT_TYPE_DIRECTORY) {
+				kfree(obj->variant.dir_variant.index);
+				obj->variant.dir_variant.index = NULL;
+			}
+		}
+	}
+
 	yaffs_deinit_raw_tnodes_and_objs(dev);
 	dev->n_obj = 0;
 	dev->n_tnodes = 0;
@@ -1328,6 +1484,7 @@ static void yaffs_remove_obj_from_dir(struct yaffs_obj *obj)
 		dev->param.remove_obj_fn(obj);
 
 	list_del_init(&obj->siblings);
+	yaffs_dir_index_remove(parent, obj);
 	obj->parent = NULL;
 
 	yaffs_verify_dir(parent);
@@ -1361,6 +1518,7 @@ void yaffs_add_obj_to_dir(struct yaffs_obj *directory, struct yaffs_obj *obj)
 	/* Now add it */
 	list_add(&obj->siblings, &directory->variant.dir_variant.children);
 	obj->parent = directory;
+	yaffs_dir_index_add(directory, obj);
 
 	if (directory == obj->my_dev->unlinked_dir
 	    || directory == obj->my_dev->del_dir) {
@@ -1429,19 +1587,61 @@ static int yaffs_change_obj_name(struct yaffs_obj *obj,
  *   In Linux, the page cache provides read buffering and the short op cache
  *   provides write buffering.
  *
- *   There are a small number (~10) of cache chunks per device so that we don't
- *   need a very intelligent search.
+ *   Cache chunks in use are hashed by (object, chunk_id) and kept on an LRU
+ *   list with the most recently used chunk first. Unused cache chunks live
+ *   on a free list. This keeps lookups cheap for large caches, which help
+ *   when many files are appended to at the same time.
  */
 
+static void yaffs_cache_set_dirty(struct yaffs_dev *dev,
+				  struct yaffs_cache *cache, int dirty)
+{
+	if (cache->dirty != dirty)
+		dev->n_dirty_caches += dirty ? 1 : -1;
+	cache->dirty = dirty;
+}
+
+static struct list_head *yaffs_cache_bucket(struct yaffs_dev *dev,
+					    const struct yaffs_obj *obj,
+					    int chunk_id)
+{
+	return &dev->cache_hash[(obj->obj_id * 31 + chunk_id) &
+				dev->cache_hash_mask];
+}
+
+/* Attach a free cache chunk to an object chunk */
+static void yaffs_cache_attach(struct yaffs_dev *dev, struct yaffs_cache *cache,
+			       struct yaffs_obj *obj, int chunk_id)
+{
+	cache->object = obj;
+	cache->chunk_id = chunk_id;
+	yaffs_cache_set_dirty(dev, cache, 0);
+	cache->locked = 0;
+	cache->n_bytes = 0;
+	list_add(&cache->hash_link, yaffs_cache_bucket(dev, obj, chunk_id));
+	list_move(&cache->lru, &dev->cache_lru);
+}
+
+/* Drop the contents of a cache chunk and return it to the free list */
+static void yaffs_cache_detach(struct yaffs_dev *dev, struct yaffs_cache *cache)
+{
+	cache->object = NULL;
+	yaffs_cache_set_dirty(dev, cache, 0);
+	list_del_init(&cache->hash_link);
+	list_move(&cache->lru, &dev->cache_free);
+}
+
 static int yaffs_obj_cache_dirty(struct yaffs_obj *obj)
 {
 	struct yaffs_dev *dev = obj->my_dev;
-	int i;
+	struct list_head *i;
 	struct yaffs_cache *cache;
-	int n_caches = obj->my_dev->param.n_caches;
 
-	for (i = 0; i < n_caches; i++) {
-		cache = &dev->cache[i];
+	if (dev->param.n_caches < 1)
+		return 0;
+
+	list_for_each(i, &dev->cache_lru) {
+		cache = list_entry(i, struct yaffs_cache, lru);
 		if (cache->object == obj && cache->dirty)
 			return 1;
 	}
@@ -1451,10 +1651,13 @@ static int yaffs_obj_cache_dirty(struct yaffs_obj *obj)
 
 static void yaffs_flush_single_cache(struct yaffs_cache *cache, int discard)
 {
+	struct yaffs_dev *dev;
 
-	if (!cache || cache->locked)
+	if (!cache || cache->locked || !cache->object)
 		return;
 
+	dev = cache->object->my_dev;
+
 	/* Write it out and free it up  if need be.*/
 	if (cache->dirty) {
 		yaffs_wr_data_obj(cache->object,
@@ -1463,115 +1666,119 @@ static void yaffs_flush_single_cache(struct yaffs_cache *cache, int discard)
 				  cache->n_bytes,
 				  1);
 
-		cache->dirty = 0;
+		yaffs_cache_set_dirty(dev, cache, 0);
 	}
 
 	if (discard)
-		cache->object = NULL;
+		yaffs_cache_detach(dev, cache);
 }
 
 static void yaffs_flush_file_cache(struct yaffs_obj *obj, int discard)
 {
 	struct yaffs_dev *dev = obj->my_dev;
-	int i;
+	struct list_head *i;
 	struct yaffs_cache *cache;
-	int n_caches = obj->my_dev->param.n_caches;
 
-	if (n_caches < 1)
+	if (dev->param.n_caches < 1)
 		return;
 
-
-	/* Find the chunks for this object and flush them. */
-	for (i = 0; i < n_caches; i++) {
-		cache = &dev->cache[i];
-		if (cache->object == obj)
-			yaffs_flush_single_cache(cache, discard);
-	}
-
+	/* Find the cache chunks for this object and flush them.
+	 * Writing a chunk can run garbage collection, which may drop
+	 * other cache chunks, so rescan the list after every flush.
+	 */
+	do {
+		cache = NULL;
+		list_for_each(i, &dev->cache_lru) {
+			cache = list_entry(i, struct yaffs_cache, lru);
+			if (cache->object == obj && !cache->locked &&
+			    (cache->dirty || discard))
+				break;
+			cache = NULL;
+		}
+		yaffs_flush_single_cache(cache, discard);
+	} while (cache);
 }
 
-
 void yaffs_flush_whole_cache(struct yaffs_dev *dev, int discard)
 {
 	struct yaffs_obj *obj;
-	int n_caches = dev->param.n_caches;
-	int i;
+	struct list_head *i;
+	struct yaffs_cache *cache;
+
+	if (dev->param.n_caches < 1)
+		return;
 
 	/* Find a dirty object in the cache and flush it...
 	 * until there are no further dirty objects.
 	 */
 	do {
 		obj = NULL;
-		for (i = 0; i < n_caches && !obj; i++) {
-			if (dev->cache[i].object && dev->cache[i].dirty)
-				obj = dev->cache[i].object;
+		list_for_each(i, &dev->cache_lru) {
+			cache = list_entry(i, struct yaffs_cache, lru);
+			if (cache->dirty && !cache->locked) {
+				obj = cache->object;
+				break;
+			}
 		}
 		if (obj)
 			yaffs_flush_file_cache(obj, discard);
 	} while (obj);
-
 }
 
-/* Grab us an unused cache chunk for use.
- * First look for an empty one.
- * Then look for the least recently used non-dirty one.
- * Then look for the least recently used dirty one...., flush and look again.
+/* Grab us a cache chunk for the given object chunk.
+ * Use an unused one if possible, otherwise push out the least recently
+ * used one, writing it out if it is dirty.
  */
-static struct yaffs_cache *yaffs_grab_chunk_worker(struct yaffs_dev *dev)
+static struct yaffs_cache *yaffs_grab_chunk_cache(struct yaffs_dev *dev,
+						  struct yaffs_obj *obj,
+						  int chunk_id)
 {
-	int i;
+	struct list_head *i;
+	struct yaffs_cache *cache;
 
-	if (dev->param.n_caches > 0) {
-		for (i = 0; i < dev->param.n_caches; i++) {
-			if (!dev->cache[i].object)
-				return &dev->cache[i];
+	if (dev->param.n_caches < 1)
+		return NULL;
+
+	if (list_empty(&dev->cache_free)) {
+		cache = NULL;
+		for (i = dev->cache_lru.prev; i != &dev->cache_lru;
+		     i = i->prev) {
+			cache = list_entry(i, struct yaffs_cache, lru);
+			if (!cache->locked)
+				break;
+			cache = NULL;
 		}
+		if (!cache)
+			return NULL;
+
+		yaffs_flush_single_cache(cache, 1);
 	}
 
-	return NULL;
+	if (list_empty(&dev->cache_free))
+		return NULL;
+
+	cache = list_entry(dev->cache_free.next, struct yaffs_cache, lru);
+	yaffs_cache_attach(dev, cache, obj, chunk_id);
+
+	return cache;
 }
 
-static struct yaffs_cache *yaffs_grab_chunk_cache(struct yaffs_dev *dev)
+static struct yaffs_cache *yaffs_lookup_chunk_cache(const struct yaffs_obj *obj,
+						    int chunk_id)
 {
+	struct yaffs_dev *dev = obj->my_dev;
+	struct list_head *i;
 	struct yaffs_cache *cache;
-	int usage;
-	int i;
 
 	if (dev->param.n_caches < 1)
 		return NULL;
 
-	/* First look for an unused cache */
-
-	cache = yaffs_grab_chunk_worker(dev);
-
-	if (cache)
-		return cache;
-
-	/*
-	 * Thery were all in use.
-	 * Find the LRU cache and flush it if it is dirty.
-	 */
-
-	usage = -1;
-	cache = NULL;
-
-	for (i = 0; i < dev->param.n_caches; i++) {
-		if (dev->cache[i].object &&
-		    !dev->cache[i].locked &&
-		    (dev->cache[i].last_use < usage || !cache)) {
-				usage = dev->cache[i].last_use;
-				cache = &dev->cache[i];
-		}
+	list_for_each(i, yaffs_cache_bucket(dev, obj, chunk_id)) {
+		cache = list_entry(i, struct yaffs_cache, hash_link);
+		if (cache->object == obj && cache->chunk_id == chunk_id)
+			return cache;
 	}
-
-#if 1
-	yaffs_flush_single_cache(cache, 1);
-#else
-	yaffs_flush_file_cache(cache->object, 1);
-	cache = yaffs_grab_chunk_worker(dev);
-#endif
-
-	return cache;
+	return NULL;
 }
 
 /* Find a cached chunk */
@@ -1579,44 +1786,31 @@ static struct yaffs_cache *yaffs_find_chunk_cache(const struct yaffs_obj *obj,
 						  int chunk_id)
 {
 	struct yaffs_dev *dev = obj->my_dev;
-	int i;
+	struct yaffs_cache *cache;
 
 	if (dev->param.n_caches < 1)
 		return NULL;
 
-	for (i = 0; i < dev->param.n_caches; i++) {
-		if (dev->cache[i].object == obj &&
-		    dev->cache[i].chunk_id == chunk_id) {
-			dev->cache_hits++;
+	cache = yaffs_lookup_chunk_cache(obj, chunk_id);
+	if (cache)
+		dev->cache_hits++;
+	else
+		dev->cache_misses++;
 
-			return &dev->cache[i];
-		}
-	}
-	return NULL;
+	return cache;
 }
 
 /* Mark the chunk for the least recently used algorithym */
 static void yaffs_use_cache(struct yaffs_dev *dev, struct yaffs_cache *cache,
 			    int is_write)
 {
-	int i;
-
 	if (dev->param.n_caches < 1)
 		return;
 
-	if (dev->cache_last_use < 0 ||
-		dev->cache_last_use > 100000000) {
-		/* Reset the cache usages */
-		for (i = 1; i < dev->param.n_caches; i++)
-			dev->cache[i].last_use = 0;
-
-		dev->cache_last_use = 0;
-	}
-	dev->cache_last_use++;
-	cache->last_use = dev->cache_last_use;
+	list_move(&cache->lru, &dev->cache_lru);
 
 	if (is_write)
-		cache->dirty = 1;
+		yaffs_cache_set_dirty(dev, cache, 1);
 }
 
 /* Invalidate a single cache page.
@@ -1628,10 +1822,10 @@ static void yaffs_invalidate_chunk_cache(struct yaffs_obj *object, int chunk_id)
 	struct yaffs_cache *cache;
 
 	if (object->my_dev->param.n_caches > 0) {
-		cache = yaffs_find_chunk_cache(object, chunk_id);
+		cache = yaffs_lookup_chunk_cache(object, chunk_id);
 
 		if (cache)
-			cache->object = NULL;
+			yaffs_cache_detach(object->my_dev, cache);
 	}
 }
 
@@ -1640,14 +1834,17 @@ static void yaffs_invalidate_chunk_cache(struct yaffs_obj *object, int chunk_id)
  */
 static void yaffs_invalidate_whole_cache(struct yaffs_obj *in)
 {
-	int i;
 	struct yaffs_dev *dev = in->my_dev;
+	struct list_head *i;
+	struct list_head *n;
+	struct yaffs_cache *cache;
 
 	if (dev->param.n_caches > 0) {
 		/* Invalidate it. */
-		for (i = 0; i < dev->param.n_caches; i++) {
-			if (dev->cache[i].object == in)
-				dev->cache[i].object = NULL;
+		list_for_each_safe(i, n, &dev->cache_lru) {
+			cache = list_entry(i, struct yaffs_cache, lru);
+			if (cache->object == in)
+				yaffs_cache_detach(dev, cache);
 		}
 	}
 }
@@ -1690,6 +1887,9 @@ static void yaffs_free_obj(struct yaffs_obj *obj)
 		return;
 	}
 
+	if (obj->variant_type == YAFFS_OBJECT_TYPE_DIRECTORY)
+		yaffs_dir_index_free(obj);
+
 	yaffs_unhash_obj(obj);
 
 	yaffs_free_raw_obj(dev, obj);
@@ -1871,12 +2071,14 @@ static struct yaffs_obj *yaffs_alloc_empty_obj(struct yaffs_dev *dev)
 	INIT_LIST_HEAD(&(obj->hard_links));
 	INIT_LIST_HEAD(&(obj->hash_link));
 	INIT_LIST_HEAD(&obj->siblings);
+	INIT_LIST_HEAD(&obj->name_link);
 
 	/* Now make the directory sane */
 	if (dev->root_dir) {
 		obj->parent = dev->root_dir;
 		list_add(&(obj->siblings),
 			 &dev->root_dir->variant.dir_variant.children);
+		yaffs_dir_index_add(dev->root_dir, obj);
 	}
 
 	/* Add it to the lost and found directory.
@@ -3377,6 +3579,10 @@ int yaffs_update_oh(struct yaffs_obj *in, const YCHAR *name, int force,
 
 	in->hdr_chunk = new_chunk_id;
 
+	/* An object written for the first time now has a usable name sum */
+	if (prev_chunk_id <= 0)
+		yaffs_dir_index_rehash(in);
+
 	if (prev_chunk_id > 0)
 		yaffs_chunk_del(dev, prev_chunk_id, 1, __LINE__);
 
@@ -3444,15 +3650,10 @@ int yaffs_file_rd(struct yaffs_obj *in, u8 * buffer, loff_t offset, int n_bytes)
 				 * then load it up. */
 
 				if (!cache) {
-					cache =
-					    yaffs_grab_chunk_cache(in->my_dev);
-					cache->object = in;
-					cache->chunk_id = chunk;
-					cache->dirty = 0;
-					cache->locked = 0;
+					cache = yaffs_grab_chunk_cache(dev, in,
+								       chunk);
 					yaffs_rd_data_obj(in, chunk,
 							  cache->data);
-					cache->n_bytes = 0;
 				}
 
 				yaffs_use_cache(dev, cache, 0);
@@ -3571,13 +3772,11 @@ int yaffs_do_file_wr(struct yaffs_obj *in, const u8 *buffer, loff_t offset,
 
 				if (!cache &&
 				    yaffs_check_alloc_available(dev, 1)) {
-					cache = yaffs_grab_chunk_cache(dev);
-					cache->object = in;
-					cache->chunk_id = chunk;
-					cache->dirty = 0;
-					cache->locked = 0;
-					yaffs_rd_data_obj(in, chunk,
-							  cache->data);
+					cache = yaffs_grab_chunk_cache(dev, in,
+								       chunk);
+					if (cache)
+						yaffs_rd_data_obj(in, chunk,
+								  cache->data);
 				} else if (cache &&
 					   !cache->dirty &&
 					   !yaffs_check_alloc_available(dev,
@@ -3606,7 +3805,8 @@ int yaffs_do_file_wr(struct yaffs_obj *in, const u8 *buffer, loff_t offset,
 						     cache->chunk_id,
 						     cache->data,
 						     cache->n_bytes, 1);
-						cache->dirty = 0;
+						yaffs_cache_set_dirty(dev,
+								      cache, 0);
 					}
 				} else {
 					chunk_written = -1;	/* fail write */
@@ -3968,6 +4168,7 @@ struct yaffs_obj *yaffs_retype_obj(struct yaffs_obj *obj,
 	case YAFFS_OBJECT_TYPE_DIRECTORY:
 		/* Put the children in lost and found. */
 		yaffs_empty_dir_to_dir(obj, obj->my_dev->lost_n_found);
+		yaffs_dir_index_free(obj);
 		if (!list_empty(&obj->variant.dir_variant.dirty))
 			list_del_init(&obj->variant.dir_variant.dirty);
 		break;
@@ -4372,13 +4573,67 @@ static void yaffs_empty_l_n_f(struct yaffs_dev *dev)
 }
 
 
+/* Check whether a child of a directory goes by the given name */
+static int yaffs_child_has_name(struct yaffs_obj *directory,
+				struct yaffs_obj *l, const YCHAR *name,
+				u16 sum, YCHAR *buffer)
+{
+	if (l->parent != directory)
+		BUG();
+
+	yaffs_check_obj_details_loaded(l);
+
+	/* Special case for lost-n-found */
+	if (l->obj_id == YAFFS_OBJECTID_LOSTNFOUND) {
+		if (!strcmp(name, YAFFS_LOSTNFOUND_NAME))
+			return 1;
+	} else if (l->sum == sum || l->hdr_chunk <= 0) {
+		/* LostnFound chunk called Objxxx
+		 * Do a real check
+		 */
+		yaffs_get_obj_name(l, buffer,
+			YAFFS_MAX_NAME_LENGTH + 1);
+		if (!strncmp(name, buffer, YAFFS_MAX_NAME_LENGTH))
+			return 1;
+	}
+	return 0;
+}
+
+static struct yaffs_obj *yaffs_find_in_index(struct yaffs_obj *directory,
+					     const YCHAR *name, u16 sum,
+					     YCHAR *buffer)
+{
+	struct yaffs_dir_index *index = directory->variant.dir_variant.index;
+	struct list_head *i;
+	struct list_head *n;
+	struct yaffs_obj *l;
+
+	/* Loading an object's details may move it to a bucket, hence _safe */
+	list_for_each_safe(i, n, yaffs_dir_index_bucket(index, sum)) {
+		l = list_entry(i, struct yaffs_obj, name_link);
+		if (l->sum == sum &&
+		    yaffs_child_has_name(directory, l, name, sum, buffer))
+			return l;
+	}
+
+	list_for_each_safe(i, n, &index->unsorted) {
+		l = list_entry(i, struct yaffs_obj, name_link);
+		if (yaffs_child_has_name(directory, l, name, sum, buffer))
+			return l;
+	}
+	return NULL;
+}
+
 struct yaffs_obj *yaffs_find_by_name(struct yaffs_obj *directory,
 				     const YCHAR *name)
 {
-	int sum;
+	u16 sum;
 	struct list_head *i;
 	YCHAR buffer[YAFFS_MAX_NAME_LENGTH + 1];
 	struct yaffs_obj *l;
+	struct yaffs_obj *found = NULL;
+	struct yaffs_dev *dev;
+	int n_searched = 0;
 
 	if (!name)
 		return NULL;
@@ -4399,29 +4654,29 @@ struct yaffs_obj *yaffs_find_by_name(struct yaffs_obj *directory,
 
 	sum = yaffs_calc_name_sum(name);
 
+	if (directory->variant.dir_variant.index)
+		return yaffs_find_in_index(directory, name, sum, buffer);
+
 	list_for_each(i, &directory->variant.dir_variant.children) {
 		l = list_entry(i, struct yaffs_obj, siblings);
+		n_searched++;
 
-		if (l->parent != directory)
-			BUG();
-
-		yaffs_check_obj_details_loaded(l);
-
-		/* Special case for lost-n-found */
-		if (l->obj_id == YAFFS_OBJECTID_LOSTNFOUND) {
-			if (!strcmp(name, YAFFS_LOSTNFOUND_NAME))
-				return l;
-		} else if (l->sum == sum || l->hdr_chunk <= 0) {
-			/* LostnFound chunk called Objxxx
-			 * Do a real check
-			 */
-			yaffs_get_obj_name(l, buffer,
-				YAFFS_MAX_NAME_LENGTH + 1);
-			if (!strncmp(name, buffer, YAFFS_MAX_NAME_LENGTH))
-				return l;
+		if (yaffs_child_has_name(directory, l, name, sum, buffer)) {
+			found = l;
+			break;
 		}
 	}
-	return NULL;
+
+	/* That was a long walk, index the directory for next time. The
+	 * unlinked and deleted directories may hold duplicate names.
+	 */
+	dev = directory->my_dev;
+	if (n_searched >= YAFFS_DIR_INDEX_MIN &&
+	    !dev->param.disable_dir_index &&
+	    directory != dev->unlinked_dir && directory != dev->del_dir)
+		yaffs_dir_index_build(directory);
+
+	return found;
 }
 
 /* GetEquivalentObject dereferences any hard links to get to the
@@ -4865,38 +5120,54 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 		init_failed = 1;
 
 	dev->cache = NULL;
+	dev->cache_hash = NULL;
+	dev->n_dirty_caches = 0;
 	dev->gc_cleanup_list = NULL;
 
 	if (!init_failed && dev->param.n_caches > 0) {
 		int i;
 		void *buf;
-		int cache_bytes =
-		    dev->param.n_caches * sizeof(struct yaffs_cache);
+		int cache_bytes;
+		int n_buckets = 16;
 
 		if (dev->param.n_caches > YAFFS_MAX_SHORT_OP_CACHES)
 			dev->param.n_caches = YAFFS_MAX_SHORT_OP_CACHES;
 
+		cache_bytes = dev->param.n_caches * sizeof(struct yaffs_cache);
+
+		while (n_buckets < dev->param.n_caches)
+			n_buckets <<= 1;
+		dev->cache_hash_mask = n_buckets - 1;
+		dev->cache_hash = kmalloc(n_buckets * sizeof(struct list_head),
+					  GFP_NOFS);
+
+		INIT_LIST_HEAD(&dev->cache_lru);
+		INIT_LIST_HEAD(&dev->cache_free);
+
 		dev->cache = kmalloc(cache_bytes, GFP_NOFS);
 
-		buf = (u8 *) dev->cache;
+		buf = dev->cache_hash ? (u8 *) dev->cache : NULL;
 
 		if (dev->cache)
 			memset(dev->cache, 0, cache_bytes);
 
+		for (i = 0; i < n_buckets && buf; i++)
+			INIT_LIST_HEAD(&dev->cache_hash[i]);
+
 		for (i = 0; i < dev->param.n_caches && buf; i++) {
 			dev->cache[i].object = NULL;
-			dev->cache[i].last_use = 0;
 			dev->cache[i].dirty = 0;
+			INIT_LIST_HEAD(&dev->cache[i].hash_link);
+			list_add_tail(&dev->cache[i].lru, &dev->cache_free);
 			dev->cache[i].data = buf =
 			    kmalloc(dev->param.total_bytes_per_chunk, GFP_NOFS);
 		}
 		if (!buf)
 			init_failed = 1;
-
-		dev->cache_last_use = 0;
 	}
 
 	dev->cache_hits = 0;
+	dev->cache_misses = 0;
 
 	if (!init_failed) {
 		dev->gc_cleanup_list =
@@ -4918,7 +5189,6 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 		init_failed = 1;
 
 	if (!init_failed && dev->param.is_yaffs2 &&
-		!dev->param.disable_summary &&
 		!yaffs_summary_init(dev))
 		init_failed = 1;
 
@@ -5018,6 +5288,8 @@ void yaffs_deinitialise(struct yaffs_dev *dev)
 
 			kfree(dev->cache);
 			dev->cache = NULL;
+			kfree(dev->cache_hash);
+			dev->cache_hash = NULL;
 		}
 
 		kfree(dev->gc_cleanup_list);
@@ -5060,21 +5332,13 @@ int yaffs_get_n_free_chunks(struct yaffs_dev *dev)
 {
 	/* This is what we report to the outside world */
 	int n_free;
-	int n_dirty_caches;
 	int blocks_for_checkpt;
-	int i;
 
 	n_free = dev->n_free_chunks;
 	n_free += dev->n_deleted_files;
 
-	/* Now count and subtract the number of dirty chunks in the cache. */
-
-	for (n_dirty_caches = 0, i = 0; i < dev->param.n_caches; i++) {
-		if (dev->cache[i].dirty)
-			n_dirty_caches++;
-	}
-
-	n_free -= n_dirty_caches;
+	/* Subtract the number of dirty chunks in the cache. */
+	n_free -= dev->n_dirty_caches;
 
 	n_free -=
 	    ((dev->param.n_reserved_blocks + 1) * dev->param.chunks_per_block);
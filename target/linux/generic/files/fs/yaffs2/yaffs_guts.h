@@ -74,6 +74,10 @@
 
 #define YAFFS_NOBJECT_BUCKETS		256
 
+/* Directories searched past this many entries get a name index */
+#define YAFFS_DIR_INDEX_MIN		32
+#define YAFFS_DIR_INDEX_MAX_BUCKETS	1024
+
 #define YAFFS_OBJECT_SPACE		0x40000
 #define YAFFS_MAX_OBJECT_ID		(YAFFS_OBJECT_SPACE - 1)
 
@@ -104,7 +108,7 @@
 #define YAFFS_OBJECTID_CHECKPOINT_DATA	0x20
 #define YAFFS_SEQUENCE_CHECKPOINT_DATA	0x21
 
-#define YAFFS_MAX_SHORT_OP_CACHES	20
+#define YAFFS_MAX_SHORT_OP_CACHES	256
 
 #define YAFFS_N_TEMP_BUFFERS		6
 
@@ -131,11 +135,12 @@
 struct yaffs_cache {
 	struct yaffs_obj *object;
 	int chunk_id;
-	int last_use;
 	int dirty;
 	int n_bytes;		/* Only valid if the cache is dirty */
 	int locked;		/* Can't push out or flush while locked. */
 	u8 *data;
+	struct list_head hash_link;	/* Lookup by (object, chunk_id) */
+	struct list_head lru;	/* LRU list when in use, else free list */
 };
 
 /* yaffs1 tags structures in RAM
@@ -376,9 +381,18 @@ struct yaffs_file_var {
 	struct yaffs_tnode *top;
 };
 
+/* Name index of a large directory, objects are hashed by their name sum */
+struct yaffs_dir_index {
+	int n_buckets;		/* power of 2 */
+	int n_entries;
+	struct list_head unsorted;	/* objects without a usable name sum */
+	struct list_head buckets[];
+};
+
 struct yaffs_dir_var {
 	struct list_head children;	/* list of child links */
 	struct list_head dirty;	/* Entry for list of dirty directories */
+	struct yaffs_dir_index *index;	/* built on demand, may be NULL */
 };
 
 struct yaffs_symlink_var {
@@ -442,6 +456,7 @@ struct yaffs_obj {
 	/* also used for linking up the free list */
 	struct yaffs_obj *parent;
 	struct list_head siblings;
+	struct list_head name_link;	/* entry in the parent's name index */
 
 	/* Where's my object header in NAND? */
 	int hdr_chunk;
@@ -593,6 +608,7 @@ struct yaffs_param {
 
 	int disable_summary;
 	int disable_bad_block_marking;
+	int disable_dir_index;	/* Always search directories linearly */
 
 };
 
@@ -604,6 +620,10 @@ struct yaffs_driver {
 				   u8 *data, int data_len,
 				   u8 *oob, int oob_len,
 				   enum yaffs_ecc_result *ecc_result);
+	/* Optional: read the first oob_len bytes of the oob of n_chunks
+	 * consecutive chunks into oob, oob_len bytes per chunk. */
+	int (*drv_read_oob_fn) (struct yaffs_dev *dev, int nand_chunk,
+				int n_chunks, u8 *oob, int oob_len);
 	int (*drv_erase_fn) (struct yaffs_dev *dev, int block_no);
 	int (*drv_mark_bad_fn) (struct yaffs_dev *dev, int block_no);
 	int (*drv_check_bad_fn) (struct yaffs_dev *dev, int block_no);
@@ -618,6 +638,10 @@ struct yaffs_tags_handler {
 	int (*read_chunk_tags_fn) (struct yaffs_dev *dev,
 				   int nand_chunk, u8 *data,
 				   struct yaffs_ext_tags *tags);
+	/* Optional: read the tags of n_chunks consecutive chunks */
+	int (*read_tags_range_fn) (struct yaffs_dev *dev,
+				   int nand_chunk, int n_chunks,
+				   struct yaffs_ext_tags *tags);
 
 	int (*query_block_fn) (struct yaffs_dev *dev, int block_no,
 			       enum yaffs_block_state *state,
@@ -735,7 +759,11 @@ struct yaffs_dev {
 	int doing_buffered_block_rewrite;
 
 	struct yaffs_cache *cache;
-	int cache_last_use;
+	struct list_head *cache_hash;
+	int cache_hash_mask;
+	struct list_head cache_lru;	/* Most recently used first */
+	struct list_head cache_free;
+	int n_dirty_caches;	/* Chunks the caches still have to write */
 
 	/* Stuff for background deletion and unlinked files. */
 	struct yaffs_obj *unlinked_dir;	/* Directory where unlinked and deleted
@@ -795,6 +823,7 @@ struct yaffs_dev {
 	u32 n_unmarked_deletions;
 	u32 refresh_count;
 	u32 cache_hits;
+	u32 cache_misses;
 	u32 tags_used;
 	u32 summary_used;
 
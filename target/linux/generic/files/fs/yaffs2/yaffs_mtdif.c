@@ -170,6 +170,57 @@ static int yaffs_mtd_read(struct yaffs_dev *dev, int nand_chunk,
 	return YAFFS_OK;
 }
 
+/* Read the oob of a run of pages with a single MTD request. MTD packs the
+ * free oob bytes of all pages one after another, so pick out the first
+ * oob_len bytes of each page. Any error, including corrected bit flips, is
+ * reported as a failure so that the caller reads the pages one by one.
+ */
+static int yaffs_mtd_read_oob(struct yaffs_dev *dev, int nand_chunk,
+			      int n_chunks, u8 *oob, int oob_len)
+{
+	struct mtd_info *mtd = yaffs_dev_to_mtd(dev);
+	int avail = mtd->oobavail;
+	struct mtd_oob_ops ops;
+	loff_t addr;
+	u8 *buf = oob;
+	int retval;
+	int i;
+
+	if (oob_len > avail)
+		return YAFFS_FAIL;
+
+	if (oob_len != avail) {
+		buf = kmalloc(n_chunks * avail, GFP_NOFS);
+		if (!buf)
+			return YAFFS_FAIL;
+	}
+
+	addr = ((loff_t) nand_chunk) * dev->param.total_bytes_per_chunk;
+	memset(&ops, 0, sizeof(ops));
+	ops.mode = MTD_OPS_AUTO_OOB;
+	ops.ooblen = n_chunks * avail;
+	ops.oobbuf = buf;
+#if (MTD_VERSION_CODE < MTD_VERSION(2, 6, 20))
+	ops.len = ops.ooblen;
+#endif
+
+	retval = mtd_read_oob(mtd, addr, &ops);
+	if (retval || ops.oobretlen != ops.ooblen) {
+		yaffs_trace(YAFFS_TRACE_MTD,
+			"read_oob of %d chunks failed, chunk %d, mtd error %d",
+			n_chunks, nand_chunk, retval);
+		retval = -EIO;
+	}
+
+	if (buf != oob) {
+		for (i = 0; !retval && i < n_chunks; i++)
+			memcpy(oob + i * oob_len, buf + i * avail, oob_len);
+		kfree(buf);
+	}
+
+	return retval ? YAFFS_FAIL : YAFFS_OK;
+}
+
 static 	int yaffs_mtd_erase(struct yaffs_dev *dev, int block_no)
 {
 	struct mtd_info *mtd = yaffs_dev_to_mtd(dev);
@@ -240,6 +291,7 @@ void yaffs_mtd_drv_install(struct yaffs_dev *dev)
 
 	drv->drv_write_chunk_fn = yaffs_mtd_write;
 	drv->drv_read_chunk_fn = yaffs_mtd_read;
+	drv->drv_read_oob_fn = yaffs_mtd_read_oob;
 	drv->drv_erase_fn = yaffs_mtd_erase;
 	drv->drv_mark_bad_fn = yaffs_mtd_mark_bad;
 	drv->drv_check_bad_fn = yaffs_mtd_check_bad;
@@ -47,6 +47,37 @@ int yaffs_rd_chunk_tags_nand(struct yaffs_dev *dev, int nand_chunk,
 	return result;
 }
 
+/* Read the tags of a run of chunks, in one go if the tags handler can do
+ * that, else chunk by chunk.
+ */
+int yaffs_rd_tags_range_nand(struct yaffs_dev *dev, int nand_chunk,
+			     int n_chunks, struct yaffs_ext_tags *tags)
+{
+	int flash_chunk = apply_chunk_offset(dev, nand_chunk);
+	struct yaffs_block_info *bi;
+	int i;
+
+	if (!dev->tagger.read_tags_range_fn ||
+	    dev->tagger.read_tags_range_fn(dev, flash_chunk, n_chunks,
+					   tags) != YAFFS_OK) {
+		for (i = 0; i < n_chunks; i++)
+			yaffs_rd_chunk_tags_nand(dev, nand_chunk + i, NULL,
+						 &tags[i]);
+		return YAFFS_OK;
+	}
+
+	dev->n_page_reads += n_chunks;
+
+	for (i = 0; i < n_chunks; i++) {
+		if (tags[i].ecc_result > YAFFS_ECC_RESULT_NO_ERROR) {
+			bi = yaffs_get_block_info(dev, (nand_chunk + i) /
+						  dev->param.chunks_per_block);
+			yaffs_handle_chunk_error(dev, bi);
+		}
+	}
+	return YAFFS_OK;
+}
+
 int yaffs_wr_chunk_tags_nand(struct yaffs_dev *dev,
 				int nand_chunk,
 				const u8 *buffer, struct yaffs_ext_tags *tags)
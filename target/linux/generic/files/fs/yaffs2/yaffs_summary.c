@@ -255,7 +255,7 @@ int yaffs_summary_add(struct yaffs_dev *dev,
 	int block_in_nand = chunk_in_nand / dev->param.chunks_per_block;
 	int chunk_in_block = chunk_in_nand % dev->param.chunks_per_block;
 
-	if (!dev->sum_tags)
+	if (!dev->sum_tags || dev->param.disable_summary)
 		return YAFFS_OK;
 
 	if (chunk_in_block >= 0 && chunk_in_block < dev->chunks_per_summary) {
@@ -130,6 +130,42 @@ static int yaffs_tags_marshall_read(struct yaffs_dev *dev,
 		return YAFFS_FAIL;
 }
 
+static int yaffs_tags_marshall_read_range(struct yaffs_dev *dev,
+					  int nand_chunk, int n_chunks,
+					  struct yaffs_ext_tags *tags)
+{
+	struct yaffs_packed_tags2 pt;
+	u8 *oob;
+	int i;
+
+	int packed_tags_size =
+	    dev->param.no_tags_ecc ? sizeof(pt.t) : sizeof(pt);
+	void *packed_tags_ptr =
+	    dev->param.no_tags_ecc ? (void *)&pt.t : (void *)&pt;
+
+	if (dev->param.inband_tags || !dev->drv.drv_read_oob_fn)
+		return YAFFS_FAIL;
+
+	oob = kmalloc(n_chunks * packed_tags_size, GFP_NOFS);
+	if (!oob)
+		return YAFFS_FAIL;
+
+	if (dev->drv.drv_read_oob_fn(dev, nand_chunk, n_chunks,
+				     oob, packed_tags_size) != YAFFS_OK) {
+		kfree(oob);
+		return YAFFS_FAIL;
+	}
+
+	for (i = 0; i < n_chunks; i++) {
+		memcpy(packed_tags_ptr, oob + i * packed_tags_size,
+		       packed_tags_size);
+		yaffs_unpack_tags2(&tags[i], &pt, !dev->param.no_tags_ecc);
+	}
+
+	kfree(oob);
+	return YAFFS_OK;
+}
+
 static int yaffs_tags_marshall_query_block(struct yaffs_dev *dev, int block_no,
 			       enum yaffs_block_state *state,
 			       u32 *seq_number)
@@ -190,6 +226,9 @@ void yaffs_tags_marshall_install(struct yaffs_dev *dev)
 	if (!dev->tagger.read_chunk_tags_fn)
 		dev->tagger.read_chunk_tags_fn = yaffs_tags_marshall_read;
 
+	if (!dev->tagger.read_tags_range_fn)
+		dev->tagger.read_tags_range_fn = yaffs_tags_marshall_read_range;
+
 	if (!dev->tagger.query_block_fn)
 		dev->tagger.query_block_fn = yaffs_tags_marshall_query_block;
 
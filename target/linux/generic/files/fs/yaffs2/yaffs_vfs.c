@@ -2608,6 +2608,7 @@ struct yaffs_options {
 	int skip_checkpoint_read;
 	int skip_checkpoint_write;
 	int no_cache;
+	int n_caches;
 	int tags_ecc_on;
 	int tags_ecc_overridden;
 	int lazy_loading_enabled;
@@ -2615,6 +2616,7 @@ struct yaffs_options {
 	int empty_lost_and_found;
 	int empty_lost_and_found_overridden;
 	int disable_summary;
+	int disable_dir_index;
 };
 
 #define MAX_OPT_LEN 30
@@ -2658,6 +2660,8 @@ static int yaffs_parse_options(struct yaffs_options *options,
 			options->lazy_loading_overridden = 1;
 		} else if (!strcmp(cur_opt, "disable-summary")) {
 			options->disable_summary = 1;
+		} else if (!strcmp(cur_opt, "disable-dir-index")) {
+			options->disable_dir_index = 1;
 		} else if (!strcmp(cur_opt, "empty-lost-and-found-off")) {
 			options->empty_lost_and_found = 0;
 			options->empty_lost_and_found_overridden = 1;
@@ -2666,6 +2670,16 @@ static int yaffs_parse_options(struct yaffs_options *options,
 			options->empty_lost_and_found_overridden = 1;
 		} else if (!strcmp(cur_opt, "no-cache")) {
 			options->no_cache = 1;
+		} else if (!strncmp(cur_opt, "cache-size=", 11)) {
+			options->n_caches =
+			    simple_strtoul(cur_opt + 11, NULL, 0);
+			if (options->n_caches < 1 ||
+			    options->n_caches > YAFFS_MAX_SHORT_OP_CACHES) {
+				printk(KERN_INFO
+				       "yaffs: cache-size must be 1..%d\n",
+				       YAFFS_MAX_SHORT_OP_CACHES);
+				error = 1;
+			}
 		} else if (!strcmp(cur_opt, "no-checkpoint-read")) {
 			options->skip_checkpoint_read = 1;
 		} else if (!strcmp(cur_opt, "no-checkpoint-write")) {
@@ -2856,7 +2870,12 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 
 
 	param->n_reserved_blocks = 5;
-	param->n_caches = (options.no_cache) ? 0 : 10;
+	if (options.no_cache)
+		param->n_caches = 0;
+	else if (options.n_caches)
+		param->n_caches = options.n_caches;
+	else
+		param->n_caches = 32;
 	param->inband_tags = inband_tags;
 
 	param->enable_xattr = 1;
@@ -2871,6 +2890,7 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 	param->empty_lost_n_found = 1;
 	param->refresh_period = 500;
 	param->disable_summary = options.disable_summary;
+	param->disable_dir_index = options.disable_dir_index;
 
 
 #ifdef CONFIG_YAFFS_DISABLE_BAD_BLOCK_MARKING
@@ -3124,6 +3144,8 @@ static char *yaffs_dump_dev_part0(char *buf, struct yaffs_dev *dev)
 				param->disable_lazy_load);
 	buf += sprintf(buf, "disable_bad_block_mrk %d\n",
 				param->disable_bad_block_marking);
+	buf += sprintf(buf, "disable_dir_index.... %d\n",
+				param->disable_dir_index);
 	buf += sprintf(buf, "refresh_period....... %d\n",
 				param->refresh_period);
 	buf += sprintf(buf, "n_caches............. %d\n", param->n_caches);
@@ -3179,6 +3201,7 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 	buf += sprintf(buf, "n_tags_ecc_unfixed... %u\n",
 				dev->n_tags_ecc_unfixed);
 	buf += sprintf(buf, "cache_hits........... %u\n", dev->cache_hits);
+	buf += sprintf(buf, "cache_misses......... %u\n", dev->cache_misses);
 	buf += sprintf(buf, "n_deleted_files...... %u\n", dev->n_deleted_files);
 	buf += sprintf(buf, "n_unlinked_files..... %u\n",
 				dev->n_unlinked_files);
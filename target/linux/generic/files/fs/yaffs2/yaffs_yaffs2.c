@@ -936,7 +936,8 @@ static inline int yaffs2_scan_chunk(struct yaffs_dev *dev,
 		int *found_chunks,
 		u8 *chunk_data,
 		struct list_head *hard_list,
-		int summary_available)
+		int summary_available,
+		const struct yaffs_ext_tags *block_tags)
 {
 	struct yaffs_obj_hdr *oh;
 	struct yaffs_obj *in;
@@ -958,7 +959,10 @@ static inline int yaffs2_scan_chunk(struct yaffs_dev *dev,
 		tags.seq_number = bi->seq_number;
 	}
 
-	if (!summary_available || tags.obj_id == 0) {
+	if (block_tags) {
+		tags = block_tags[chunk_in_block];
+		dev->tags_used++;
+	} else if (!summary_available || tags.obj_id == 0) {
 		result = yaffs_rd_chunk_tags_nand(dev, chunk, NULL, &tags);
 		dev->tags_used++;
 	} else {
@@ -1362,6 +1366,8 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 	struct yaffs_block_index *block_index = NULL;
 	int alt_block_index = 0;
 	int summary_available;
+	struct yaffs_ext_tags *block_tags;
+	struct yaffs_ext_tags *tags_to_use;
 
 	yaffs_trace(YAFFS_TRACE_SCAN,
 		"yaffs2_scan_backwards starts  intstartblk %d intendblk %d...",
@@ -1389,6 +1395,12 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 	chunk_data = yaffs_get_temp_buffer(dev);
 
+	/* Blocks without a summary have the tags of all their chunks read
+	 * in one go if the driver can do that. Not fatal if this fails.
+	 */
+	block_tags = kmalloc(dev->param.chunks_per_block *
+				sizeof(struct yaffs_ext_tags), GFP_NOFS);
+
 	/* Scan all the blocks to determine their state */
 	bi = dev->block_info;
 	for (blk = dev->internal_start_block; blk <= dev->internal_end_block;
@@ -1471,14 +1483,24 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 		bi = yaffs_get_block_info(dev, blk);
 		deleted = 0;
 
-		summary_available = yaffs_summary_read(dev, dev->sum_tags, blk);
+		summary_available = dev->sum_tags &&
+			yaffs_summary_read(dev, dev->sum_tags, blk) == YAFFS_OK;
 
 		/* For each chunk in each block that needs scanning.... */
 		found_chunks = 0;
-		if (summary_available)
+		tags_to_use = NULL;
+		if (summary_available) {
 			c = dev->chunks_per_summary - 1;
-		else
+		} else {
 			c = dev->param.chunks_per_block - 1;
+			if (block_tags && dev->tagger.read_tags_range_fn) {
+				yaffs_rd_tags_range_nand(dev,
+					blk * dev->param.chunks_per_block,
+					dev->param.chunks_per_block,
+					block_tags);
+				tags_to_use = block_tags;
+			}
+		}
 
 		for (/* c is already initialised */;
 		     !alloc_failed && c >= 0 &&
@@ -1490,7 +1512,8 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 			 */
 			if (yaffs2_scan_chunk(dev, bi, blk, c,
 					&found_chunks, chunk_data,
-					&hard_list, summary_available) ==
+					&hard_list, summary_available,
+					tags_to_use) ==
 					YAFFS_FAIL)
 				alloc_failed = 1;
 		}
@@ -1511,6 +1534,8 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 	yaffs_skip_rest_of_block(dev);
 
+	kfree(block_tags);
+
 	if (alt_block_index)
 		vfree(block_index);
 	else
@@ -0,0 +1,283 @@
+/*
+ *  Copyright (C) 2015 OpenWrt.org
+ *
+ *  Zero-copy file I/O helpers shared by the firmware image builders.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#if defined(__linux__)
+#  include <sys/syscall.h>
+#endif
+
+#include "fwio.h"
+
+#define FWIO_FILL_LEN	(64 * 1024)
+
+#define ERRS(fmt, ...) do { \
+	int save = errno; \
+	fflush(0); \
+	fprintf(stderr, "*** error: " fmt ": %s\n", ## __VA_ARGS__, \
+		strerror(save)); \
+} while (0)
+
+static int fwio_read_all(struct fwio_file *f)
+{
+	size_t alloc = FWIO_FILL_LEN;
+	ssize_t n;
+
+	f->data = malloc(alloc);
+	if (!f->data)
+		return -1;
+
+	f->size = 0;
+	for (;;) {
+		if (f->size == alloc) {
+			uint8_t *p;
+
+			alloc *= 2;
+			p = realloc(f->data, alloc);
+			if (!p)
+				return -1;
+			f->data = p;
+		}
+
+		n = read(f->fd, f->data + f->size, alloc - f->size);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (n == 0)
+			break;
+
+		f->size += n;
+	}
+
+	return 0;
+}
+
+static int fwio_do_open(struct fwio_file *f, const char *name, int writable)
+{
+	struct stat st;
+	void *p;
+
+	memset(f, 0, sizeof(*f));
+	f->name = name;
+	f->writable = writable;
+
+	f->fd = open(name, O_RDONLY);
+	if (f->fd < 0) {
+		ERRS("could not open \"%s\" for reading", name);
+		return -1;
+	}
+
+	if (fstat(f->fd, &st)) {
+		ERRS("stat failed on \"%s\"", name);
+		goto err_close;
+	}
+
+	if (S_ISREG(st.st_mode) && st.st_size > 0) {
+		p = mmap(NULL, st.st_size,
+			 writable ? PROT_READ | PROT_WRITE : PROT_READ,
+			 MAP_PRIVATE, f->fd, 0);
+		if (p != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+			madvise(p, st.st_size, MADV_SEQUENTIAL);
+#endif
+			f->data = p;
+			f->size = st.st_size;
+			f->mapped = 1;
+			return 0;
+		}
+	}
+
+	if (fwio_read_all(f)) {
+		ERRS("unable to read from file \"%s\"", name);
+		goto err_close;
+	}
+
+	return 0;
+
+err_close:
+	fwio_close(f);
+	return -1;
+}
+
+int fwio_open(struct fwio_file *f, const char *name)
+{
+	return fwio_do_open(f, name, 0);
+}
+
+int fwio_open_rw(struct fwio_file *f, const char *name)
+{
+	return fwio_do_open(f, name, 1);
+}
+
+void fwio_close(struct fwio_file *f)
+{
+	if (f->mapped)
+		munmap(f->data, f->size);
+	else
+		free(f->data);
+
+	if (f->fd >= 0)
+		close(f->fd);
+
+	f->data = NULL;
+	f->size = 0;
+	f->mapped = 0;
+	f->fd = -1;
+}
+
+int fwio_create(struct fwio_out *o, const char *name)
+{
+	o->name = name;
+	o->pos = 0;
+	o->fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (o->fd < 0) {
+		ERRS("could not open \"%s\" for writing", name);
+		return -1;
+	}
+
+	return 0;
+}
+
+int fwio_pwrite(struct fwio_out *o, off_t ofs, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	ssize_t n;
+
+	while (len > 0) {
+		n = pwrite(o->fd, p, len, ofs);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			ERRS("unable to write output file \"%s\"", o->name);
+			return -1;
+		}
+
+		p += n;
+		ofs += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+int fwio_write(struct fwio_out *o, const void *data, size_t len)
+{
+	if (fwio_pwrite(o, o->pos, data, len))
+		return -1;
+
+	o->pos += len;
+	return 0;
+}
+
+int fwio_pad(struct fwio_out *o, size_t len, uint8_t c)
+{
+	uint8_t buf[FWIO_FILL_LEN];
+	size_t buflen = sizeof(buf);
+
+	if (len < buflen)
+		buflen = len;
+
+	memset(buf, c, buflen);
+	while (len > 0) {
+		if (len < buflen)
+			buflen = len;
+
+		if (fwio_write(o, buf, buflen))
+			return -1;
+
+		len -= buflen;
+	}
+
+	return 0;
+}
+
+/*
+ * Copy a range of an input file to the output.  For read-only mappings the
+ * kernel does the copy with copy_file_range() where available; everything
+ * else, including writable mappings that may have been modified, falls back
+ * to writing straight out of the mapping.
+ */
+int fwio_copy(struct fwio_out *o, struct fwio_file *f, size_t ofs, size_t len)
+{
+	if (ofs + len > f->size) {
+		fprintf(stderr, "*** error: range exceeds size of \"%s\"\n",
+			f->name);
+		return -1;
+	}
+
+#if defined(__linux__) && defined(__NR_copy_file_range)
+	if (f->mapped && !f->writable) {
+		loff_t in_ofs = ofs;
+		loff_t out_ofs = o->pos;
+		size_t left = len;
+		long n;
+
+		while (left > 0) {
+			n = syscall(__NR_copy_file_range, f->fd, &in_ofs,
+				    o->fd, &out_ofs, left, 0);
+			if (n <= 0)
+				break;
+			left -= n;
+		}
+
+		o->pos += len - left;
+		ofs += len - left;
+		len = left;
+	}
+#endif
+
+	return fwio_write(o, f->data + ofs, len);
+}
+
+int fwio_finish(struct fwio_out *o, int failed)
+{
+	if (o->fd < 0)
+		return -1;
+
+	if (close(o->fd) && !failed) {
+		ERRS("unable to write output file \"%s\"", o->name);
+		failed = 1;
+	}
+	o->fd = -1;
+
+	if (failed)
+		unlink(o->name);
+
+	return failed ? -1 : 0;
+}
+
+void fwio_fill_update(void (*update)(void *ctx, const uint8_t *data, size_t len),
+		      void *ctx, uint8_t c, size_t len)
+{
+	uint8_t buf[FWIO_FILL_LEN];
+	size_t buflen = sizeof(buf);
+
+	if (len < buflen)
+		buflen = len;
+
+	memset(buf, c, buflen);
+	while (len > 0) {
+		if (len < buflen)
+			buflen = len;
+
+		update(ctx, buf, buflen);
+		len -= buflen;
+	}
+}
@@ -0,0 +1,63 @@
+/*
+ *  Copyright (C) 2015 OpenWrt.org
+ *
+ *  Zero-copy file I/O helpers shared by the firmware image builders.
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License version 2 as published
+ *  by the Free Software Foundation.
+ *
+ */
+
+#ifndef _FWIO_H_
+#define _FWIO_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * A view of an input file.  fwio_open() maps the contents read-only, so
+ * fwio_copy() can let the kernel copy straight from the file.  Callers that
+ * want to scribble over the data use fwio_open_rw() instead, which maps it
+ * privately without touching the file; fwio_copy() then always copies from
+ * the mapping.  Files which can not be mapped (pipes, empty files) are read
+ * into a heap buffer instead.
+ */
+struct fwio_file {
+	const char	*name;
+	int		fd;
+	uint8_t		*data;
+	size_t		size;
+	int		mapped;
+	int		writable;
+};
+
+/*
+ * An output image.  Data is written with pwrite() at the current position,
+ * so headers can be patched in afterwards with fwio_pwrite().
+ */
+struct fwio_out {
+	const char	*name;
+	int		fd;
+	off_t		pos;
+};
+
+int fwio_open(struct fwio_file *f, const char *name);
+int fwio_open_rw(struct fwio_file *f, const char *name);
+void fwio_close(struct fwio_file *f);
+
+int fwio_create(struct fwio_out *o, const char *name);
+int fwio_write(struct fwio_out *o, const void *data, size_t len);
+int fwio_pwrite(struct fwio_out *o, off_t ofs, const void *data, size_t len);
+int fwio_pad(struct fwio_out *o, size_t len, uint8_t c);
+int fwio_copy(struct fwio_out *o, struct fwio_file *f, size_t ofs, size_t len);
+int fwio_finish(struct fwio_out *o, int failed);
+
+/*
+ * Feed @len bytes of @c to a streaming hash/checksum update function,
+ * without having to materialize the padding in memory.
+ */
+void fwio_fill_update(void (*update)(void *ctx, const uint8_t *data, size_t len),
+		      void *ctx, uint8_t c, size_t len);
+
+#endif /* _FWIO_H_ */
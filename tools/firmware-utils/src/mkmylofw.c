@@ -43,11 +43,11 @@
 #endif
 
 #include "myloader.h"
+#include "fwio.h"
 
 #define MAX_FW_BLOCKS  	32
 #define MAX_ARG_COUNT   32
 #define MAX_ARG_LEN     1024
-#define FILE_BUF_LEN    (16*1024)
 #define PART_NAME_LEN	32
 
 struct fw_block {
@@ -368,53 +368,6 @@ find_board(char *model){
 }
 
 
-int
-get_file_crc(struct fw_block *ff)
-{
-	FILE *f;
-	uint8_t buf[FILE_BUF_LEN];
-	uint32_t readlen = sizeof(buf);
-	int res = -1;
-	size_t len;
-
-	if ((ff->flags & BLOCK_FLAG_HAVEHDR) == 0) {
-		res = 0;
-		goto out;
-	}
-
-	errno = 0;
-	f = fopen(ff->name,"r");
-	if (errno) {
-		errmsg(1,"unable to open file %s", ff->name);
-		goto out;
-	}
-
-	ff->crc = 0;
-	len = ff->size;
-	while (len > 0) {
-		if (len < readlen)
-			readlen = len;
-
-		errno = 0;
-		fread(buf, readlen, 1, f);
-		if (errno) {
-			errmsg(1,"unable to read from file %s",	ff->name);
-			goto out_close;
-		}
-
-		update_crc(buf, readlen, &ff->crc);
-		len -= readlen;
-	}
-
-	res = 0;
-
-out_close:
-	fclose(f);
-out:
-	return res;
-}
-
-
 int
 process_files(void)
 {
@@ -529,64 +482,49 @@ write_out_padding(FILE *outfile, size_t len, uint8_t padc, uint32_t *crc)
 int
 write_out_file(FILE *outfile, struct fw_block *block, uint32_t *crc)
 {
-	char buff[FILE_BUF_LEN];
-	size_t  buflen = sizeof(buff);
-	FILE *f;
+	struct fwio_file f;
 	size_t len;
-
-	errno = 0;
+	int res = -1;
 
 	if (block->name == NULL) {
 		return 0;
 	}
 
+	/* the mapping is used both for the crc header and the data */
+	if (fwio_open(&f, block->name) != 0)
+		return -1;
+
+	if (f.size != block->size) {
+		errmsg(0,"size of file %s changed", block->name);
+		goto out_close;
+	}
+
 	if ((block->flags & BLOCK_FLAG_HAVEHDR) != 0) {
 		struct mylo_partition_header ph;
 
-		if (get_file_crc(block) != 0)
-		        return -1;
+		block->crc = get_crc(f.data, f.size);
 
 		ph.crc = HOST_TO_LE32(block->crc);
 		ph.len = HOST_TO_LE32(block->size);
 
 		if (write_out_data(outfile, (uint8_t *)&ph, sizeof(ph), crc) != 0)
-			return -1;
-	}
-
-	f = fopen(block->name,"r");
-	if (errno) {
-		errmsg(1,"unable to open file: %s", block->name);
-		return -1;
-	}
-
-	len = block->size;
-	while (len > 0) {
-		if (len < buflen)
-			buflen = len;
-
-		/* read data from source file */
-		errno = 0;
-		fread(buff, buflen, 1, f);
-		if (errno != 0) {
-			errmsg(1,"unable to read from file: %s",block->name);
-			return -1;
-		}
-
-		if (write_out_data(outfile, buff, buflen, crc) != 0)
-			return -1;
-
-		len -= buflen;
+			goto out_close;
 	}
 
-	fclose(f);
+	if (write_out_data(outfile, f.data, f.size, crc) != 0)
+		goto out_close;
 
 	/* align next block on a 4 byte boundary */
-	len = ALIGN(len,4) - block->size;
+	len = (ALIGN(block->size, 4)) - block->size;
 	if (write_out_padding(outfile, len, 0xFF, crc))
-		return -1;
+		goto out_close;
 
 	dbgmsg(1,"file %s written out", block->name);
-	return 0;
+	res = 0;
+
+out_close:
+	fwio_close(&f);
+	return res;
 }
 
 
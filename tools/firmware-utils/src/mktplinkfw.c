@@ -26,6 +26,7 @@
 #include <netinet/in.h>
 
 #include "md5.h"
+#include "fwio.h"
 
 #define ALIGN(x,a) ({ typeof(a) __a = (a); (((x) + __a - 1) & ~(__a - 1)); })
 
@@ -107,6 +108,15 @@ struct fw_header {
 	uint8_t		pad[354];
 } __attribute__ ((packed));
 
+struct fw_seg {
+	struct fwio_file	*file;	/* data comes from this file, ... */
+	const uint8_t		*data;	/* ... from memory, ... */
+	uint32_t		len;
+	uint8_t			fill;	/* ... or is padding with this byte */
+};
+
+#define MAX_FW_SEGS	64
+
 struct flash_layout {
 	char		*id;
 	uint32_t	fw_max_len;
@@ -126,6 +136,8 @@ struct board_info {
  * Globals
  */
 static char *ofname;
+static char *sysup_ofname;
+static char *batch_name;
 static char *progname;
 static char *vendor = "TP-LINK Technologies";
 static char *version = "ver. 1.0";
@@ -134,6 +146,8 @@ static char *fw_ver = "0.0.0";
 static char *board_id;
 static struct board_info *board;
 static char *layout_id;
+static char *opt_layout_id;
+static struct flash_layout cur_layout;
 static struct flash_layout *layout;
 static char *opt_hw_id;
 static uint32_t hw_id;
@@ -143,10 +157,15 @@ static int fw_ver_lo;
 static int fw_ver_mid;
 static int fw_ver_hi;
 static struct file_info kernel_info;
+static struct fwio_file kernel_file;
+static uint32_t opt_kernel_la;
 static uint32_t kernel_la = 0;
+static uint32_t opt_kernel_ep;
 static uint32_t kernel_ep = 0;
 static uint32_t kernel_len = 0;
 static struct file_info rootfs_info;
+static struct fwio_file rootfs_file;
+static uint32_t opt_rootfs_ofs;
 static uint32_t rootfs_ofs = 0;
 static uint32_t rootfs_align;
 static struct file_info boot_info;
@@ -158,6 +177,10 @@ static unsigned char jffs2_eof_mark[4] = {0xde, 0xad, 0xc0, 0xde};
 static uint32_t fw_max_len;
 static uint32_t reserved_space;
 
+static struct fw_seg segs[MAX_FW_SEGS];
+static int num_segs;
+static uint32_t segs_len;
+
 static struct file_info inspect_info;
 static int extract = 0;
 
@@ -514,6 +537,9 @@ static void usage(int status)
 "\n"
 "Options:\n"
 "  -B <board>      create image for the board specified with <board>\n"
+"  -b <file>       create images for all boards listed in <file> (- for stdin),\n"
+"                  one '<board>|<hwid>:<hwrev>[:<layout>] <file> [<sysupgrade file>]'\n"
+"                  entry per line\n"
 "  -c              use combined kernel image\n"
 "  -E <ep>         overwrite kernel entry point with <ep> (hexval prefixed with 0x)\n"
 "  -L <la>         overwrite kernel load address with <la> (hexval prefixed with 0x)\n"
@@ -525,6 +551,7 @@ static void usage(int status)
 "  -a <align>      align the rootfs start on an <align> bytes boundary\n"
 "  -R <offset>     overwrite rootfs offset with <offset> (hexval prefixed with 0x)\n"
 "  -o <file>       write output to the file <file>\n"
+"  -O <file>       also write the image with padding stripped to <file>\n"
 "  -s              strip padding from the end of the image\n"
 "  -S              ignore firmware size limit (only for combined images)\n"
 "  -j              add jffs2 end-of-filesystem markers\n"
@@ -567,52 +594,16 @@ static int get_file_stat(struct file_info *fdata)
 	return 0;
 }
 
-static int read_to_buf(struct file_info *fdata, char *buf)
+static int check_board(void)
 {
-	FILE *f;
-	int ret = EXIT_FAILURE;
-
-	f = fopen(fdata->file_name, "r");
-	if (f == NULL) {
-		ERRS("could not open \"%s\" for reading", fdata->file_name);
-		goto out;
-	}
-
-	errno = 0;
-	fread(buf, fdata->file_size, 1, f);
-	if (errno != 0) {
-		ERRS("unable to read from file \"%s\"", fdata->file_name);
-		goto out_close;
-	}
-
-	ret = EXIT_SUCCESS;
-
- out_close:
-	fclose(f);
- out:
-	return ret;
-}
-
-static int check_options(void)
-{
-	int ret;
-
-	if (inspect_info.file_name) {
-		ret = get_file_stat(&inspect_info);
-		if (ret)
-			return ret;
-
-		return 0;
-	} else if (extract) {
-		ERR("no firmware for inspection specified");
-		return -1;
-	}
+	struct flash_layout *l;
 
 	if (board_id == NULL && opt_hw_id == NULL) {
 		ERR("either board or hardware id must be specified");
 		return -1;
 	}
 
+	layout_id = opt_layout_id;
 	if (board_id) {
 		board = find_board(board_id);
 		if (board == NULL) {
@@ -637,12 +628,20 @@ static int check_options(void)
 			hw_rev = 1;
 	}
 
-	layout = find_layout(layout_id);
-	if (layout == NULL) {
+	l = find_layout(layout_id);
+	if (l == NULL) {
 		ERR("unknown flash layout \"%s\"", layout_id);
 		return -1;
 	}
 
+	/* work on a copy, the maximum length may be adjusted below */
+	cur_layout = *l;
+	layout = &cur_layout;
+
+	kernel_la = opt_kernel_la;
+	kernel_ep = opt_kernel_ep;
+	rootfs_ofs = opt_rootfs_ofs;
+
 	if (!kernel_la)
 		kernel_la = layout->kernel_la;
 	if (!kernel_ep)
@@ -657,15 +656,6 @@ static int check_options(void)
 
 	fw_max_len = layout->fw_max_len - reserved_space;
 
-	if (kernel_info.file_name == NULL) {
-		ERR("no kernel image specified");
-		return -1;
-	}
-
-	ret = get_file_stat(&kernel_info);
-	if (ret)
-		return ret;
-
 	kernel_len = kernel_info.file_size;
 
 	if (combined) {
@@ -680,15 +670,6 @@ static int check_options(void)
 					     reserved_space;
 		}
 	} else {
-		if (rootfs_info.file_name == NULL) {
-			ERR("no rootfs image specified");
-			return -1;
-		}
-
-		ret = get_file_stat(&rootfs_info);
-		if (ret)
-			return ret;
-
 		if (rootfs_align) {
 			kernel_len += sizeof(struct fw_header);
 			kernel_len = ALIGN(kernel_len, rootfs_align);
@@ -716,11 +697,55 @@ static int check_options(void)
 		}
 	}
 
-	if (ofname == NULL) {
-		ERR("no output file specified");
+	return 0;
+}
+
+static int check_options(void)
+{
+	int ret;
+
+	if (inspect_info.file_name) {
+		ret = get_file_stat(&inspect_info);
+		if (ret)
+			return ret;
+
+		return 0;
+	} else if (extract) {
+		ERR("no firmware for inspection specified");
+		return -1;
+	}
+
+	if (kernel_info.file_name == NULL) {
+		ERR("no kernel image specified");
 		return -1;
 	}
 
+	ret = get_file_stat(&kernel_info);
+	if (ret)
+		return ret;
+
+	if (!combined) {
+		if (rootfs_info.file_name == NULL) {
+			ERR("no rootfs image specified");
+			return -1;
+		}
+
+		ret = get_file_stat(&rootfs_info);
+		if (ret)
+			return ret;
+	}
+
+	if (batch_name == NULL) {
+		ret = check_board();
+		if (ret)
+			return ret;
+
+		if (ofname == NULL && sysup_ofname == NULL) {
+			ERR("no output file specified");
+			return -1;
+		}
+	}
+
 	ret = sscanf(fw_ver, "%d.%d.%d", &fw_ver_hi, &fw_ver_mid, &fw_ver_lo);
 	if (ret != 3) {
 		ERR("invalid firmware version '%s'", fw_ver);
@@ -730,10 +755,8 @@ static int check_options(void)
 	return 0;
 }
 
-static void fill_header(char *buf, int len)
+static void fill_header(struct fw_header *hdr)
 {
-	struct fw_header *hdr = (struct fw_header *)buf;
-
 	memset(hdr, 0, sizeof(struct fw_header));
 
 	hdr->version = htonl(HEADER_VERSION_V1);
@@ -760,18 +783,42 @@ static void fill_header(char *buf, int len)
 	hdr->ver_hi = htons(fw_ver_hi);
 	hdr->ver_mid = htons(fw_ver_mid);
 	hdr->ver_lo = htons(fw_ver_lo);
+}
 
-	get_md5(buf, len, hdr->md5sum1);
+/*
+ * The image is described as a list of segments which are hashed and
+ * written out in a single streaming pass, so the kernel and rootfs are
+ * never copied into an image sized buffer.
+ */
+static void add_seg(struct fwio_file *file, const uint8_t *data,
+		    uint32_t len, uint8_t fill)
+{
+	struct fw_seg *seg;
+
+	if (len == 0)
+		return;
+
+	seg = &segs[num_segs++];
+	seg->file = file;
+	seg->data = data;
+	seg->len = len;
+	seg->fill = fill;
+	segs_len += len;
+}
+
+static void add_seg_pad_to(uint32_t ofs)
+{
+	if (ofs > segs_len)
+		add_seg(NULL, NULL, ofs - segs_len, 0xff);
 }
 
-static int pad_jffs2(char *buf, int currlen)
+static void pad_jffs2(void)
 {
-	int len;
+	uint32_t len;
 	uint32_t pad_mask;
 
-	len = currlen;
 	pad_mask = (64 * 1024);
-	while ((len < layout->fw_max_len) && (pad_mask != 0)) {
+	while ((segs_len < layout->fw_max_len) && (pad_mask != 0)) {
 		uint32_t mask;
 		int i;
 
@@ -781,7 +828,7 @@ static int pad_jffs2(char *buf, int currlen)
 				break;
 		}
 
-		len = ALIGN(len, mask);
+		len = ALIGN(segs_len, mask);
 
 		for (i = 10; i < 32; i++) {
 			mask = 1 << i;
@@ -789,103 +836,245 @@ static int pad_jffs2(char *buf, int currlen)
 				pad_mask &= ~mask;
 		}
 
-		for (i = 0; i < sizeof(jffs2_eof_mark); i++)
-			buf[len + i] = jffs2_eof_mark[i];
+		if (len + sizeof(jffs2_eof_mark) > layout->fw_max_len)
+			break;
 
-		len += sizeof(jffs2_eof_mark);
+		add_seg_pad_to(len);
+		add_seg(NULL, jffs2_eof_mark, sizeof(jffs2_eof_mark), 0);
 	}
+}
 
-	return len;
+static void md5_update(void *ctx, const uint8_t *data, size_t len)
+{
+	MD5_Update(ctx, (unsigned char *) data, (unsigned int) len);
 }
 
-static int write_fw(char *data, int len)
+static void hash_segs(MD5_CTX *ctx, int first, int last)
 {
-	FILE *f;
-	int ret = EXIT_FAILURE;
+	struct fw_seg *seg;
+	int i;
 
-	f = fopen(ofname, "w");
-	if (f == NULL) {
-		ERRS("could not open \"%s\" for writing", ofname);
-		goto out;
+	for (i = first; i < last; i++) {
+		seg = &segs[i];
+		if (seg->file)
+			md5_update(ctx, seg->file->data, seg->len);
+		else if (seg->data)
+			md5_update(ctx, seg->data, seg->len);
+		else
+			fwio_fill_update(md5_update, ctx, seg->fill, seg->len);
 	}
+}
 
-	errno = 0;
-	fwrite(data, len, 1, f);
-	if (errno) {
-		ERRS("unable to write output file");
-		goto out_flush;
+static int write_segs(struct fwio_out *out, int first, int last)
+{
+	struct fw_seg *seg;
+	int ret = 0;
+	int i;
+
+	for (i = first; i < last && !ret; i++) {
+		seg = &segs[i];
+		if (seg->file)
+			ret = fwio_copy(out, seg->file, 0, seg->len);
+		else if (seg->data)
+			ret = fwio_write(out, seg->data, seg->len);
+		else
+			ret = fwio_pad(out, seg->len, seg->fill);
 	}
 
-	DBG("firmware file \"%s\" completed", ofname);
+	return ret;
+}
 
-	ret = EXIT_SUCCESS;
+static int write_fw(const char *name, struct fw_header *hdr,
+		    const uint8_t *md5, int nsegs)
+{
+	struct fwio_out out;
+	int ret;
 
- out_flush:
-	fflush(f);
-	fclose(f);
-	if (ret != EXIT_SUCCESS) {
-		unlink(ofname);
-	}
- out:
-	return ret;
+	memcpy(hdr->md5sum1, md5, sizeof(hdr->md5sum1));
+
+	if (fwio_create(&out, name))
+		return EXIT_FAILURE;
+
+	ret = write_segs(&out, 0, nsegs);
+	ret = fwio_finish(&out, ret);
+	if (ret)
+		return EXIT_FAILURE;
+
+	DBG("firmware file \"%s\" completed", name);
+	return EXIT_SUCCESS;
 }
 
-static int build_fw(void)
+static int open_inputs(void)
 {
-	int buflen;
-	char *buf;
-	char *p;
-	int ret = EXIT_FAILURE;
-	int writelen = 0;
+	if (fwio_open(&kernel_file, kernel_info.file_name))
+		return -1;
 
-	buflen = layout->fw_max_len;
+	if (kernel_file.size != kernel_info.file_size) {
+		ERR("size of \"%s\" changed", kernel_info.file_name);
+		goto err_close_kernel;
+	}
 
-	buf = malloc(buflen);
-	if (!buf) {
-		ERR("no memory for buffer\n");
-		goto out;
+	if (combined)
+		return 0;
+
+	if (fwio_open(&rootfs_file, rootfs_info.file_name))
+		goto err_close_kernel;
+
+	if (rootfs_file.size != rootfs_info.file_size) {
+		ERR("size of \"%s\" changed", rootfs_info.file_name);
+		fwio_close(&rootfs_file);
+		goto err_close_kernel;
 	}
 
-	memset(buf, 0xff, buflen);
-	p = buf + sizeof(struct fw_header);
-	ret = read_to_buf(&kernel_info, p);
-	if (ret)
-		goto out_free_buf;
+	return 0;
 
-	writelen = sizeof(struct fw_header) + kernel_len;
+ err_close_kernel:
+	fwio_close(&kernel_file);
+	return -1;
+}
 
-	if (!combined) {
-		if (rootfs_align)
-			p = buf + writelen;
-		else
-			p = buf + rootfs_ofs;
+static void close_inputs(void)
+{
+	if (!combined)
+		fwio_close(&rootfs_file);
+	fwio_close(&kernel_file);
+}
 
-		ret = read_to_buf(&rootfs_info, p);
-		if (ret)
-			goto out_free_buf;
+/*
+ * Build the image for the current board.  The stripped image is a prefix
+ * of the padded one, so when both are requested the payload is hashed only
+ * once and the digest state is forked before the trailing padding.
+ */
+static int build_fw(const char *fw_name, const char *sysup_name)
+{
+	struct fw_header hdr;
+	uint8_t fw_md5[MD5SUM_LEN];
+	uint8_t sysup_md5[MD5SUM_LEN];
+	MD5_CTX ctx;
+	MD5_CTX sysup_ctx;
+	int sysup_segs;
+	int ret = EXIT_SUCCESS;
 
-		if (rootfs_align)
-			writelen += rootfs_info.file_size;
-		else
-			writelen = rootfs_ofs + rootfs_info.file_size;
+	num_segs = 0;
+	segs_len = 0;
+
+	fill_header(&hdr);
+	add_seg(NULL, (uint8_t *) &hdr, sizeof(hdr), 0);
+	add_seg(&kernel_file, NULL, kernel_file.size, 0);
+	add_seg_pad_to(sizeof(struct fw_header) + kernel_len);
+
+	if (!combined) {
+		if (!rootfs_align)
+			add_seg_pad_to(rootfs_ofs);
+
+		add_seg(&rootfs_file, NULL, rootfs_file.size, 0);
 
 		if (add_jffs2_eof)
-			writelen = pad_jffs2(buf, writelen);
+			pad_jffs2();
 	}
 
+	sysup_segs = num_segs;
 	if (!strip_padding)
-		writelen = buflen;
+		add_seg_pad_to(layout->fw_max_len);
 
-	fill_header(buf, writelen);
-	ret = write_fw(buf, writelen);
-	if (ret)
-		goto out_free_buf;
+	/* the header is the first segment, hash it with the salt in place */
+	MD5_Init(&ctx);
+	hash_segs(&ctx, 0, sysup_segs);
 
-	ret = EXIT_SUCCESS;
+	if (sysup_name) {
+		sysup_ctx = ctx;
+		MD5_Final(sysup_md5, &sysup_ctx);
+	}
+
+	if (fw_name) {
+		hash_segs(&ctx, sysup_segs, num_segs);
+		MD5_Final(fw_md5, &ctx);
+		ret = write_fw(fw_name, &hdr, fw_md5, num_segs);
+	}
+
+	if (sysup_name && write_fw(sysup_name, &hdr, sysup_md5, sysup_segs))
+		ret = EXIT_FAILURE;
+
+	return ret;
+}
+
+/*
+ * Batch mode: build images for a list of boards from a single run, with
+ * kernel and rootfs opened only once.  Each line of the list contains
+ *
+ *   <board> <firmware file> [<sysupgrade file>]
+ *
+ * where <board> is either a board id or <hwid>:<hwrev>[:<layout>], and
+ * "-" can be used to skip an output.
+ */
+static int build_batch(void)
+{
+	char *cli_layout_id = opt_layout_id;
+	char line[1024];
+	int lineno = 0;
+	int ret = EXIT_SUCCESS;
+	FILE *f;
+
+	if (strcmp(batch_name, "-") == 0) {
+		f = stdin;
+	} else {
+		f = fopen(batch_name, "r");
+		if (f == NULL) {
+			ERRS("could not open \"%s\" for reading", batch_name);
+			return EXIT_FAILURE;
+		}
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		char *id, *fw_name, *sysup_name, *p;
+
+		lineno++;
+
+		id = strtok(line, " \t\r\n");
+		if (id == NULL || *id == '#')
+			continue;
+
+		fw_name = strtok(NULL, " \t\r\n");
+		sysup_name = strtok(NULL, " \t\r\n");
+		if (fw_name == NULL) {
+			ERR("%s:%d: no output file specified", batch_name, lineno);
+			ret = EXIT_FAILURE;
+			continue;
+		}
+
+		if (strcmp(fw_name, "-") == 0)
+			fw_name = NULL;
+		if (sysup_name && strcmp(sysup_name, "-") == 0)
+			sysup_name = NULL;
+
+		opt_layout_id = cli_layout_id;
+		p = strchr(id, ':');
+		if (p) {
+			board_id = NULL;
+			opt_hw_id = id;
+			*p++ = '\0';
+			opt_hw_rev = p;
+			p = strchr(p, ':');
+			if (p) {
+				*p++ = '\0';
+				opt_layout_id = p;
+			}
+		} else {
+			board_id = id;
+			opt_hw_id = NULL;
+			opt_hw_rev = NULL;
+		}
+
+		if (check_board() ||
+		    build_fw(fw_name, sysup_name) != EXIT_SUCCESS) {
+			ERR("%s:%d: building images failed", batch_name, lineno);
+			ret = EXIT_FAILURE;
+		}
+	}
+
+	if (f != stdin)
+		fclose(f);
 
- out_free_buf:
-	free(buf);
- out:
 	return ret;
 }
 
@@ -956,21 +1145,25 @@ static inline void inspect_fw_pmd5sum(char *label, uint8_t *val, char *text)
 
 static int inspect_fw(void)
 {
+	struct fwio_file fw;
 	char *buf;
 	struct fw_header *hdr;
 	uint8_t md5sum[MD5SUM_LEN];
 	struct board_info *board;
 	int ret = EXIT_FAILURE;
 
-	buf = malloc(inspect_info.file_size);
-	if (!buf) {
-		ERR("no memory for buffer!\n");
+	if (fwio_open_rw(&fw, inspect_info.file_name))
 		goto out;
-	}
 
-	ret = read_to_buf(&inspect_info, buf);
-	if (ret)
+	ret = EXIT_SUCCESS;
+	if (fw.size < sizeof(struct fw_header)) {
+		ERR("file is too small to hold a firmware header");
+		ret = EXIT_FAILURE;
 		goto out_free_buf;
+	}
+
+	/* the mapping is private, so the header can be modified in place */
+	buf = (char *) fw.data;
 	hdr = (struct fw_header *)buf;
 
 	inspect_fw_pstr("File name", inspect_info.file_name);
@@ -991,7 +1184,7 @@ static int inspect_fw(void)
 		memcpy(hdr->md5sum1, md5salt_normal, sizeof(md5sum));
 	else
 		memcpy(hdr->md5sum1, md5salt_boot, sizeof(md5sum));
-	get_md5(buf, inspect_info.file_size, hdr->md5sum1);
+	get_md5(buf, fw.size, hdr->md5sum1);
 
 	if (memcmp(md5sum, hdr->md5sum1, sizeof(md5sum))) {
 		inspect_fw_pmd5sum("Header MD5Sum1", md5sum, "(*ERROR*)");
@@ -1095,7 +1288,7 @@ static int inspect_fw(void)
 	}
 
  out_free_buf:
-	free(buf);
+	fwio_close(&fw);
  out:
 	return ret;
 }
@@ -1112,7 +1305,7 @@ int main(int argc, char *argv[])
 	while ( 1 ) {
 		int c;
 
-		c = getopt(argc, argv, "a:B:H:E:F:L:V:N:W:ci:k:r:R:o:xX:hsSjv:");
+		c = getopt(argc, argv, "a:b:B:H:E:F:L:V:N:W:ci:k:r:R:o:O:xX:hsSjv:");
 		if (c == -1)
 			break;
 
@@ -1120,6 +1313,9 @@ int main(int argc, char *argv[])
 		case 'a':
 			sscanf(optarg, "0x%x", &rootfs_align);
 			break;
+		case 'b':
+			batch_name = optarg;
+			break;
 		case 'B':
 			board_id = optarg;
 			break;
@@ -1127,16 +1323,16 @@ int main(int argc, char *argv[])
 			opt_hw_id = optarg;
 			break;
 		case 'E':
-			sscanf(optarg, "0x%x", &kernel_ep);
+			sscanf(optarg, "0x%x", &opt_kernel_ep);
 			break;
 		case 'F':
-			layout_id = optarg;
+			opt_layout_id = optarg;
 			break;
 		case 'W':
 			opt_hw_rev = optarg;
 			break;
 		case 'L':
-			sscanf(optarg, "0x%x", &kernel_la);
+			sscanf(optarg, "0x%x", &opt_kernel_la);
 			break;
 		case 'V':
 			version = optarg;
@@ -1157,11 +1353,14 @@ int main(int argc, char *argv[])
 			rootfs_info.file_name = optarg;
 			break;
 		case 'R':
-			sscanf(optarg, "0x%x", &rootfs_ofs);
+			sscanf(optarg, "0x%x", &opt_rootfs_ofs);
 			break;
 		case 'o':
 			ofname = optarg;
 			break;
+		case 'O':
+			sysup_ofname = optarg;
+			break;
 		case 's':
 			strip_padding = 1;
 			break;
@@ -1193,10 +1392,21 @@ int main(int argc, char *argv[])
 	if (ret)
 		goto out;
 
-	if (!inspect_info.file_name)
-		ret = build_fw();
-	else
+	if (inspect_info.file_name) {
 		ret = inspect_fw();
+		goto out;
+	}
+
+	ret = open_inputs();
+	if (ret)
+		goto out;
+
+	if (batch_name)
+		ret = build_batch();
+	else
+		ret = build_fw(ofname, sysup_ofname);
+
+	close_inputs();
 
  out:
 	return ret;
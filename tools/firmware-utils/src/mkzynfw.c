@@ -29,6 +29,7 @@
 #endif
 
 #include "zynos.h"
+#include "fwio.h"
 
 #if (__BYTE_ORDER == __LITTLE_ENDIAN)
 #  define HOST_TO_LE16(x)	(x)
@@ -55,7 +56,6 @@
 #define MAX_NUM_BLOCKS	8
 #define MAX_ARG_COUNT	32
 #define MAX_ARG_LEN	1024
-#define FILE_BUF_LEN	(16*1024)
 
 
 struct csum_state{
@@ -682,42 +682,24 @@ err:
 int
 write_out_file(FILE *outfile, char *name, size_t len, struct csum_state *css)
 {
-	char buf[FILE_BUF_LEN];
-	size_t buflen = sizeof(buf);
-	FILE *f;
+	struct fwio_file f;
 	int res;
 
 	DBG(2, "writing out file, name=%s, len=%d",
 		name, len);
 
-	errno = 0;
-	f = fopen(name,"r");
-	if (errno) {
-		ERRS("unable to open file: %s", name);
+	if (fwio_open(&f, name))
 		return -1;
-	}
-
-	while (len > 0) {
-		if (len < buflen)
-			buflen = len;
-
-		/* read data from source file */
-		errno = 0;
-		fread(buf, buflen, 1, f);
-		if (errno != 0) {
-			ERRS("unable to read from file: %s",name);
-			res = -1;
-			break;
-		}
-
-		res = write_out_data(outfile, buf, buflen, css);
-		if (res)
-			break;
 
-		len -= buflen;
+	if (f.size < len) {
+		ERR("file %s is too short", name);
+		fwio_close(&f);
+		return -1;
 	}
 
-	fclose(f);
+	res = write_out_data(outfile, f.data, len, css);
+
+	fwio_close(&f);
 	return res;
 }
 
@@ -51,6 +51,8 @@
 #include <errno.h>
 #include <unistd.h>
 
+#include "fwio.h"
+
 #if __BYTE_ORDER == __BIG_ENDIAN
 #define STORE32_LE(X)		bswap_32(X)
 #define LOAD32_LE(X)		bswap_32(X)
@@ -93,7 +95,8 @@ void usage(void)
 int main(int argc, char **argv)
 {
 	FILE *out = stdout;
-	FILE *in;
+	struct fwio_file in;
+	int have_input = 0;
 	char *ofn = NULL;
 	char *buf;
 	char *e;
@@ -118,7 +121,6 @@ int main(int argc, char **argv)
 	p->magic = STORE32_LE(TRX_MAGIC);
 	cur_len = sizeof(struct trx_header) - 4; /* assume v1 header */
 
-	in = NULL;
 	i = 0;
 
 	while ((c = getopt(argc, argv, "-:2o:m:a:x:b:f:A:F:")) != -1) {
@@ -143,17 +145,19 @@ int main(int argc, char **argv)
 				if (!append)
 					p->offsets[i++] = STORE32_LE(cur_len);
 
-				if (!(in = fopen(optarg, "r"))) {
+				if (fwio_open(&in, optarg)) {
 					fprintf(stderr, "can not open \"%s\" for reading\n", optarg);
 					usage();
 				}
-				n = fread(buf + cur_len, 1, maxlen - cur_len, in);
-				if (!feof(in)) {
+				n = in.size;
+				if (n > maxlen - cur_len) {
 					fprintf(stderr, "fread failure or file \"%s\" too large\n",optarg);
-					fclose(in);
+					fwio_close(&in);
 					return EXIT_FAILURE;
 				}
-				fclose(in);
+				memcpy(buf + cur_len, in.data, n);
+				fwio_close(&in);
+				have_input = 1;
 #undef  ROUND
 #define ROUND 4
 				if (n & (ROUND-1)) {
@@ -249,7 +253,7 @@ int main(int argc, char **argv)
 	}
 	p->flag_version = STORE32_LE((trx_version << 16));
 
-	if (!in) {
+	if (!have_input) {
 		fprintf(stderr, "we require atleast one filename\n");
 		usage();
 	}
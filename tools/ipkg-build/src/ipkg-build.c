@@ -0,0 +1,1028 @@
+/*
+ * ipkg-build - construct a .ipk from a directory
+ *
+ * Copyright (C) 2015 OpenWrt.org
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * Native replacement for scripts/ipkg-build. The data and outer archives
+ * are compressed while they are being built and streamed to temporary
+ * files next to the destination, so memory use does not grow with the
+ * package size; the finished package is put in place with one rename.
+ *
+ * The output is reproducible: directory entries are stored in sorted
+ * order, all timestamps are set to $SOURCE_DATE_EPOCH (or 0) and the gzip
+ * streams carry no name or time. Large payloads are compressed in
+ * independent 128 KiB blocks (primed with the preceding 32 KiB as
+ * dictionary, like pigz does) by a pool of threads; the block layout does
+ * not depend on the number of threads, so neither does the output.
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include <zlib.h>
+
+#define TAR_BLOCK	512
+#define TAR_RECORD	(20 * TAR_BLOCK)
+#define GZ_BLOCK	(128 * 1024)
+#define GZ_DICT		(32 * 1024)
+#define GZ_BATCH	(4 * GZ_BLOCK)
+
+static char *progname;
+
+#define ERR(fmt, ...) do { \
+	fflush(0); \
+	fprintf(stderr, "*** Error: " fmt "\n", ## __VA_ARGS__ ); \
+} while (0)
+
+#define ERRS(fmt, ...) do { \
+	int save = errno; \
+	fflush(0); \
+	fprintf(stderr, "*** Error: " fmt ": %s\n", \
+			## __VA_ARGS__, strerror(save)); \
+} while (0)
+
+struct gz_stream;
+
+struct buf {
+	uint8_t *data;
+	size_t len;
+	size_t alloc;
+	struct gz_stream *gz;	/* compress and flush as it fills up */
+};
+
+/*
+ * Compressed output attached to a struct buf. Whole blocks are taken from
+ * the front of the buffer once enough of them have accumulated; the last
+ * GZ_DICT bytes of input are kept there as dictionary for the next block.
+ */
+struct gz_stream {
+	int fd;			/* output file, or -1 to append to out */
+	struct buf *out;
+	size_t base;		/* stream offset of the buffer start */
+	size_t dict;		/* leading buffer bytes already compressed */
+	size_t out_len;
+	uint32_t crc;
+	int err;
+};
+
+struct tar_owner {
+	long uid;
+	long gid;
+	const char *uname;
+	const char *gname;
+	time_t mtime;
+};
+
+struct hardlink {
+	dev_t dev;
+	ino_t ino;
+	char *name;
+};
+
+static struct hardlink *links;
+static size_t num_links;
+
+static int jobs;
+
+static void gz_flush(struct buf *b, int last);
+
+static void *xrealloc(void *p, size_t len)
+{
+	p = realloc(p, len);
+	if (!p) {
+		ERR("out of memory");
+		exit(1);
+	}
+
+	return p;
+}
+
+static uint8_t *buf_grow(struct buf *b, size_t len)
+{
+	uint8_t *p;
+
+	if (b->gz && b->len - b->gz->dict >= (size_t) jobs * GZ_BATCH)
+		gz_flush(b, 0);
+
+	if (b->len + len > b->alloc) {
+		b->alloc = b->alloc ? b->alloc : 64 * 1024;
+		while (b->len + len > b->alloc)
+			b->alloc *= 2;
+		b->data = xrealloc(b->data, b->alloc);
+	}
+
+	p = b->data + b->len;
+	b->len += len;
+	return p;
+}
+
+static void buf_append(struct buf *b, const void *data, size_t len)
+{
+	memcpy(buf_grow(b, len), data, len);
+}
+
+static void buf_zero(struct buf *b, size_t len)
+{
+	memset(buf_grow(b, len), 0, len);
+}
+
+/* stream offset of the buffer end, including what has been flushed */
+static size_t buf_pos(const struct buf *b)
+{
+	return b->gz ? b->gz->base + b->len : b->len;
+}
+
+static int read_fd(int fd, const char *path, struct buf *b, size_t len)
+{
+	size_t chunk;
+	uint8_t *p;
+	ssize_t n;
+
+	while (len > 0) {
+		chunk = len < GZ_BLOCK ? len : GZ_BLOCK;
+		p = buf_grow(b, chunk);
+		len -= chunk;
+
+		while (chunk > 0) {
+			n = read(fd, p, chunk);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0) {
+				ERRS("unable to read %s", path);
+				return -1;
+			}
+			p += n;
+			chunk -= n;
+		}
+	}
+
+	return 0;
+}
+
+static int read_file(const char *path, struct buf *b, size_t len)
+{
+	int fd, ret;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		ERRS("unable to open %s", path);
+		return -1;
+	}
+
+	ret = read_fd(fd, path, b, len);
+	close(fd);
+	return ret;
+}
+
+/*
+ * GNU tar format, as written by "tar --format=gnu".
+ */
+static void tar_octal(char *field, size_t len, unsigned long long val)
+{
+	char tmp[32];
+
+	snprintf(tmp, sizeof(tmp), "%0*llo", (int) len - 1, val);
+	memcpy(field, tmp, len - 1);
+	field[len - 1] = '\0';
+}
+
+static void tar_raw_header(struct buf *b, const struct tar_owner *o,
+			   const char *name, char type, unsigned int mode,
+			   unsigned long long size, const char *linkname,
+			   unsigned int major, unsigned int minor)
+{
+	char *h = (char *) buf_grow(b, TAR_BLOCK);
+	unsigned int sum = 0;
+	int i;
+
+	memset(h, 0, TAR_BLOCK);
+	strncpy(h, name, 100);
+	tar_octal(h + 100, 8, mode);
+	tar_octal(h + 108, 8, o->uid);
+	tar_octal(h + 116, 8, o->gid);
+	tar_octal(h + 124, 12, size);
+	tar_octal(h + 136, 12, o->mtime);
+	memset(h + 148, ' ', 8);
+	h[156] = type;
+	if (linkname)
+		strncpy(h + 157, linkname, 100);
+	memcpy(h + 257, "ustar  ", 8);
+	if (o->uname)
+		strncpy(h + 265, o->uname, 32);
+	if (o->gname)
+		strncpy(h + 297, o->gname, 32);
+	if (type == '3' || type == '4') {
+		tar_octal(h + 329, 8, major);
+		tar_octal(h + 337, 8, minor);
+	}
+
+	for (i = 0; i < TAR_BLOCK; i++)
+		sum += (uint8_t) h[i];
+	snprintf(h + 148, 8, "%06o", sum);
+}
+
+static void tar_pad(struct buf *b)
+{
+	if (buf_pos(b) % TAR_BLOCK)
+		buf_zero(b, TAR_BLOCK - buf_pos(b) % TAR_BLOCK);
+}
+
+static void tar_longname(struct buf *b, const struct tar_owner *o,
+			 char type, const char *name)
+{
+	size_t len = strlen(name) + 1;
+
+	tar_raw_header(b, o, "././@LongLink", type, 0, len, NULL, 0, 0);
+	buf_append(b, name, len);
+	tar_pad(b);
+}
+
+static void tar_header(struct buf *b, const struct tar_owner *o,
+		       const char *name, char type, unsigned int mode,
+		       unsigned long long size, const char *linkname,
+		       unsigned int major, unsigned int minor)
+{
+	if (linkname && strlen(linkname) > 100)
+		tar_longname(b, o, 'K', linkname);
+	if (strlen(name) > 100)
+		tar_longname(b, o, 'L', name);
+
+	tar_raw_header(b, o, name, type, mode, size, linkname, major, minor);
+}
+
+static void tar_end(struct buf *b)
+{
+	buf_zero(b, 2 * TAR_BLOCK);
+	if (buf_pos(b) % TAR_RECORD)
+		buf_zero(b, TAR_RECORD - buf_pos(b) % TAR_RECORD);
+}
+
+static const char *find_link(const struct stat *st, const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < num_links; i++)
+		if (links[i].dev == st->st_dev && links[i].ino == st->st_ino)
+			return links[i].name;
+
+	links = xrealloc(links, (num_links + 1) * sizeof(*links));
+	links[num_links].dev = st->st_dev;
+	links[num_links].ino = st->st_ino;
+	links[num_links].name = strdup(name);
+	num_links++;
+
+	return NULL;
+}
+
+static int cmp_name(const void *a, const void *b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+static int tar_add(struct buf *b, const struct tar_owner *o,
+		   const char *path, const char *name, const char *exclude);
+
+static int tar_add_dir(struct buf *b, const struct tar_owner *o,
+		       const char *path, const char *name, const char *exclude)
+{
+	char **names = NULL;
+	size_t num = 0, i;
+	struct dirent *e;
+	DIR *d;
+	int ret = 0;
+
+	d = opendir(path);
+	if (!d) {
+		ERRS("unable to open directory %s", path);
+		return -1;
+	}
+
+	while ((e = readdir(d)) != NULL) {
+		if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, ".."))
+			continue;
+		if (exclude && !strcmp(e->d_name, exclude))
+			continue;
+
+		names = xrealloc(names, (num + 1) * sizeof(*names));
+		names[num++] = strdup(e->d_name);
+	}
+	closedir(d);
+
+	qsort(names, num, sizeof(*names), cmp_name);
+
+	for (i = 0; i < num; i++) {
+		char *cpath, *cname;
+
+		if (!ret) {
+			if (asprintf(&cpath, "%s/%s", path, names[i]) < 0 ||
+			    asprintf(&cname, "%s%s", name, names[i]) < 0) {
+				ERR("out of memory");
+				exit(1);
+			}
+
+			ret = tar_add(b, o, cpath, cname, exclude);
+			free(cpath);
+			free(cname);
+		}
+		free(names[i]);
+	}
+	free(names);
+
+	return ret;
+}
+
+static int tar_add(struct buf *b, const struct tar_owner *o,
+		   const char *path, const char *name, const char *exclude)
+{
+	unsigned int mode;
+	const char *link;
+	char target[4096];
+	struct stat st;
+	ssize_t n;
+
+	if (lstat(path, &st)) {
+		ERRS("unable to stat %s", path);
+		return -1;
+	}
+
+	mode = st.st_mode & 07777;
+
+	switch (st.st_mode & S_IFMT) {
+	case S_IFDIR: {
+		char *dname;
+		int ret;
+
+		if (asprintf(&dname, "%s/", name) < 0) {
+			ERR("out of memory");
+			exit(1);
+		}
+
+		tar_header(b, o, dname, '5', mode, 0, NULL, 0, 0);
+		ret = tar_add_dir(b, o, path, dname, exclude);
+		free(dname);
+		return ret;
+	}
+
+	case S_IFREG:
+		if (st.st_nlink > 1 && (link = find_link(&st, name)) != NULL) {
+			tar_header(b, o, name, '1', mode, 0, link, 0, 0);
+			return 0;
+		}
+
+		tar_header(b, o, name, '0', mode, st.st_size, NULL, 0, 0);
+		if (read_file(path, b, st.st_size))
+			return -1;
+		tar_pad(b);
+		return 0;
+
+	case S_IFLNK:
+		n = readlink(path, target, sizeof(target) - 1);
+		if (n < 0) {
+			ERRS("unable to read link %s", path);
+			return -1;
+		}
+		target[n] = '\0';
+		tar_header(b, o, name, '2', mode, 0, target, 0, 0);
+		return 0;
+
+	case S_IFCHR:
+	case S_IFBLK:
+		tar_header(b, o, name, S_ISCHR(st.st_mode) ? '3' : '4', mode,
+			   0, NULL, major(st.st_rdev), minor(st.st_rdev));
+		return 0;
+
+	case S_IFIFO:
+		tar_header(b, o, name, '6', mode, 0, NULL, 0, 0);
+		return 0;
+
+	default:
+		fprintf(stderr, "%s: socket ignored\n", path);
+		return 0;
+	}
+}
+
+/*
+ * Block parallel gzip.
+ */
+struct gz_block {
+	const uint8_t *in;
+	size_t in_len;
+	const uint8_t *dict;
+	size_t dict_len;
+	int last;
+	uint8_t *out;
+	size_t out_len;
+	int err;
+};
+
+struct gz_job {
+	struct gz_block *blocks;
+	size_t num;
+	size_t next;
+	pthread_mutex_t lock;
+};
+
+static void gz_compress_block(struct gz_block *blk)
+{
+	z_stream zs;
+
+	memset(&zs, 0, sizeof(zs));
+	if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS,
+			 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		blk->err = 1;
+		return;
+	}
+
+	if (blk->dict_len)
+		deflateSetDictionary(&zs, blk->dict, blk->dict_len);
+
+	/* room for the sync flush marker on top of the worst case */
+	blk->out = xrealloc(NULL, deflateBound(&zs, blk->in_len) + 16);
+
+	zs.next_in = (uint8_t *) blk->in;
+	zs.avail_in = blk->in_len;
+	zs.next_out = blk->out;
+	zs.avail_out = deflateBound(&zs, blk->in_len) + 16;
+
+	if (deflate(&zs, blk->last ? Z_FINISH : Z_SYNC_FLUSH) !=
+	    (blk->last ? Z_STREAM_END : Z_OK) || zs.avail_in)
+		blk->err = 1;
+
+	blk->out_len = zs.next_out - blk->out;
+	deflateEnd(&zs);
+}
+
+static void *gz_worker(void *arg)
+{
+	struct gz_job *job = arg;
+	size_t i;
+
+	for (;;) {
+		pthread_mutex_lock(&job->lock);
+		i = job->next++;
+		pthread_mutex_unlock(&job->lock);
+
+		if (i >= job->num)
+			break;
+
+		gz_compress_block(&job->blocks[i]);
+	}
+
+	return NULL;
+}
+
+static void gz_output(struct gz_stream *gz, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	ssize_t n;
+
+	gz->out_len += len;
+	if (gz->fd < 0) {
+		buf_append(gz->out, data, len);
+		return;
+	}
+
+	while (len > 0 && !gz->err) {
+		n = write(gz->fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			ERRS("unable to write output");
+			gz->err = 1;
+			break;
+		}
+		p += n;
+		len -= n;
+	}
+}
+
+/*
+ * Compress the whole blocks pending in the buffer, or everything that is
+ * left if this is the end of the stream.
+ */
+static void gz_flush(struct buf *b, int last)
+{
+	struct gz_stream *gz = b->gz;
+	size_t avail = b->len - gz->dict;
+	size_t i, nthreads, used, start;
+	struct gz_job job;
+	pthread_t *threads;
+
+	memset(&job, 0, sizeof(job));
+	if (last)
+		job.num = avail ? (avail + GZ_BLOCK - 1) / GZ_BLOCK : 1;
+	else
+		job.num = avail / GZ_BLOCK;
+
+	if (!job.num)
+		return;
+
+	pthread_mutex_init(&job.lock, NULL);
+	job.blocks = xrealloc(NULL, job.num * sizeof(*job.blocks));
+	memset(job.blocks, 0, job.num * sizeof(*job.blocks));
+
+	for (i = 0; i < job.num; i++) {
+		struct gz_block *blk = &job.blocks[i];
+		size_t ofs = gz->dict + i * GZ_BLOCK;
+
+		blk->in = b->data + ofs;
+		blk->in_len = b->len - ofs < GZ_BLOCK ? b->len - ofs : GZ_BLOCK;
+		blk->dict_len = ofs < GZ_DICT ? ofs : GZ_DICT;
+		blk->dict = blk->in - blk->dict_len;
+		blk->last = last && (i == job.num - 1);
+	}
+
+	nthreads = jobs;
+	if (nthreads > job.num)
+		nthreads = job.num;
+
+	threads = xrealloc(NULL, nthreads * sizeof(*threads));
+	for (i = 1; i < nthreads; i++)
+		if (pthread_create(&threads[i], NULL, gz_worker, &job))
+			break;
+	nthreads = i;
+
+	gz_worker(&job);
+
+	for (i = 1; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	used = last ? avail : job.num * GZ_BLOCK;
+	gz->crc = crc32(gz->crc, b->data + gz->dict, used);
+
+	for (i = 0; i < job.num; i++) {
+		if (job.blocks[i].err && !gz->err) {
+			ERR("compression failed");
+			gz->err = 1;
+		}
+		gz_output(gz, job.blocks[i].out, job.blocks[i].out_len);
+		free(job.blocks[i].out);
+	}
+
+	free(job.blocks);
+	pthread_mutex_destroy(&job.lock);
+
+	if (last) {
+		gz->dict = b->len;
+		return;
+	}
+
+	/* keep the tail of what was compressed as dictionary */
+	start = gz->dict + used - GZ_DICT;
+	memmove(b->data, b->data + start, b->len - start);
+	b->len -= start;
+	gz->base += start;
+	gz->dict = GZ_DICT;
+}
+
+static void gz_open(struct buf *b, struct gz_stream *gz, int fd,
+		    struct buf *out)
+{
+	static const uint8_t gz_header[10] = {
+		0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3
+	};
+
+	memset(gz, 0, sizeof(*gz));
+	gz->fd = fd;
+	gz->out = out;
+	gz->crc = crc32(0, NULL, 0);
+	b->gz = gz;
+
+	gz_output(gz, gz_header, sizeof(gz_header));
+}
+
+static int gz_close(struct buf *b)
+{
+	struct gz_stream *gz = b->gz;
+	uint8_t trailer[8];
+	size_t len;
+
+	gz_flush(b, 1);
+	len = buf_pos(b);
+
+	trailer[0] = gz->crc;
+	trailer[1] = gz->crc >> 8;
+	trailer[2] = gz->crc >> 16;
+	trailer[3] = gz->crc >> 24;
+	trailer[4] = len;
+	trailer[5] = len >> 8;
+	trailer[6] = len >> 16;
+	trailer[7] = len >> 24;
+	gz_output(gz, trailer, sizeof(trailer));
+
+	b->gz = NULL;
+	return gz->err ? -1 : 0;
+}
+
+/*
+ * Control file handling
+ */
+static char *control_field(const struct buf *control, const char *field)
+{
+	size_t flen = strlen(field);
+	const char *p = (const char *) control->data;
+	const char *end = p + control->len;
+	const char *nl, *v;
+
+	while (p < end) {
+		nl = memchr(p, '\n', end - p);
+		if (!nl)
+			nl = end;
+
+		if ((size_t) (nl - p) > flen && !strncmp(p, field, flen) &&
+		    p[flen] == ':') {
+			v = p + flen + 1;
+			while (v < nl && (*v == ' ' || *v == '\t'))
+				v++;
+			return strndup(v, nl - v);
+		}
+
+		p = nl + 1;
+	}
+
+	return strdup("");
+}
+
+static int set_installed_size(const char *path, struct buf *control,
+			      size_t size)
+{
+	static const char field[] = "Installed-Size: ";
+	const char *p = (const char *) control->data;
+	const char *end = p + control->len;
+	struct buf out = { 0 };
+	const char *nl;
+	char val[32];
+	int fd, ret = 0;
+
+	snprintf(val, sizeof(val), "%zu", size);
+
+	while (p < end) {
+		nl = memchr(p, '\n', end - p);
+		nl = nl ? nl + 1 : end;
+
+		if (nl - p >= (ssize_t) sizeof(field) - 1 &&
+		    !memcmp(p, field, sizeof(field) - 1)) {
+			buf_append(&out, field, sizeof(field) - 1);
+			buf_append(&out, val, strlen(val));
+			if (nl[-1] == '\n')
+				buf_append(&out, "\n", 1);
+		} else {
+			buf_append(&out, p, nl - p);
+		}
+
+		p = nl;
+	}
+
+	if (out.len == control->len && !memcmp(out.data, control->data, out.len)) {
+		free(out.data);
+		return 0;
+	}
+
+	fd = open(path, O_WRONLY | O_TRUNC);
+	if (fd < 0 || write(fd, out.data, out.len) != (ssize_t) out.len) {
+		ERRS("unable to update %s", path);
+		ret = -1;
+	}
+	if (fd >= 0)
+		close(fd);
+
+	free(control->data);
+	*control = out;
+
+	return ret;
+}
+
+static void resolve_conffile(const char *pkg_dir, const char *path, FILE *out)
+{
+	char *full, **names = NULL;
+	size_t num = 0, i;
+	struct dirent *e;
+	struct stat st;
+	DIR *d;
+
+	if (asprintf(&full, "%s%s", pkg_dir, path) < 0)
+		return;
+
+	if (stat(full, &st)) {
+		fprintf(stderr, "find: %s: %s\n", full, strerror(errno));
+		free(full);
+		return;
+	}
+
+	if (S_ISREG(st.st_mode))
+		fprintf(out, "%s\n", path);
+
+	if (!S_ISDIR(st.st_mode) || !(d = opendir(full))) {
+		free(full);
+		return;
+	}
+
+	while ((e = readdir(d)) != NULL) {
+		if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, ".."))
+			continue;
+		names = xrealloc(names, (num + 1) * sizeof(*names));
+		names[num++] = strdup(e->d_name);
+	}
+	closedir(d);
+
+	qsort(names, num, sizeof(*names), cmp_name);
+	for (i = 0; i < num; i++) {
+		char *sub;
+
+		if (asprintf(&sub, "%s/%s", path, names[i]) >= 0) {
+			resolve_conffile(pkg_dir, sub, out);
+			free(sub);
+		}
+		free(names[i]);
+	}
+
+	free(names);
+	free(full);
+}
+
+/*
+ * Expand directories listed in CONTROL/conffiles to the regular files
+ * below them and drop entries which do not exist.
+ */
+static int resolve_conffiles(const char *pkg_dir)
+{
+	char *path, *tmp, line[4096];
+	FILE *in, *out;
+	int ret = 0;
+
+	if (asprintf(&path, "%s/CONTROL/conffiles", pkg_dir) < 0 ||
+	    asprintf(&tmp, "%s/CONTROL/conffiles.resolved", pkg_dir) < 0) {
+		ERR("out of memory");
+		exit(1);
+	}
+
+	in = fopen(path, "r");
+	if (!in)
+		goto out;
+
+	out = fopen(tmp, "w");
+	if (!out) {
+		ERRS("unable to create %s", tmp);
+		fclose(in);
+		ret = -1;
+		goto out;
+	}
+
+	while (fgets(line, sizeof(line), in)) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if (line[0])
+			resolve_conffile(pkg_dir, line, out);
+	}
+
+	fclose(in);
+	if (fclose(out) || rename(tmp, path) || chmod(path, 0644)) {
+		ERRS("unable to update %s", path);
+		unlink(tmp);
+		ret = -1;
+	}
+
+out:
+	free(path);
+	free(tmp);
+	return ret;
+}
+
+static int create_tmp(const char *name, char **tmp)
+{
+	int fd;
+
+	if (asprintf(tmp, "%s.XXXXXX", name) < 0) {
+		ERR("out of memory");
+		exit(1);
+	}
+
+	fd = mkstemp(*tmp);
+	if (fd < 0) {
+		ERRS("unable to create %s", *tmp);
+		free(*tmp);
+	}
+
+	return fd;
+}
+
+static int commit_pkg(int fd, char *tmp, const char *name, int ret)
+{
+	if (fchmod(fd, 0644) || close(fd))
+		ret = -1;
+
+	if (ret || rename(tmp, name)) {
+		ERRS("unable to write %s", name);
+		unlink(tmp);
+		ret = -1;
+	}
+
+	free(tmp);
+	return ret;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: %s [-c] [-C] [-o owner] [-g group] [-j jobs] "
+		"<pkg_directory> [<destination_directory>]\n", progname);
+}
+
+int main(int argc, char **argv)
+{
+	struct tar_owner data_owner = { 0 }, outer_owner = { 0 };
+	struct buf control = { 0 }, data_tar = { 0 };
+	struct buf control_tar = { 0 }, control_gz = { 0 };
+	struct buf outer_tar = { 0 };
+	struct gz_stream data_gz, control_stream, outer_gz;
+	char *pkg, *version, *arch, *v, *path, *pkg_file, *tmp;
+	const char *pkg_dir, *dest_dir = ".", *epoch;
+	char cwd[4096];
+	struct stat st;
+	int c, data_fd, pkg_fd, ret = 1;
+
+	progname = argv[0];
+	data_owner.uid = data_owner.gid = -1;
+
+	while ((c = getopt(argc, argv, "cCg:ho:vj:")) != -1) {
+		switch (c) {
+		case 'o':
+			data_owner.uid = strtol(optarg, NULL, 0);
+			break;
+		case 'g':
+			data_owner.gid = strtol(optarg, NULL, 0);
+			break;
+		case 'j':
+			jobs = strtol(optarg, NULL, 0);
+			break;
+		case 'c':
+		case 'C':
+			break;
+		case 'v':
+			printf("1.0\n");
+			return 0;
+		default:
+			usage();
+			break;
+		}
+	}
+
+	if (argc - optind < 1 || argc - optind > 2) {
+		usage();
+		return 1;
+	}
+
+	pkg_dir = argv[optind];
+	if (argc - optind == 2)
+		dest_dir = argv[optind + 1];
+
+	if (!strcmp(dest_dir, ".") || !strcmp(dest_dir, "./"))
+		dest_dir = getcwd(cwd, sizeof(cwd)) ? cwd : ".";
+
+	if (stat(pkg_dir, &st) || !S_ISDIR(st.st_mode)) {
+		ERR("Directory %s does not exist", pkg_dir);
+		return 1;
+	}
+
+	if (asprintf(&path, "%s/CONTROL", pkg_dir) < 0)
+		return 1;
+	if (stat(path, &st) || !S_ISDIR(st.st_mode)) {
+		ERR("Directory %s has no CONTROL subdirectory.", pkg_dir);
+		return 1;
+	}
+	free(path);
+
+	if (jobs <= 0)
+		jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	if (jobs <= 0)
+		jobs = 1;
+
+	epoch = getenv("SOURCE_DATE_EPOCH");
+	data_owner.mtime = epoch ? strtoll(epoch, NULL, 10) : 0;
+	outer_owner.mtime = data_owner.mtime;
+
+	/* without -o/-g the file owners are taken over, like tar does */
+	if (data_owner.uid < 0 || data_owner.gid < 0) {
+		if (stat(pkg_dir, &st))
+			return 1;
+		if (data_owner.uid < 0)
+			data_owner.uid = st.st_uid;
+		if (data_owner.gid < 0)
+			data_owner.gid = st.st_gid;
+	}
+	data_owner.uname = data_owner.uid ? NULL : "root";
+	data_owner.gname = data_owner.gid ? NULL : "root";
+	outer_owner.uname = outer_owner.gname = "root";
+
+	if (asprintf(&path, "%s/CONTROL/control", pkg_dir) < 0 ||
+	    stat(path, &st) || read_file(path, &control, st.st_size)) {
+		ERR("unable to read %s/CONTROL/control", pkg_dir);
+		return 1;
+	}
+
+	pkg = control_field(&control, "Package");
+	version = control_field(&control, "Version");
+	arch = control_field(&control, "Architecture");
+
+	/* strip the epoch */
+	v = version;
+	if (v[0] && v[1] == ':')
+		v += 2;
+
+	if (pkg[strspn(pkg, "abcdefghijklmnopqrstuvwxyz"
+			    "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_.+-")]) {
+		fprintf(stderr, "%s\n", pkg);
+		ERR("Package name %s contains illegal characters, (other than [a-z0-9.+-])", pkg);
+		fprintf(stderr, "\nipkg-build: Please fix the above errors and try again.\n");
+		return 1;
+	}
+
+	if (asprintf(&pkg_file, "%s/%s_%s_%s.ipk", dest_dir, pkg, v, arch) < 0)
+		return 1;
+
+	if (resolve_conffiles(pkg_dir))
+		return 1;
+
+	/* data.tar.gz only has to live until it is copied into the package */
+	data_fd = create_tmp(pkg_file, &tmp);
+	if (data_fd < 0)
+		return 1;
+	unlink(tmp);
+	free(tmp);
+
+	gz_open(&data_tar, &data_gz, data_fd, NULL);
+	if (tar_add(&data_tar, &data_owner, pkg_dir, ".", "CONTROL"))
+		return 1;
+	tar_end(&data_tar);
+	if (gz_close(&data_tar))
+		return 1;
+	free(data_tar.data);
+
+	if (set_installed_size(path, &control, data_gz.out_len))
+		return 1;
+	free(path);
+
+	gz_open(&control_tar, &control_stream, -1, &control_gz);
+	if (asprintf(&path, "%s/CONTROL", pkg_dir) < 0 ||
+	    tar_add(&control_tar, &data_owner, path, ".", NULL))
+		return 1;
+	free(path);
+	tar_end(&control_tar);
+	if (gz_close(&control_tar))
+		return 1;
+
+	unlink(pkg_file);
+	pkg_fd = create_tmp(pkg_file, &tmp);
+	if (pkg_fd < 0)
+		return 1;
+
+	gz_open(&outer_tar, &outer_gz, pkg_fd, NULL);
+	tar_header(&outer_tar, &outer_owner, "./debian-binary", '0', 0644, 4,
+		   NULL, 0, 0);
+	buf_append(&outer_tar, "2.0\n", 4);
+	tar_pad(&outer_tar);
+	tar_header(&outer_tar, &outer_owner, "./data.tar.gz", '0', 0644,
+		   data_gz.out_len, NULL, 0, 0);
+	if (lseek(data_fd, 0, SEEK_SET) ||
+	    read_fd(data_fd, "data.tar.gz", &outer_tar, data_gz.out_len)) {
+		unlink(tmp);
+		return 1;
+	}
+	close(data_fd);
+	tar_pad(&outer_tar);
+	tar_header(&outer_tar, &outer_owner, "./control.tar.gz", '0', 0644,
+		   control_gz.len, NULL, 0, 0);
+	buf_append(&outer_tar, control_gz.data, control_gz.len);
+	tar_pad(&outer_tar);
+	tar_end(&outer_tar);
+	free(control_gz.data);
+
+	if (!commit_pkg(pkg_fd, tmp, pkg_file, gz_close(&outer_tar))) {
+		printf("Packaged contents of %s into %s\n", pkg_dir, pkg_file);
+		ret = 0;
+	}
+
+	free(pkg_file);
+	free(outer_tar.data);
+	free(control_tar.data);
+	free(control.data);
+	free(pkg);
+	free(version);
+	free(arch);
+
+	return ret;
+}
@@ -0,0 +1,721 @@
+/*
+ * ipkg-make-index - generate an opkg "Packages" index for a directory tree
+ *
+ * Copyright (C) 2015 OpenWrt.org
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * Drop-in replacement for scripts/ipkg-make-index.sh. Every .ipk is read
+ * exactly once: the raw stream is fed to MD5 and SHA-256 while it is being
+ * inflated, and the control file is pulled out of the nested
+ * control.tar.gz on the fly. Packages are processed by a pool of worker
+ * threads, and results can be cached across runs keyed by path, size and
+ * mtime, so that only new or changed packages are read again.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+#include <openssl/evp.h>
+
+#define READ_BUF_LEN	(64 * 1024)
+#define INFLATE_BUF_LEN	(64 * 1024)
+#define TAR_BLOCK	512
+#define MAX_CONTROL_LEN	(1024 * 1024)
+
+static char *progname;
+
+#define ERR(fmt, ...) do { \
+	fflush(0); \
+	fprintf(stderr, "[%s] *** error: " fmt "\n", \
+			progname, ## __VA_ARGS__ ); \
+} while (0)
+
+#define ERRS(fmt, ...) do { \
+	int save = errno; \
+	fflush(0); \
+	fprintf(stderr, "[%s] *** error: " fmt ", %s\n", \
+			progname, ## __VA_ARGS__, strerror(save)); \
+} while (0)
+
+struct pkg {
+	char *path;
+	off_t size;
+	time_t mtime;
+	char md5[2 * 16 + 1];
+	char sha256[2 * 32 + 1];
+	char *control;
+	size_t control_len;
+	int cached;
+	int failed;
+};
+
+static struct pkg *pkgs;
+static size_t num_pkgs;
+static size_t alloc_pkgs;
+static size_t num_found;
+
+static size_t next_pkg;
+static pthread_mutex_t next_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Minimal streaming tar reader: looks for a single member by name and
+ * hands its contents to a callback as they arrive.
+ */
+struct tar {
+	const char *want;
+	void (*data)(void *ctx, const uint8_t *buf, size_t len);
+	void *ctx;
+
+	uint8_t hdr[TAR_BLOCK];
+	size_t hdr_len;
+	uint64_t left;
+	uint64_t pad;
+	int match;
+	int longname;
+	char name[1024];
+	size_t name_len;
+	int have_longname;
+	int done;
+};
+
+static uint64_t tar_octal(const uint8_t *p, size_t len)
+{
+	uint64_t val = 0;
+
+	while (len > 0 && (*p == ' ' || *p == '\0')) {
+		p++;
+		len--;
+	}
+
+	while (len > 0 && *p >= '0' && *p <= '7') {
+		val = (val << 3) | (*p - '0');
+		p++;
+		len--;
+	}
+
+	return val;
+}
+
+static void tar_header(struct tar *t)
+{
+	const char *name = (const char *) t->hdr;
+	char type = t->hdr[156];
+	int i;
+
+	for (i = 0; i < TAR_BLOCK; i++)
+		if (t->hdr[i])
+			break;
+
+	if (i == TAR_BLOCK) {
+		/* end of archive */
+		t->done = 1;
+		return;
+	}
+
+	t->left = tar_octal(t->hdr + 124, 12);
+	t->pad = (TAR_BLOCK - (t->left % TAR_BLOCK)) % TAR_BLOCK;
+
+	if (type == 'L') {
+		t->longname = 1;
+		t->name_len = 0;
+		return;
+	}
+
+	if (t->have_longname) {
+		name = t->name;
+		t->have_longname = 0;
+	} else {
+		memcpy(t->name, name, 100);
+		t->name[100] = '\0';
+		name = t->name;
+	}
+
+	t->match = (type == '0' || type == '\0') && !strcmp(name, t->want);
+}
+
+static void tar_feed(struct tar *t, const uint8_t *buf, size_t len)
+{
+	size_t n;
+
+	while (len > 0 && !t->done) {
+		if (t->left > 0) {
+			n = len;
+			if (n > t->left)
+				n = t->left;
+
+			if (t->longname) {
+				size_t room = sizeof(t->name) - 1 - t->name_len;
+
+				memcpy(t->name + t->name_len, buf,
+				       n < room ? n : room);
+				t->name_len += n < room ? n : room;
+			} else if (t->match) {
+				t->data(t->ctx, buf, n);
+			}
+
+			t->left -= n;
+			buf += n;
+			len -= n;
+
+			if (t->left == 0) {
+				if (t->longname) {
+					t->name[t->name_len] = '\0';
+					t->longname = 0;
+					t->have_longname = 1;
+				} else if (t->match) {
+					t->done = 1;
+				}
+			}
+			continue;
+		}
+
+		if (t->pad > 0) {
+			n = len;
+			if (n > t->pad)
+				n = t->pad;
+
+			t->pad -= n;
+			buf += n;
+			len -= n;
+			continue;
+		}
+
+		n = TAR_BLOCK - t->hdr_len;
+		if (n > len)
+			n = len;
+
+		memcpy(t->hdr + t->hdr_len, buf, n);
+		t->hdr_len += n;
+		buf += n;
+		len -= n;
+
+		if (t->hdr_len == TAR_BLOCK) {
+			t->hdr_len = 0;
+			tar_header(t);
+			if (t->match && t->left == 0)
+				t->done = 1;
+		}
+	}
+}
+
+/*
+ * A gzip stream feeding a tar reader.
+ */
+struct gztar {
+	z_stream zs;
+	struct tar tar;
+	int error;
+	int eof;
+};
+
+static int gztar_init(struct gztar *g, const char *want,
+		      void (*data)(void *ctx, const uint8_t *buf, size_t len),
+		      void *ctx)
+{
+	memset(g, 0, sizeof(*g));
+	g->tar.want = want;
+	g->tar.data = data;
+	g->tar.ctx = ctx;
+
+	return inflateInit2(&g->zs, 16 + MAX_WBITS) == Z_OK ? 0 : -1;
+}
+
+static void gztar_feed(struct gztar *g, const uint8_t *buf, size_t len)
+{
+	uint8_t out[INFLATE_BUF_LEN];
+	int ret;
+
+	if (g->error || g->eof || g->tar.done)
+		return;
+
+	g->zs.next_in = (uint8_t *) buf;
+	g->zs.avail_in = len;
+
+	do {
+		g->zs.next_out = out;
+		g->zs.avail_out = sizeof(out);
+
+		ret = inflate(&g->zs, Z_NO_FLUSH);
+		if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+			g->error = 1;
+			return;
+		}
+
+		tar_feed(&g->tar, out, sizeof(out) - g->zs.avail_out);
+
+		if (ret == Z_STREAM_END) {
+			g->eof = 1;
+			return;
+		}
+	} while (g->zs.avail_out == 0 && !g->tar.done);
+}
+
+static void gztar_free(struct gztar *g)
+{
+	inflateEnd(&g->zs);
+}
+
+struct pkg_reader {
+	struct pkg *pkg;
+	struct gztar outer;
+	struct gztar inner;
+	size_t control_alloc;
+	int overflow;
+};
+
+static void control_data(void *ctx, const uint8_t *buf, size_t len)
+{
+	struct pkg_reader *r = ctx;
+	struct pkg *p = r->pkg;
+
+	if (p->control_len + len > MAX_CONTROL_LEN) {
+		r->overflow = 1;
+		return;
+	}
+
+	if (p->control_len + len > r->control_alloc) {
+		char *c;
+
+		r->control_alloc = (p->control_len + len) * 2;
+		c = realloc(p->control, r->control_alloc);
+		if (!c) {
+			r->overflow = 1;
+			return;
+		}
+		p->control = c;
+	}
+
+	memcpy(p->control + p->control_len, buf, len);
+	p->control_len += len;
+}
+
+static void control_tar_data(void *ctx, const uint8_t *buf, size_t len)
+{
+	struct pkg_reader *r = ctx;
+
+	gztar_feed(&r->inner, buf, len);
+}
+
+static void hex(char *out, const uint8_t *in, unsigned int len)
+{
+	static const char digits[] = "0123456789abcdef";
+	unsigned int i;
+
+	for (i = 0; i < len; i++) {
+		*out++ = digits[in[i] >> 4];
+		*out++ = digits[in[i] & 0xf];
+	}
+	*out = '\0';
+}
+
+static int read_pkg(struct pkg *p)
+{
+	struct pkg_reader r;
+	EVP_MD_CTX *md5, *sha256;
+	uint8_t *buf;
+	uint8_t digest[EVP_MAX_MD_SIZE];
+	unsigned int digest_len;
+	ssize_t n;
+	int fd, ret = -1;
+
+	memset(&r, 0, sizeof(r));
+	r.pkg = p;
+
+	buf = malloc(READ_BUF_LEN);
+	md5 = EVP_MD_CTX_create();
+	sha256 = EVP_MD_CTX_create();
+	if (!buf || !md5 || !sha256) {
+		ERR("out of memory");
+		goto out_free;
+	}
+
+	fd = open(p->path, O_RDONLY);
+	if (fd < 0) {
+		ERRS("unable to open %s", p->path);
+		goto out_free;
+	}
+
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	EVP_DigestInit_ex(md5, EVP_md5(), NULL);
+	EVP_DigestInit_ex(sha256, EVP_sha256(), NULL);
+
+	if (gztar_init(&r.outer, "./control.tar.gz", control_tar_data, &r) ||
+	    gztar_init(&r.inner, "./control", control_data, &r)) {
+		ERR("unable to initialize zlib");
+		goto out_close;
+	}
+
+	for (;;) {
+		n = read(fd, buf, READ_BUF_LEN);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			ERRS("unable to read %s", p->path);
+			goto out_zlib;
+		}
+		if (n == 0)
+			break;
+
+		EVP_DigestUpdate(md5, buf, n);
+		EVP_DigestUpdate(sha256, buf, n);
+		gztar_feed(&r.outer, buf, n);
+	}
+
+	EVP_DigestFinal_ex(md5, digest, &digest_len);
+	hex(p->md5, digest, digest_len);
+	EVP_DigestFinal_ex(sha256, digest, &digest_len);
+	hex(p->sha256, digest, digest_len);
+
+	if (r.overflow || !r.inner.tar.done) {
+		/* the shell version emitted nothing but a blank line here */
+		fprintf(stderr, "[%s] no control file found in %s\n",
+			progname, p->path);
+		free(p->control);
+		p->control = NULL;
+		p->control_len = 0;
+	}
+
+	ret = 0;
+
+out_zlib:
+	gztar_free(&r.inner);
+	gztar_free(&r.outer);
+out_close:
+	close(fd);
+out_free:
+	EVP_MD_CTX_destroy(sha256);
+	EVP_MD_CTX_destroy(md5);
+	free(buf);
+	return ret;
+}
+
+static void *worker(void *arg)
+{
+	struct pkg *p;
+	size_t i;
+
+	for (;;) {
+		pthread_mutex_lock(&next_lock);
+		i = next_pkg++;
+		pthread_mutex_unlock(&next_lock);
+
+		if (i >= num_pkgs)
+			break;
+
+		p = &pkgs[i];
+		if (!p->cached && read_pkg(p))
+			p->failed = 1;
+	}
+
+	return NULL;
+}
+
+static int skip_pkg(const char *path)
+{
+	const char *name = strrchr(path, '/');
+	size_t len;
+
+	name = name ? name + 1 : path;
+	len = strcspn(name, "_");
+
+	return (len == 6 && !strncmp(name, "kernel", 6)) ||
+	       (len == 4 && !strncmp(name, "libc", 4));
+}
+
+static int add_pkg(const char *path, const struct stat *st, int type,
+		   struct FTW *ftw)
+{
+	size_t len = strlen(path);
+	struct pkg *p;
+
+	if (type != FTW_F && type != FTW_SL)
+		return 0;
+
+	if (len < 4 || strcmp(path + len - 4, ".ipk"))
+		return 0;
+
+	num_found++;
+	if (skip_pkg(path))
+		return 0;
+
+	if (num_pkgs == alloc_pkgs) {
+		alloc_pkgs = alloc_pkgs ? alloc_pkgs * 2 : 256;
+		p = realloc(pkgs, alloc_pkgs * sizeof(*pkgs));
+		if (!p) {
+			ERR("out of memory");
+			return -1;
+		}
+		pkgs = p;
+	}
+
+	p = &pkgs[num_pkgs++];
+	memset(p, 0, sizeof(*p));
+	p->path = strdup(path);
+	if (!p->path) {
+		ERR("out of memory");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int cmp_pkg(const void *a, const void *b)
+{
+	const struct pkg *pa = a, *pb = b;
+
+	return strcmp(pa->path, pb->path);
+}
+
+/*
+ * Cache file format, one record per package:
+ *
+ *   <size> <mtime> <md5> <sha256> <control length> <path>\n
+ *   <control file contents>\n
+ */
+static void load_cache(const char *name)
+{
+	char line[4096], path[4096];
+	struct pkg key, *p;
+	long long size, mtime, len;
+	FILE *f;
+
+	f = fopen(name, "r");
+	if (!f)
+		return;
+
+	while (fgets(line, sizeof(line), f)) {
+		char md5[sizeof(key.md5)], sha256[sizeof(key.sha256)];
+
+		if (sscanf(line, "%lld %lld %32s %64s %lld %4095[^\n]",
+			   &size, &mtime, md5, sha256, &len, path) != 6 ||
+		    len < 0 || len > MAX_CONTROL_LEN)
+			break;
+
+		key.path = path;
+		p = bsearch(&key, pkgs, num_pkgs, sizeof(*pkgs), cmp_pkg);
+		if (!p || p->size != size || p->mtime != mtime) {
+			if (fseek(f, len + 1, SEEK_CUR))
+				break;
+			continue;
+		}
+
+		p->control = malloc(len + 1);
+		if (!p->control ||
+		    fread(p->control, 1, len + 1, f) != (size_t) len + 1) {
+			free(p->control);
+			p->control = NULL;
+			break;
+		}
+
+		p->control_len = len;
+		strcpy(p->md5, md5);
+		strcpy(p->sha256, sha256);
+		p->cached = 1;
+	}
+
+	fclose(f);
+}
+
+static void save_cache(const char *name)
+{
+	char *tmp;
+	FILE *f;
+	size_t i;
+	int fd, err = 0;
+
+	if (asprintf(&tmp, "%s.XXXXXX", name) < 0)
+		return;
+
+	fd = mkstemp(tmp);
+	if (fd < 0 || !(f = fdopen(fd, "w"))) {
+		ERRS("unable to write cache %s", name);
+		free(tmp);
+		return;
+	}
+
+	for (i = 0; i < num_pkgs; i++) {
+		struct pkg *p = &pkgs[i];
+
+		if (p->failed)
+			continue;
+
+		fprintf(f, "%lld %lld %s %s %zu %s\n",
+			(long long) p->size, (long long) p->mtime,
+			p->md5, p->sha256, p->control_len, p->path);
+		fwrite(p->control, 1, p->control_len, f);
+		fputc('\n', f);
+	}
+
+	if (ferror(f))
+		err = 1;
+	if (fclose(f))
+		err = 1;
+
+	if (err || rename(tmp, name)) {
+		ERRS("unable to write cache %s", name);
+		unlink(tmp);
+	}
+
+	free(tmp);
+}
+
+/*
+ * Emit the control file, with the index fields inserted in front of
+ * every "Description:" line, exactly like the sed expression in the
+ * shell version did.
+ */
+static void print_pkg(struct pkg *p)
+{
+	const char *c = p->control;
+	const char *end = c + p->control_len;
+	const char *filename = p->path;
+	const char *nl;
+
+	if (!strncmp(filename, "./", 2))
+		filename += 2;
+
+	while (c < end) {
+		nl = memchr(c, '\n', end - c);
+		nl = nl ? nl + 1 : end;
+
+		if (nl - c >= 12 && !memcmp(c, "Description:", 12))
+			printf("Filename: %s\n"
+			       "Size: %lld\n"
+			       "MD5Sum: %s\n"
+			       "SHA256sum: %s\n",
+			       filename, (long long) p->size,
+			       p->md5, p->sha256);
+
+		fwrite(c, 1, nl - c, stdout);
+		c = nl;
+	}
+
+	printf("\n");
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"Usage: %s [options] <package_directory>\n"
+		"\n"
+		"Options:\n"
+		"  -c <file>       cache package checksums and control files in <file>\n"
+		"  -j <jobs>       number of packages to process in parallel\n"
+		"  -h              show this screen\n",
+		progname);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *cache = NULL;
+	pthread_t *threads;
+	struct stat st;
+	long jobs = 0;
+	size_t i;
+	int c, ret = 0;
+
+	progname = argv[0];
+
+	while ((c = getopt(argc, argv, "c:j:h")) != -1) {
+		switch (c) {
+		case 'c':
+			cache = optarg;
+			break;
+		case 'j':
+			jobs = strtol(optarg, NULL, 0);
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (optind != argc - 1 || stat(argv[optind], &st) || !S_ISDIR(st.st_mode))
+		usage();
+
+	if (nftw(argv[optind], add_pkg, 16, FTW_PHYS)) {
+		ERRS("unable to scan %s", argv[optind]);
+		return 1;
+	}
+
+	if (!num_found)
+		printf("\n");
+	if (!num_pkgs)
+		return 0;
+
+	qsort(pkgs, num_pkgs, sizeof(*pkgs), cmp_pkg);
+
+	for (i = 0; i < num_pkgs; i++) {
+		if (stat(pkgs[i].path, &st)) {
+			ERRS("unable to stat %s", pkgs[i].path);
+			return 1;
+		}
+		pkgs[i].size = st.st_size;
+		pkgs[i].mtime = st.st_mtime;
+	}
+
+	if (cache)
+		load_cache(cache);
+
+	if (jobs <= 0)
+		jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	if (jobs <= 0)
+		jobs = 1;
+	if ((size_t) jobs > num_pkgs)
+		jobs = num_pkgs;
+
+	threads = calloc(jobs, sizeof(*threads));
+	if (!threads) {
+		ERR("out of memory");
+		return 1;
+	}
+
+	for (i = 1; i < (size_t) jobs; i++) {
+		if (pthread_create(&threads[i], NULL, worker, NULL)) {
+			ERR("unable to start worker thread");
+			jobs = i;
+			break;
+		}
+	}
+
+	worker(NULL);
+
+	for (i = 1; i < (size_t) jobs; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+
+	for (i = 0; i < num_pkgs; i++) {
+		struct pkg *p = &pkgs[i];
+
+		if (p->failed) {
+			ret = 1;
+			break;
+		}
+
+		fprintf(stderr, "Generating index for package %s\n", p->path);
+		print_pkg(p);
+	}
+
+	if (cache && !ret)
+		save_cache(cache);
+
+	return ret;
+}